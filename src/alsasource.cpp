@@ -0,0 +1,273 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "alsasource.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "logger.hpp"
+
+std::ostream &operator<<(std::ostream &os, const AlsaSource::Props &props) {
+    os << "name=" << props.name << ", friendly-name=" << props.friendlyName
+       << ", rate=" << props.rate
+       << ", channels=" << static_cast<int>(props.channels)
+       << ", period-size=" << props.periodSize;
+    return os;
+}
+
+AlsaSource::AlsaSource(Props props, DataReadyHandler dataReadyHandler,
+                       ErrorHandler errorHandler)
+    : m_props{std::move(props)},
+      m_dataReadyHandler{std::move(dataReadyHandler)},
+      m_errorHandler{std::move(errorHandler)} {
+    LOGD("creating alsa source: " << m_props);
+
+    if (auto err = snd_pcm_open(&m_pcm, m_props.name.c_str(),
+                                SND_PCM_STREAM_CAPTURE, 0);
+        err < 0) {
+        LOGE("snd_pcm_open error: " << snd_strerror(err));
+        throw std::runtime_error("snd_pcm_open error");
+    }
+
+    try {
+        setHwParams();
+        setSwParams();
+    } catch (...) {
+        clean();
+        throw;
+    }
+
+    LOGD("alsa source created");
+}
+
+AlsaSource::~AlsaSource() {
+    LOGD("alsa source termination started");
+    clean();
+    LOGD("alsa source termination completed");
+}
+
+void AlsaSource::clean() {
+    m_termination = true;
+    if (m_thread.joinable()) m_thread.join();
+
+    if (m_pcm != nullptr) {
+        snd_pcm_close(m_pcm);
+        m_pcm = nullptr;
+    }
+}
+
+bool AlsaSource::supported() noexcept { return true; }
+
+void AlsaSource::setHwParams() {
+    snd_pcm_hw_params_t *params = nullptr;
+    snd_pcm_hw_params_alloca(&params);
+
+    snd_pcm_hw_params_any(m_pcm, params);
+
+    if (snd_pcm_hw_params_set_access(m_pcm, params,
+                                     SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0)
+        throw std::runtime_error("alsa mmap access not supported");
+    if (snd_pcm_hw_params_set_format(m_pcm, params, m_format) < 0)
+        throw std::runtime_error("alsa format not supported");
+    if (snd_pcm_hw_params_set_channels(m_pcm, params, m_props.channels) < 0)
+        throw std::runtime_error("alsa channels not supported");
+    if (snd_pcm_hw_params_set_rate(m_pcm, params, m_props.rate, 0) < 0)
+        throw std::runtime_error("alsa rate not supported");
+
+    snd_pcm_uframes_t periodSize = m_props.periodSize;
+    int dir = 0;
+    if (snd_pcm_hw_params_set_period_size_near(m_pcm, params, &periodSize,
+                                               &dir) < 0)
+        throw std::runtime_error("alsa period size not supported");
+
+    snd_pcm_uframes_t bufferSize = periodSize * m_periods;
+    if (snd_pcm_hw_params_set_buffer_size_near(m_pcm, params, &bufferSize) <
+        0)
+        throw std::runtime_error("alsa buffer size not supported");
+
+    if (auto err = snd_pcm_hw_params(m_pcm, params); err < 0) {
+        LOGE("snd_pcm_hw_params error: " << snd_strerror(err));
+        throw std::runtime_error("snd_pcm_hw_params error");
+    }
+
+    if (periodSize != m_props.periodSize)
+        LOGW("alsa period size adjusted: " << m_props.periodSize << " => "
+                                           << periodSize);
+
+    m_props.periodSize = periodSize;
+
+    LOGD("alsa period size: " << periodSize
+                              << ", buffer size: " << bufferSize);
+}
+
+void AlsaSource::setSwParams() {
+    snd_pcm_sw_params_t *params = nullptr;
+    snd_pcm_sw_params_alloca(&params);
+
+    snd_pcm_sw_params_current(m_pcm, params);
+
+    // poll wakes up when whole period is available
+    snd_pcm_sw_params_set_avail_min(m_pcm, params, m_props.periodSize);
+
+    if (auto err = snd_pcm_sw_params(m_pcm, params); err < 0) {
+        LOGE("snd_pcm_sw_params error: " << snd_strerror(err));
+        throw std::runtime_error("snd_pcm_sw_params error");
+    }
+}
+
+void AlsaSource::start() {
+    LOGD("starting alsa source");
+
+    if (auto err = snd_pcm_start(m_pcm); err < 0) {
+        LOGE("snd_pcm_start error: " << snd_strerror(err));
+        throw std::runtime_error("snd_pcm_start error");
+    }
+
+    m_thread = std::thread{[this] {
+        LOGD("alsa source thread started");
+        doCapture();
+        LOGD("alsa source thread ended");
+    }};
+}
+
+void AlsaSource::doCapture() {
+    while (!m_termination) {
+        auto ret = snd_pcm_wait(m_pcm, m_maxWait);
+
+        if (ret == 0) continue;  // timeout
+
+        if (ret < 0 ? !recover(ret) : !readPeriods()) {
+            if (m_errorHandler) m_errorHandler();
+            break;
+        }
+    }
+}
+
+bool AlsaSource::readPeriods() {
+    auto avail = snd_pcm_avail_update(m_pcm);
+    if (avail < 0) return recover(static_cast<int>(avail));
+
+    while (avail >= static_cast<snd_pcm_sframes_t>(m_props.periodSize)) {
+        const snd_pcm_channel_area_t *areas = nullptr;
+        snd_pcm_uframes_t offset = 0;
+        auto frames = static_cast<snd_pcm_uframes_t>(avail);
+
+        if (auto err = snd_pcm_mmap_begin(m_pcm, &areas, &offset, &frames);
+            err < 0)
+            return recover(err);
+
+        // interleaved access, so all channels are in the first area
+        const auto *data = static_cast<const uint8_t *>(areas[0].addr) +
+                           (areas[0].first + offset * areas[0].step) / 8;
+        const auto size = snd_pcm_frames_to_bytes(m_pcm, frames);
+
+        LOGT("alsa audio data: " << size);
+
+        m_dataReadyHandler(data, size);
+
+        auto committed = snd_pcm_mmap_commit(m_pcm, offset, frames);
+        if (committed < 0) return recover(static_cast<int>(committed));
+        if (static_cast<snd_pcm_uframes_t>(committed) != frames)
+            return recover(-EPIPE);
+
+        avail -= committed;
+    }
+
+    return true;
+}
+
+bool AlsaSource::recover(int err) {
+    LOGW("alsa capture error: " << snd_strerror(err));
+
+    if (auto ret = snd_pcm_recover(m_pcm, err, 1); ret < 0) {
+        LOGE("snd_pcm_recover error: " << snd_strerror(ret));
+        return false;
+    }
+
+    // capture stream stays in prepared state after recovery
+    if (auto ret = snd_pcm_start(m_pcm); ret < 0) {
+        LOGE("snd_pcm_start error: " << snd_strerror(ret));
+        return false;
+    }
+
+    return true;
+}
+
+bool AlsaSource::formatSupported(const Props &props) {
+    snd_pcm_t *pcm = nullptr;
+
+    if (auto err = snd_pcm_open(&pcm, props.name.c_str(),
+                                SND_PCM_STREAM_CAPTURE, SND_PCM_NONBLOCK);
+        err < 0) {
+        LOGD("alsa pcm cannot be opened: " << props.name << " ("
+                                            << snd_strerror(err) << ")");
+        return false;
+    }
+
+    snd_pcm_hw_params_t *params = nullptr;
+    snd_pcm_hw_params_alloca(&params);
+
+    auto ok = snd_pcm_hw_params_any(pcm, params) >= 0 &&
+              snd_pcm_hw_params_test_access(
+                  pcm, params, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0 &&
+              snd_pcm_hw_params_test_format(pcm, params, m_format) == 0 &&
+              snd_pcm_hw_params_test_channels(pcm, params, props.channels) ==
+                  0 &&
+              snd_pcm_hw_params_test_rate(pcm, params, props.rate, 0) == 0;
+
+    snd_pcm_close(pcm);
+
+    if (!ok) LOGD("alsa pcm format not supported: " << props.name);
+
+    return ok;
+}
+
+std::vector<AlsaSource::Props> AlsaSource::sources() {
+    LOGD("alsa sources detection started");
+
+    std::vector<Props> sources;
+
+    void **hints = nullptr;
+    if (auto err = snd_device_name_hint(-1, "pcm", &hints); err < 0) {
+        LOGW("snd_device_name_hint error: " << snd_strerror(err));
+        return sources;
+    }
+
+    for (auto **hint = hints; *hint != nullptr; ++hint) {
+        auto *name = snd_device_name_get_hint(*hint, "NAME");
+        auto *desc = snd_device_name_get_hint(*hint, "DESC");
+        auto *ioid = snd_device_name_get_hint(*hint, "IOID");
+
+        // missing ioid means that device supports both directions
+        if (name != nullptr &&
+            (ioid == nullptr || strcmp(ioid, "Input") == 0)) {
+            Props props;
+            props.name = name;
+            props.friendlyName = desc ? desc : name;
+            std::replace(props.friendlyName.begin(), props.friendlyName.end(),
+                         '\n', ' ');
+
+            if (formatSupported(props)) {
+                LOGD("alsa pcm found: " << props);
+                sources.push_back(std::move(props));
+            }
+        }
+
+        free(name);
+        free(desc);
+        free(ioid);
+    }
+
+    snd_device_name_free_hint(hints);
+
+    LOGD("alsa sources detection completed");
+
+    return sources;
+}
@@ -0,0 +1,63 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef ALSASOURCE_HPP
+#define ALSASOURCE_HPP
+
+#include <alsa/asoundlib.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+class AlsaSource {
+   public:
+    using DataReadyHandler = std::function<void(const uint8_t *, size_t)>;
+    using ErrorHandler = std::function<void(void)>;
+
+    struct Props {
+        std::string name;  // pcm name, e.g. hw:CARD=Loopback,DEV=1
+        std::string friendlyName;
+        uint32_t rate = 48000;
+        uint8_t channels = 2;
+        uint32_t periodSize = 240;  // frames
+        friend std::ostream &operator<<(std::ostream &os, const Props &props);
+    };
+
+    AlsaSource(Props props, DataReadyHandler dataReadyHandler,
+               ErrorHandler errorHandler);
+    ~AlsaSource();
+    void start();
+    static bool supported() noexcept;
+    static std::vector<Props> sources();
+
+   private:
+    static const snd_pcm_format_t m_format = SND_PCM_FORMAT_S16_LE;
+    static const uint32_t m_periods = 4;
+    static const int m_maxWait = 100;  // ms
+
+    Props m_props;
+    DataReadyHandler m_dataReadyHandler;
+    ErrorHandler m_errorHandler;
+    snd_pcm_t *m_pcm = nullptr;
+    std::thread m_thread;
+    std::atomic_bool m_termination{false};
+
+    void clean();
+    void setHwParams();
+    void setSwParams();
+    void doCapture();
+    bool readPeriods();
+    bool recover(int err);
+    static bool formatSupported(const Props &props);
+};
+
+#endif  // ALSASOURCE_HPP
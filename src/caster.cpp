@@ -29,6 +29,9 @@
 #include <array>
 #include <cctype>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <limits>
@@ -175,6 +178,9 @@ std::ostream &operator<<(std::ostream &os, Caster::OptionsFlags flags) {
         os << "only-nice-video-formats, ";
     if (flags & Caster::OptionsFlags::MuteAudioSource)
         os << "mute-audio-source, ";
+    if (flags & Caster::OptionsFlags::V4l2Passthrough)
+        os << "v4l2-passthrough, ";
+    if (flags & Caster::OptionsFlags::V4l2Mjpeg) os << "v4l2-mjpeg, ";
     if (flags & Caster::OptionsFlags::V4l2VideoSources)
         os << "v4l2-video-sources, ";
     if (flags & Caster::OptionsFlags::DroidCamVideoSources)
@@ -185,12 +191,22 @@ std::ostream &operator<<(std::ostream &os, Caster::OptionsFlags flags) {
         os << "x11-capture-video-sources, ";
     if (flags & Caster::OptionsFlags::LipstickCaptureVideoSources)
         os << "lipstick-capture-video-sources, ";
+    if (flags & Caster::OptionsFlags::WlrCaptureVideoSources)
+        os << "wlr-capture-video-sources, ";
     if (flags & Caster::OptionsFlags::PaMicAudioSources)
         os << "pa-mic-audio-sources, ";
     if (flags & Caster::OptionsFlags::PaMonitorAudioSources)
         os << "pa-monitor-audio-sources, ";
     if (flags & Caster::OptionsFlags::PaPlaybackAudioSources)
         os << "pa-playback-audio-sources, ";
+    if (flags & Caster::OptionsFlags::PwMicAudioSources)
+        os << "pw-mic-audio-sources, ";
+    if (flags & Caster::OptionsFlags::PwMonitorAudioSources)
+        os << "pw-monitor-audio-sources, ";
+    if (flags & Caster::OptionsFlags::AlsaAudioSources)
+        os << "alsa-audio-sources, ";
+    if (flags & Caster::OptionsFlags::SynthAudioSources)
+        os << "synth-audio-sources, ";
 
     return os;
 }
@@ -220,6 +236,46 @@ std::ostream &operator<<(std::ostream &os, Caster::State state) {
     return os;
 }
 
+std::ostream &operator<<(std::ostream &os, Caster::StartupPhase phase) {
+    switch (phase) {
+        case Caster::StartupPhase::SourceDetection:
+            os << "source-detection";
+            break;
+        case Caster::StartupPhase::AvInit:
+            os << "av-init";
+            break;
+        case Caster::StartupPhase::AudioInit:
+            os << "audio-init";
+            break;
+        case Caster::StartupPhase::VideoInit:
+            os << "video-init";
+            break;
+        case Caster::StartupPhase::AudioEncoderOpen:
+            os << "audio-encoder-open";
+            break;
+        case Caster::StartupPhase::VideoEncoderOpen:
+            os << "video-encoder-open";
+            break;
+        case Caster::StartupPhase::VideoStreamInit:
+            os << "video-stream-init";
+            break;
+        case Caster::StartupPhase::HeaderWrite:
+            os << "header-write";
+            break;
+        case Caster::StartupPhase::FirstVideoFrame:
+            os << "first-video-frame";
+            break;
+        case Caster::StartupPhase::FirstAudioFrame:
+            os << "first-audio-frame";
+            break;
+        case Caster::StartupPhase::FirstMuxedData:
+            os << "first-muxed-data";
+            break;
+    }
+
+    return os;
+}
+
 std::ostream &operator<<(std::ostream &os,
                          Caster::VideoOrientation videoOrientation) {
     switch (videoOrientation) {
@@ -263,6 +319,24 @@ std::ostream &operator<<(std::ostream &os, Caster::StreamFormat streamFormat) {
     return os;
 }
 
+std::ostream &operator<<(std::ostream &os, Caster::FragmentPolicy policy) {
+    switch (policy) {
+        case Caster::FragmentPolicy::Frame:
+            os << "frame";
+            break;
+        case Caster::FragmentPolicy::Interval:
+            os << "interval";
+            break;
+        case Caster::FragmentPolicy::Gop:
+            os << "gop";
+            break;
+        default:
+            os << "unknown";
+    }
+
+    return os;
+}
+
 std::ostream &operator<<(std::ostream &os, Caster::SensorDirection direction) {
     switch (direction) {
         case Caster::SensorDirection::Back:
@@ -395,6 +469,18 @@ std::ostream &operator<<(std::ostream &os, Caster::VideoScale scale) {
     return os;
 }
 
+std::ostream &operator<<(std::ostream &os,
+                         const Caster::EncoderParams &params) {
+    os << "video-bitrate=" << params.videoBitrate << ", video-scale=";
+    if (params.videoScale)
+        os << *params.videoScale;
+    else
+        os << "auto";
+    os << ", video-framerate=" << params.videoFramerate
+       << ", audio-bitrate=" << params.audioBitrate;
+    return os;
+}
+
 std::ostream &operator<<(std::ostream &os, Caster::VideoSourceType type) {
     switch (type) {
         case Caster::VideoSourceType::DroidCam:
@@ -412,6 +498,9 @@ std::ostream &operator<<(std::ostream &os, Caster::VideoSourceType type) {
         case Caster::VideoSourceType::LipstickCapture:
             os << "lipstick-capture";
             break;
+        case Caster::VideoSourceType::WlrCapture:
+            os << "wlr-capture";
+            break;
         case Caster::VideoSourceType::Test:
             os << "test";
             break;
@@ -436,6 +525,18 @@ std::ostream &operator<<(std::ostream &os, Caster::AudioSourceType type) {
         case Caster::AudioSourceType::File:
             os << "file";
             break;
+        case Caster::AudioSourceType::PwMic:
+            os << "pw-mic";
+            break;
+        case Caster::AudioSourceType::PwMonitor:
+            os << "pw-monitor";
+            break;
+        case Caster::AudioSourceType::Alsa:
+            os << "alsa";
+            break;
+        case Caster::AudioSourceType::Synth:
+            os << "synth";
+            break;
         default:
             os << "unknown";
     }
@@ -538,9 +639,42 @@ std::ostream &operator<<(std::ostream &os, const Caster::Config &config) {
        << ", audio-volume=" << std::to_string(config.audioVolume)
        << ", stream-author=" << config.streamAuthor
        << ", stream-title=" << config.streamTitle
-       << ", video-encoder=" << config.videoEncoder << ", options=["
+       << ", video-encoder=" << config.videoEncoder
+       << ", fragment-policy=" << config.fragmentPolicy
+       << ", fragment-interval=" << config.fragmentInterval
+       << ", alsa-period-size=" << config.alsaPeriodSize
+       << ", v4l2-queue-depth=" << config.v4l2QueueDepth
+       << ", screen-capture-framerate=" << config.screenCaptureFramerate
+       << ", encoder-params=[" << config.encoderParams << "]"
+       << ", test-source=[" << config.testSourceProps << "], synth-audio=["
+       << config.synthAudioProps << "], options=["
        << static_cast<Caster::OptionsFlags>(config.options) << "]";
     if (config.fileSourceConfig) os << ", " << *config.fileSourceConfig;
+    if (!config.videoOverlaySources.empty()) {
+        os << ", video-overlay-sources=";
+        for (const auto &s : config.videoOverlaySources)
+            os << "[" << s << "], ";
+        os << "video-overlay-position=" << config.videoOverlayPosition
+           << ", video-overlay-size=" << config.videoOverlaySize
+           << ", video-overlay-opacity=" << config.videoOverlayOpacity;
+    }
+    if (!config.audioMixSources.empty()) {
+        os << ", audio-mix-sources=";
+        for (const auto &s : config.audioMixSources) os << "[" << s << "], ";
+    }
+    if (!config.outputCacheDir.empty()) {
+        os << ", output-cache-dir=" << config.outputCacheDir
+           << ", output-cache-max-size=" << config.outputCacheMaxSize;
+    }
+    if (config.timeShiftDuration > 0) {
+        os << ", time-shift-duration=" << config.timeShiftDuration
+           << ", time-shift-max-size=" << config.timeShiftMaxSize;
+    }
+    if (!config.recordDir.empty()) {
+        os << ", record-dir=" << config.recordDir
+           << ", record-max-size=" << config.recordMaxSize
+           << ", record-max-duration=" << config.recordMaxDuration;
+    }
     return os;
 }
 
@@ -604,6 +738,113 @@ bool Caster::configValid(const Config &config) const {
         return false;
     }
 
+    if (config.alsaPeriodSize < 32 || config.alsaPeriodSize > 8192) {
+        LOGW("alsa-period-size is invalid");
+        return false;
+    }
+
+    if (config.v4l2QueueDepth < 0 || config.v4l2QueueDepth > 32) {
+        LOGW("v4l2-queue-depth is invalid");
+        return false;
+    }
+
+    if (config.screenCaptureFramerate < 1 ||
+        config.screenCaptureFramerate > 60) {
+        LOGW("screen-capture-framerate is invalid");
+        return false;
+    }
+
+    if (!encoderParamsValid(config.encoderParams)) {
+        LOGW("encoder-params are invalid");
+        return false;
+    }
+
+    if (!config.videoSource.empty() &&
+        m_videoProps.at(config.videoSource).type == VideoSourceType::Test &&
+        !TestSource::propsValid(config.testSourceProps)) {
+        LOGW("test-source is invalid");
+        return false;
+    }
+
+    if (!config.videoOverlaySources.empty()) {
+        // overlays are blended into raw frames before encoding
+        if (config.videoSource.empty() ||
+            m_videoProps.at(config.videoSource).type ==
+                VideoSourceType::DroidCam) {
+            LOGW("video-overlay-sources not supported with video-source");
+            return false;
+        }
+
+        const auto &sources = config.videoOverlaySources;
+        for (const auto &name : sources) {
+            if (name == config.videoSource || m_videoProps.count(name) == 0 ||
+                std::count(sources.cbegin(), sources.cend(), name) > 1 ||
+                !videoOverlaySourceSupported(name) ||
+                (m_videoProps.at(name).type == VideoSourceType::Test &&
+                 !TestSource::propsValid(config.testSourceProps))) {
+                LOGW("video-overlay-source is invalid: " << name);
+                return false;
+            }
+        }
+
+        if (config.videoOverlayPosition != VideoOverlay::Position::TopLeft &&
+            config.videoOverlayPosition != VideoOverlay::Position::TopRight &&
+            config.videoOverlayPosition !=
+                VideoOverlay::Position::BottomLeft &&
+            config.videoOverlayPosition !=
+                VideoOverlay::Position::BottomRight) {
+            LOGW("video-overlay-position is invalid");
+            return false;
+        }
+
+        if (config.videoOverlaySize < 5 || config.videoOverlaySize > 50) {
+            LOGW("video-overlay-size is invalid");
+            return false;
+        }
+
+        if (config.videoOverlayOpacity < 1 ||
+            config.videoOverlayOpacity > 100) {
+            LOGW("video-overlay-opacity is invalid");
+            return false;
+        }
+    }
+
+    if (!config.audioMixSources.empty()) {
+        // mix sources share pa context with audio-source
+        const auto paSource = [&](const std::string &name) {
+            const auto type = m_audioProps.at(name).type;
+            return type == AudioSourceType::Mic ||
+                   type == AudioSourceType::Monitor;
+        };
+
+        if (config.audioSource.empty() ||
+            (!paSource(config.audioSource) &&
+             m_audioProps.at(config.audioSource).type !=
+                 AudioSourceType::Playback) ||
+            !audioMixCodecSupported(
+                m_audioProps.at(config.audioSource).codec)) {
+            LOGW("audio-mix-sources not supported with audio-source");
+            return false;
+        }
+
+        const auto &sources = config.audioMixSources;
+        for (const auto &name : sources) {
+            if (name == config.audioSource || m_audioProps.count(name) == 0 ||
+                std::count(sources.cbegin(), sources.cend(), name) > 1 ||
+                !paSource(name)) {
+                LOGW("audio-mix-source is invalid: " << name);
+                return false;
+            }
+        }
+    }
+
+    if (!config.audioSource.empty() &&
+        m_audioProps.at(config.audioSource).type == AudioSourceType::Synth &&
+        !SynthAudioSource::propsValid(config.synthAudioProps)) {
+        LOGW("synth-audio is invalid");
+        return false;
+    }
+
     if (config.streamAuthor.empty()) {
         LOGW("stream-author is invalid");
         return false;
@@ -614,6 +855,53 @@ bool Caster::configValid(const Config &config) const {
         return false;
     }
 
+    if (!config.recordDir.empty() &&
+        access(config.recordDir.c_str(), W_OK) != 0) {
+        LOGW("record-dir is not writable");
+        return false;
+    }
+
+    if (config.recordMaxSize < 0 || config.recordMaxDuration < 0) {
+        LOGW("record limits are invalid");
+        return false;
+    }
+
+    if (!config.outputCacheDir.empty() &&
+        (access(config.outputCacheDir.c_str(), W_OK) != 0 ||
+         config.outputCacheMaxSize <= 0)) {
+        LOGW("output-cache params are invalid");
+        return false;
+    }
+
+    if (config.timeShiftDuration < 0 ||
+        (config.timeShiftDuration > 0 &&
+         (config.timeShiftMaxSize <= 0 ||
+          config.timeShiftMaxSize > timeShiftMaxSizeLimit))) {
+        LOGW("time-shift params are invalid");
+        return false;
+    }
+
+    return true;
+}
+
+bool Caster::encoderParamsValid(const EncoderParams &params) {
+    if (params.videoBitrate != 0 &&
+        (params.videoBitrate < 100 || params.videoBitrate > 100000)) {
+        LOGW("video-bitrate is invalid");
+        return false;
+    }
+
+    if (params.videoFramerate < 0 || params.videoFramerate > 120) {
+        LOGW("video-framerate is invalid");
+        return false;
+    }
+
+    if (params.audioBitrate != 0 &&
+        (params.audioBitrate < 32 || params.audioBitrate > 320)) {
+        LOGW("audio-bitrate is invalid");
+        return false;
+    }
+
     return true;
 }
 
@@ -628,18 +916,40 @@ Caster::Caster(Config config, DataReadyHandler dataReadyHandler,
     LOGD("creating caster, config: " << m_config);
 
     try {
+        auto time = av_gettime();
         detectSources(m_config.options);
 #ifdef USE_V4L2
         detectV4l2Encoders();
 #endif
+        addStartupTime(StartupPhase::SourceDetection, time);
+
         if (!configValid(m_config))
             throw std::runtime_error("invalid configuration");
 
         LOGD("audio enabled: " << audioEnabled());
         LOGD("video enabled: " << videoEnabled());
 
-        if (audioEnabled()) initAudioSource();
-        if (videoEnabled()) initVideoSource();
+        m_encoderParams = m_config.encoderParams;
+        m_requestedEncoderParams = m_config.encoderParams;
+
+        if (!m_config.recordDir.empty()) {
+            m_recorder.emplace(Recorder::Props{
+                m_config.recordDir,
+                m_config.streamFormat == StreamFormat::Mp4      ? "mp4"
+                : m_config.streamFormat == StreamFormat::MpegTs ? "ts"
+                                                                : "mp3",
+                static_cast<size_t>(m_config.recordMaxSize) * 0x100000,
+                std::chrono::seconds{m_config.recordMaxDuration},
+                m_config.streamFormat == StreamFormat::MpegTs ? 188u : 0u});
+        }
+
+        if (m_config.timeShiftDuration > 0) {
+            m_timeShiftBuffer.emplace(TimeShiftBuffer::Props{
+                std::chrono::seconds{m_config.timeShiftDuration},
+                static_cast<size_t>(m_config.timeShiftMaxSize) * 0x100000});
+        }
+
+        if (outputCacheSupported()) initOutputCache();
 
         initAv();
     } catch (...) {
@@ -652,6 +962,9 @@ Caster::~Caster() {
     LOGD("caster termination started");
     setState(State::Terminating, false);
     m_videoCv.notify_all();
+#ifdef USE_V4L2
+    m_v4l2Source.reset();
+#endif
 #ifdef USE_DROIDCAM
     m_droidCamSource.reset();
     m_orientationMonitor.reset();
@@ -659,7 +972,20 @@ Caster::~Caster() {
 #ifdef USE_LIPSTICK_RECORDER
     m_lipstickRecorder.reset();
 #endif
+#ifdef USE_WLR_CAPTURE
+    m_wlrCapture.reset();
+#endif
+#ifdef USE_PIPEWIRE
+    m_pwSource.reset();
+#endif
+#ifdef USE_ALSA
+    m_alsaSource.reset();
+#endif
+    m_synthAudioSource.reset();
     clean();
+    // overlays are blended on muxing thread, so removed after join
+    m_videoOverlays.clear();
+    m_videoSwitchSource.reset();
     LOGD("caster termination completed");
 }
 
@@ -674,6 +1000,20 @@ void Caster::initAudioSource() {
         case AudioSourceType::Playback:
             initPa();
             break;
+#ifdef USE_PIPEWIRE
+        case AudioSourceType::PwMic:
+        case AudioSourceType::PwMonitor:
+            initPw();
+            break;
+#endif
+#ifdef USE_ALSA
+        case AudioSourceType::Alsa:
+            initAlsa();
+            break;
+#endif
+        case AudioSourceType::Synth:
+            initSynthAudio();
+            break;
         case AudioSourceType::File:
             initFiles();
             break;
@@ -685,30 +1025,54 @@ void Caster::initAudioSource() {
 void Caster::initVideoSource() {
     initVideoTrans();
 
+#ifdef USE_DROIDCAM
+    if (videoProps().type == VideoSourceType::DroidCamRaw)
+        m_orientationMonitor.emplace();
+#endif
+
+    initVideoCapture();
+}
+
+void Caster::initVideoCapture() {
     const auto &props = videoProps();
 
     if (props.type == VideoSourceType::Test)
-        m_imageProvider.emplace([this](const uint8_t *data, size_t size) {
-            rawVideoDataReadyHandler(data, size);
-        });
+        m_imageProvider.emplace(
+            m_config.testSourceProps,
+            [this](const uint8_t *data, size_t size) {
+                rawVideoDataReadyHandler(data, size);
+            });
 #ifdef USE_LIPSTICK_RECORDER
     if (props.type == VideoSourceType::LipstickCapture)
         m_lipstickRecorder.emplace(
-            [this](const uint8_t *data, size_t size) {
-                rawVideoDataReadyHandler(data, size);
+            static_cast<uint32_t>(m_config.screenCaptureFramerate),
+            [this](const uint8_t *data, size_t size, int64_t captureTime) {
+                rawVideoDataReadyHandler(data, size, captureTime);
             },
             [this] {
                 LOGE("error in lipstick-recorder");
                 reportError();
             });
 #endif
+#ifdef USE_WLR_CAPTURE
+    if (props.type == VideoSourceType::WlrCapture)
+        m_wlrCapture.emplace(
+            static_cast<uint32_t>(std::stoi(props.dev)),
+            static_cast<uint32_t>(m_config.screenCaptureFramerate),
+            [this](const uint8_t *data, size_t size, int64_t captureTime) {
+                rawVideoDataReadyHandler(data, size, captureTime);
+            },
+            [this] {
+                LOGE("error in wlr-capture");
+                reportError();
+            });
+#endif
 #ifdef USE_DROIDCAM
     if (props.type == VideoSourceType::DroidCamRaw) {
-        m_orientationMonitor.emplace();
         m_droidCamSource.emplace(
             false, std::stoi(props.dev),
-            [this](const uint8_t *data, size_t size) {
-                rawVideoDataReadyHandler(data, size);
+            [this](const uint8_t *data, size_t size, int64_t captureTime) {
+                rawVideoDataReadyHandler(data, size, captureTime);
             },
             [this] {
                 LOGE("error in droidcam-source");
@@ -717,7 +1081,8 @@ void Caster::initVideoSource() {
     } else if (props.type == VideoSourceType::DroidCam) {
         m_droidCamSource.emplace(
             true, std::stoi(props.dev),
-            [this](const uint8_t *data, size_t size) {
+            // pts of compressed stream are read by demuxer
+            [this](const uint8_t *data, size_t size, int64_t) {
                 compressedVideoDataReadyHandler(data, size);
             },
             [this] {
@@ -750,6 +1115,7 @@ void Caster::initVideoTrans() {
         case VideoSourceType::V4l2:
         case VideoSourceType::X11Capture:
         case VideoSourceType::LipstickCapture:
+        case VideoSourceType::WlrCapture:
         case VideoSourceType::Test:
         case VideoSourceType::DroidCamRaw:
             break;
@@ -804,11 +1170,13 @@ std::vector<Caster::AudioSourceProps> Caster::audioSources(uint32_t options) {
 }
 
 void Caster::detectSources(uint32_t options) {
-    m_audioProps = detectAudioSources(options);
-    m_videoProps = detectVideoSources(options);
+    m_audioProps = detectAudioSources(options, m_config.synthAudioProps);
+    m_videoProps = detectVideoSources(options, m_config.testSourceProps,
+                                      m_config.screenCaptureFramerate);
 }
 
-Caster::AudioPropsMap Caster::detectAudioSources(uint32_t options) {
+Caster::AudioPropsMap Caster::detectAudioSources(
+    uint32_t options, const SynthAudioSource::Props &synthAudioProps) {
     AudioPropsMap props;
 
     if (options & OptionsFlags::PaMicAudioSources ||
@@ -816,6 +1184,20 @@ Caster::AudioPropsMap Caster::detectAudioSources(uint32_t options) {
         options & OptionsFlags::PaPlaybackAudioSources)
         props.merge(detectPaSources(options));
 
+#ifdef USE_PIPEWIRE
+    if (options & OptionsFlags::PwMicAudioSources ||
+        options & OptionsFlags::PwMonitorAudioSources)
+        props.merge(detectPwSources(options));
+#endif
+
+#ifdef USE_ALSA
+    if (options & OptionsFlags::AlsaAudioSources)
+        props.merge(detectAlsaSources());
+#endif
+
+    if (options & OptionsFlags::SynthAudioSources)
+        props.merge(detectSynthAudioSources(synthAudioProps));
+
     if (options & OptionsFlags::FileAudioSources)
         props.merge(detectAudioFileSources());
 
@@ -963,6 +1345,64 @@ Caster::AudioPropsMap Caster::detectPaSources(uint32_t options) {
     return std::move(result.propsMap);
 }
 
+Caster::AudioPropsMap Caster::detectSynthAudioSources(
+    const SynthAudioSource::Props &sprops) {
+    LOGD("synth audio sources detection started");
+
+    AudioPropsMap map;
+
+    if (SynthAudioSource::supported()) {
+        for (auto signal : SynthAudioSource::signals()) {
+            std::ostringstream os;
+            os << signal;
+
+            AudioSourceInternalProps props{
+                /*name=*/fmt::format("synth-{}", os.str()),
+                /*dev=*/std::to_string(static_cast<int>(signal)),
+                /*friendlyName=*/fmt::format("Synthetic {}", os.str()),
+                /*codec=*/av_get_pcm_codec(sprops.sampleFmt, 0),
+                /*channels=*/sprops.channels,
+                /*rate=*/sprops.rate,
+                /*bps=*/
+                static_cast<size_t>(av_get_bytes_per_sample(sprops.sampleFmt)),
+                /*type=*/AudioSourceType::Synth};
+
+            LOGD("synth audio source found: " << props);
+
+            map.try_emplace(props.name, std::move(props));
+        }
+    }
+
+    LOGD("synth audio sources detection completed");
+
+    return map;
+}
+
+void Caster::initSynthAudio() {
+    auto sprops = m_config.synthAudioProps;
+    sprops.signal =
+        static_cast<SynthAudioSource::Signal>(std::stoi(audioProps().dev));
+
+    m_synthAudioSource.emplace(sprops,
+                               [this](const uint8_t *data, size_t size) {
+                                   synthAudioDataReadyHandler(data, size);
+                               });
+}
+
+void Caster::synthAudioDataReadyHandler(const uint8_t *data, size_t size) {
+    std::lock_guard lock{m_audioMtx};
+
+    if (m_state != State::Started) return;
+
+    m_audioBuf.pushExactForce(data, size);
+
+    if (!m_synthAudioDataReceived) {
+        m_synthAudioDataReceived = true;
+        LOGD("first synth audio data received");
+        addStartupTime(StartupPhase::FirstAudioFrame);
+    }
+}
+
 Caster::AudioPropsMap Caster::detectAudioFileSources() {
     LOGD("audio file sources detection started");
 
@@ -988,10 +1428,46 @@ void Caster::setState(State newState, bool notify) {
     if (m_state != newState) {
         LOGD("changing state: " << m_state << " => " << newState);
         m_state = newState;
-        if (notify && m_stateChangedHandler) m_stateChangedHandler(newState);
+        if (notify && !m_detached && m_stateChangedHandler)
+            m_stateChangedHandler(newState);
     }
 }
 
+void Caster::addStartupTime(StartupPhase phase, int64_t startTime) {
+    auto now = av_gettime();
+
+    StartupPhaseTime pt{phase, startTime - m_creationTime, now - startTime};
+
+    LOGD("startup phase " << phase << ": start=" << pt.start / 1000
+                          << "ms, duration=" << pt.duration / 1000 << "ms");
+
+    std::lock_guard lock{m_startupTimesMtx};
+
+    auto it = std::find_if(m_startupTimes.begin(), m_startupTimes.end(),
+                           [phase](const auto &t) { return t.phase == phase; });
+    if (it == m_startupTimes.end())
+        m_startupTimes.push_back(pt);
+    else
+        *it = pt;
+}
+
+void Caster::addStartupTime(StartupPhase phase) {
+    addStartupTime(phase, av_gettime());
+}
+
+void Caster::markVideoDataReceived() {
+    if (m_videoDataReceived) return;
+
+    m_videoDataReceived = true;
+    LOGD("first video data received");
+    addStartupTime(StartupPhase::FirstVideoFrame);
+}
+
+std::vector<Caster::StartupPhaseTime> Caster::startupTimes() const {
+    std::lock_guard lock{m_startupTimesMtx};
+    return m_startupTimes;
+}
+
 void Caster::start(bool startPaused) {
     if (m_state == State::Paused && !startPaused) {
         LOGW("resuming instead of starting");
@@ -1007,6 +1483,18 @@ void Caster::start(bool startPaused) {
     setState(State::Starting);
 
     try {
+        if (m_outputCache && !startPaused) {
+            // cached output is sent as it is, sources are not started
+            if (auto entry = m_outputCache->find()) {
+                setState(State::Started);
+                startOutputCacheReplay(std::move(*entry));
+                return;
+            }
+
+            std::lock_guard lock{m_dataReadyHandlerMtx};
+            m_outputCache->begin();
+        }
+
         if (videoEnabled()) startVideoSource();
 
         startAv();
@@ -1026,86 +1514,537 @@ void Caster::start(bool startPaused) {
 }
 
 void Caster::startVideoSource() {
-    const auto &props = videoProps();
+#ifdef USE_DROIDCAM
+    if (m_orientationMonitor) m_orientationMonitor->start();
+#endif
+
+    startVideoCapture();
+
+    for (auto &source : m_videoOverlays) source.start();
+}
 
-    if (props.type == VideoSourceType::Test) m_imageProvider->start();
+void Caster::startVideoCapture() {
+    if (m_imageProvider) m_imageProvider->start();
+#ifdef USE_V4L2
+    if (m_v4l2Source) m_v4l2Source->start();
+#endif
 #ifdef USE_LIPSTICK_RECORDER
     if (m_lipstickRecorder) m_lipstickRecorder->start();
 #endif
+#ifdef USE_WLR_CAPTURE
+    if (m_wlrCapture) m_wlrCapture->start();
+#endif
 #ifdef USE_DROIDCAM
-    if (m_orientationMonitor) m_orientationMonitor->start();
     if (m_droidCamSource) m_droidCamSource->start();
 #endif
 }
 
-void Caster::startAudioSource() {
-    const auto &props = audioProps();
+bool Caster::videoOverlaySourceSupported(const std::string &name) const {
+    const auto &props = m_videoProps.at(name);
 
     switch (props.type) {
-        case AudioSourceType::Mic:
-        case AudioSourceType::Monitor:
-        case AudioSourceType::Playback:
-            startPa();
-            break;
+        case VideoSourceType::Test:
+            return true;
+#ifdef USE_V4L2
+        case VideoSourceType::V4l2:
+            // overlay is captured with v4l2-source, so only raw formats
+            return std::any_of(
+                props.formats.cbegin(), props.formats.cend(),
+                [](const auto &f) {
+                    return f.codecId == AV_CODEC_ID_RAWVIDEO &&
+                           f.pixfmt != AV_PIX_FMT_NONE &&
+                           !f.frameSpecs.empty();
+                });
+#endif
+#ifdef USE_WLR_CAPTURE
+        case VideoSourceType::WlrCapture:
+            return !props.formats.empty();
+#endif
         default:
-            break;
+            return false;
     }
 }
 
-void Caster::pause() {
-    if (m_state != State::Started) {
-        LOGW("pause is only possible in not started state");
+void Caster::initVideoOverlays() {
+    if (m_config.videoOverlaySources.empty()) return;
+
+    if (!VideoOverlay::pixfmtSupported(m_outVideoCtx->pix_fmt))
+        throw std::runtime_error(
+            fmt::format("video overlays do not support encoder pixfmt: {}",
+                        av_get_pix_fmt_name(m_outVideoCtx->pix_fmt)));
+
+    // overlays are stacked from the corner, offset is a distance from
+    // top or bottom edge, even value keeps rects aligned to chroma
+    auto offset =
+        (static_cast<uint32_t>(m_outVideoCtx->width) * m_videoOverlayMargin /
+         100) &
+        ~1U;
+
+    for (const auto &name : m_config.videoOverlaySources)
+        initVideoOverlay(m_videoProps.at(name), offset);
+}
+
+void Caster::initVideoOverlay(const VideoSourceInternalProps &props,
+                              uint32_t &offset) {
+    const auto width =
+        (static_cast<uint32_t>(m_outVideoCtx->width) *
+         static_cast<uint32_t>(m_config.videoOverlaySize) / 100) &
+        ~1U;
+
+    auto oprops = videoOverlayProps(props, width);
+    oprops.width = width;
+    oprops.opacity = static_cast<uint32_t>(m_config.videoOverlayOpacity);
+
+    const auto margin = (oprops.dstWidth * m_videoOverlayMargin / 100) & ~1U;
+
+    if (oprops.srcWidth > 0)
+        oprops.height = static_cast<uint32_t>(
+                            static_cast<uint64_t>(oprops.width) *
+                            oprops.srcHeight / oprops.srcWidth) &
+                        ~1U;
+
+    if (oprops.height == 0 || oprops.width + 2 * margin > oprops.dstWidth ||
+        offset + oprops.height + margin > oprops.dstHeight) {
+        LOGW("no space for video overlay: " << props.name);
         return;
     }
 
-    setState(State::Paused);
-
-    m_videoCv.notify_all();
-    if (m_avMuxingThread.joinable()) m_avMuxingThread.join();
-}
+    const auto pos = m_config.videoOverlayPosition;
+    oprops.x = pos == VideoOverlay::Position::TopLeft ||
+                       pos == VideoOverlay::Position::BottomLeft
+                   ? margin
+                   : oprops.dstWidth - oprops.width - margin;
+    oprops.y = pos == VideoOverlay::Position::TopLeft ||
+                       pos == VideoOverlay::Position::TopRight
+                   ? offset
+                   : oprops.dstHeight - oprops.height - offset;
+    offset += oprops.height + margin;
 
-void Caster::resume() {
-    if (m_state != State::Paused) {
-        LOGW("resume is only possible in paused state");
-        return;
-    }
+    LOGD("initing video overlay: " << props.name);
 
-    reInitAvOutputFormat();
-    setState(State::Started);
-    startMuxing();
+    initVideoOverlaySource(m_videoOverlays.emplace_back(oprops), props, width);
 }
 
-void Caster::clean() {
-    if (m_avMuxingThread.joinable()) m_avMuxingThread.join();
-    LOGD("av muxing thread joined");
-    if (m_audioPaThread.joinable()) m_audioPaThread.join();
-    LOGD("pa thread joined");
-    cleanPa();
-    LOGD("pa cleaned");
-    cleanAv();
-    LOGD("av cleaned");
-}
+const Caster::VideoFormatExt &Caster::videoOverlayFormat(
+    const VideoSourceInternalProps &props) {
+    // overlay is captured with v4l2-source, so only raw formats
+    auto it = std::find_if(
+        props.formats.cbegin(), props.formats.cend(), [](const auto &f) {
+            return f.codecId == AV_CODEC_ID_RAWVIDEO &&
+                   f.pixfmt != AV_PIX_FMT_NONE && !f.frameSpecs.empty();
+        });
+    if (it == props.formats.cend())
+        throw std::runtime_error("no video overlay format");
 
-std::string Caster::strForAvOpts(const AVDictionary *opts) {
-    if (opts == nullptr) return {};
+    return *it;
+}
 
-    std::ostringstream os;
+const Caster::FrameSpec &Caster::videoOverlayFrameSpec(
+    const VideoFormatExt &format, uint32_t width) {
+    // smallest dim that is not upscaled, otherwise the biggest one
+    const auto fits = [width](const FrameSpec &fs) {
+        return fs.dim.width >= width;
+    };
 
-    AVDictionaryEntry *t = nullptr;
-    while ((t = av_dict_get(opts, "", t, AV_DICT_IGNORE_SUFFIX))) {
-        os << "[" << t->key << "=" << t->value << "],";
+    const auto *spec = &format.frameSpecs.front();
+    for (const auto &fs : format.frameSpecs) {
+        if (fits(fs) ? !fits(*spec) || spec->dim > fs.dim
+                     : !fits(*spec) && fs.dim > spec->dim)
+            spec = &fs;
     }
 
-    return os.str();
+    return *spec;
 }
 
-void Caster::cleanAvOutputFormat() {
-    if (m_outFormatCtx != nullptr) {
-        if (m_outFormatCtx->pb != nullptr) {
-            if (m_outFormatCtx->pb->buffer != nullptr &&
-                m_outFormatCtx->flags & AVFMT_FLAG_CUSTOM_IO)
-                av_freep(&m_outFormatCtx->pb->buffer);
-            avio_context_free(&m_outFormatCtx->pb);
+VideoOverlay::Props Caster::videoOverlayProps(
+    const VideoSourceInternalProps &props, uint32_t width) const {
+    VideoOverlay::Props oprops;
+    oprops.dstWidth = static_cast<uint32_t>(m_outVideoCtx->width);
+    oprops.dstHeight = static_cast<uint32_t>(m_outVideoCtx->height);
+    oprops.dstPixfmt = m_outVideoCtx->pix_fmt;
+
+    switch (props.type) {
+        case VideoSourceType::Test:
+            oprops.srcWidth = m_config.testSourceProps.width;
+            oprops.srcHeight = m_config.testSourceProps.height;
+            oprops.srcPixfmt = m_config.testSourceProps.pixfmt;
+            break;
+        case VideoSourceType::V4l2: {
+            const auto &format = videoOverlayFormat(props);
+            const auto &spec = videoOverlayFrameSpec(format, width);
+            oprops.srcWidth = spec.dim.width;
+            oprops.srcHeight = spec.dim.height;
+            oprops.srcPixfmt = format.pixfmt;
+            break;
+        }
+        case VideoSourceType::WlrCapture: {
+            const auto &format = props.formats.front();
+            oprops.srcWidth = format.frameSpecs.front().dim.width;
+            oprops.srcHeight = format.frameSpecs.front().dim.height;
+            oprops.srcPixfmt = format.pixfmt;
+            break;
+        }
+        default:
+            throw std::runtime_error("unsupported video overlay source");
+    }
+
+    return oprops;
+}
+
+void Caster::initVideoOverlaySource(
+    VideoOverlaySource &source, const VideoSourceInternalProps &props,
+    [[maybe_unused]] uint32_t width) {
+    // overlay source failure does not stop casting, the last frame stays
+    [[maybe_unused]] auto errorHandler = [name = props.name] {
+        LOGE("error in video overlay source: " << name);
+    };
+
+    switch (props.type) {
+        case VideoSourceType::Test:
+            source.framerate = m_config.testSourceProps.framerate;
+            source.testSource.emplace(
+                m_config.testSourceProps,
+                [&overlay = source.overlay](const uint8_t *data, size_t size) {
+                    overlay.push(data, size);
+                });
+            break;
+#ifdef USE_V4L2
+        case VideoSourceType::V4l2: {
+            const auto &format = videoOverlayFormat(props);
+            const auto &spec = videoOverlayFrameSpec(format, width);
+            V4l2Source::Props vprops{props.dev, spec.dim.width,
+                                     spec.dim.height, *spec.framerates.begin(),
+                                     format.pixfmt};
+            if (m_config.v4l2QueueDepth > 0)
+                vprops.queueDepth =
+                    static_cast<uint32_t>(m_config.v4l2QueueDepth);
+            source.framerate = static_cast<uint32_t>(*spec.framerates.begin());
+            source.v4l2Source.emplace(
+                std::move(vprops),
+                [&overlay = source.overlay](
+                    AVFrame *frame, [[maybe_unused]] int64_t captureTime) {
+                    overlay.push(frame);
+                },
+                std::move(errorHandler));
+            break;
+        }
+#endif
+#ifdef USE_WLR_CAPTURE
+        case VideoSourceType::WlrCapture:
+            source.framerate =
+                static_cast<uint32_t>(m_config.screenCaptureFramerate);
+            source.wlrCapture.emplace(
+                static_cast<uint32_t>(std::stoi(props.dev)),
+                static_cast<uint32_t>(m_config.screenCaptureFramerate),
+                [&source](const uint8_t *data, size_t size, int64_t) {
+                    source.overlay.push(data, size,
+                                        source.wlrCapture->yinverted());
+                },
+                std::move(errorHandler));
+            break;
+#endif
+        default:
+            throw std::runtime_error("unsupported video overlay source");
+    }
+}
+
+std::vector<std::string> Caster::exclusiveSources() const {
+    const auto exclusiveVideo = [this](const std::string &name) {
+        if (name.empty() || m_videoProps.count(name) == 0) return false;
+        switch (m_videoProps.at(name).type) {
+            case VideoSourceType::Test:
+            case VideoSourceType::X11Capture:
+            case VideoSourceType::WlrCapture:
+                return false;
+            default:
+                return true;
+        }
+    };
+
+    std::vector<std::string> sources;
+
+    if (exclusiveVideo(m_config.videoSource))
+        sources.push_back(m_config.videoSource);
+    for (const auto &name : m_config.videoOverlaySources)
+        if (exclusiveVideo(name)) sources.push_back(name);
+    {
+        std::lock_guard lock{m_videoSwitchMtx};
+        if (exclusiveVideo(m_videoSwitchSourceName))
+            sources.push_back(m_videoSwitchSourceName);
+    }
+    if (!m_config.audioSource.empty() &&
+        m_audioProps.count(m_config.audioSource) != 0 &&
+        m_audioProps.at(m_config.audioSource).type == AudioSourceType::Alsa)
+        sources.push_back(m_config.audioSource);
+
+    return sources;
+}
+
+void Caster::switchVideoSource(const std::string &name) {
+    if (!videoEnabled() || m_videoPassthrough || m_outVideoCtx == nullptr ||
+        videoProps().type == VideoSourceType::DroidCam)
+        throw std::runtime_error("video source switching not supported");
+
+    const auto switched = !name.empty() && name != m_config.videoSource;
+
+    // device used by overlay can't be opened twice
+    if (switched &&
+        (m_videoProps.count(name) == 0 || !videoOverlaySourceSupported(name) ||
+         std::find(m_config.videoOverlaySources.cbegin(),
+                   m_config.videoOverlaySources.cend(),
+                   name) != m_config.videoOverlaySources.cend()))
+        throw std::runtime_error("unsupported video source: " + name);
+
+    {
+        std::lock_guard lock{m_videoEncoderMtx};
+        if (!VideoOverlay::pixfmtSupported(m_outVideoCtx->pix_fmt))
+            throw std::runtime_error("encoder pixfmt not supported");
+    }
+
+    LOGD("switching video source: "
+         << (switched ? name : m_config.videoSource));
+
+    // sources are replaced on muxing thread between frames
+    std::lock_guard lock{m_videoSwitchMtx};
+    m_pendingVideoSwitch = switched ? name : std::string{};
+}
+
+void Caster::switchVideoSourceIfNeeded() {
+    std::optional<std::string> name;
+    {
+        std::lock_guard lock{m_videoSwitchMtx};
+        name.swap(m_pendingVideoSwitch);
+    }
+
+    if (!name) return;
+
+    // previous switched source releases its device first
+    m_videoSwitchSource.reset();
+
+    if (!name->empty()) {
+        suspendVideoCapture();
+        try {
+            m_videoSwitchSource = makeVideoSwitchSource(*name);
+        } catch (const std::runtime_error &e) {
+            LOGW("failed to switch video source: " << e.what());
+            name->clear();
+        }
+    }
+
+    if (name->empty()) resumeVideoCapture();
+
+    {
+        std::lock_guard lock{m_videoSwitchMtx};
+        m_videoSwitchSourceName = *name;
+    }
+
+    // timing follows framerate of the source in use
+    const auto framerate =
+        m_videoSwitchSource && m_videoSwitchSource->framerate > 0
+            ? static_cast<int>(m_videoSwitchSource->framerate)
+            : m_videoFramerate;
+    m_videoRealFrameDuration = rescaleToUsec(1, AVRational{1, framerate});
+    m_videoFrameDuration = m_videoRealFrameDuration / 2;
+
+    // clients resync at the cut
+    m_forceVideoKeyframe = true;
+}
+
+void Caster::suspendVideoCapture() {
+    if (m_videoCaptureSuspended) return;
+
+    LOGD("suspending capture of video source");
+
+    m_videoCaptureSuspended = true;
+
+    // sources are destroyed, so their devices are closed
+    m_imageProvider.reset();
+#ifdef USE_V4L2
+    m_v4l2Source.reset();
+    m_mjpegDecoder.reset();
+    if (m_v4l2Frame != nullptr) {
+        std::lock_guard lock{m_videoMtx};
+        av_frame_unref(m_v4l2Frame);
+    }
+#endif
+#ifdef USE_LIPSTICK_RECORDER
+    m_lipstickRecorder.reset();
+#endif
+#ifdef USE_WLR_CAPTURE
+    m_wlrCapture.reset();
+#endif
+#ifdef USE_DROIDCAM
+    m_droidCamSource.reset();
+#endif
+    // x11 screen is grabbed only when frame is read
+    if (videoProps().type == VideoSourceType::V4l2) cleanAvVideoInputFormat();
+}
+
+void Caster::resumeVideoCapture() {
+    if (!m_videoCaptureSuspended) return;
+
+    LOGD("resuming capture of video source");
+
+    m_videoCaptureSuspended = false;
+
+    {
+        // frame captured before suspension is stale
+        std::lock_guard lock{m_videoMtx};
+        m_videoBuf.clear();
+    }
+
+    if (videoProps().type != VideoSourceType::V4l2) {
+        initVideoCapture();
+        startVideoCapture();
+        return;
+    }
+
+#ifdef USE_V4L2
+    if (v4l2CaptureEnabled()) {
+        initV4l2Capture();
+        m_v4l2Source->start();
+        return;
+    }
+#endif
+    initAvVideoInputRawFormat();
+    findAvVideoInputStreamIdx();
+#ifdef USE_V4L2
+    if (m_inVideoCodecId == AV_CODEC_ID_MJPEG) initMjpegDecoder();
+#endif
+}
+
+std::unique_ptr<Caster::VideoOverlaySource> Caster::makeVideoSwitchSource(
+    const std::string &name) {
+    const auto &props = m_videoProps.at(name);
+
+    auto oprops =
+        videoOverlayProps(props, static_cast<uint32_t>(m_outVideoCtx->width));
+    if (oprops.srcWidth == 0 || oprops.srcHeight == 0)
+        throw std::runtime_error("invalid video source dim: " + name);
+
+    // new source covers the whole frame keeping its aspect ratio
+    const auto scale =
+        std::min(static_cast<double>(oprops.dstWidth) / oprops.srcWidth,
+                 static_cast<double>(oprops.dstHeight) / oprops.srcHeight);
+    oprops.width = std::min(
+        static_cast<uint32_t>(oprops.srcWidth * scale) & ~1U, oprops.dstWidth);
+    oprops.height =
+        std::min(static_cast<uint32_t>(oprops.srcHeight * scale) & ~1U,
+                 oprops.dstHeight);
+    oprops.x = ((oprops.dstWidth - oprops.width) / 2) & ~1U;
+    oprops.y = ((oprops.dstHeight - oprops.height) / 2) & ~1U;
+    oprops.fill = true;
+
+    auto source = std::make_unique<VideoOverlaySource>(oprops);
+    initVideoOverlaySource(*source, props, oprops.width);
+    source->start();
+
+    return source;
+}
+
+void Caster::blendVideoOverlays(AVFrame *frame) {
+    // decoded frame may share its buffer with input packet
+    if (av_frame_make_writable(frame) < 0) {
+        LOGW("failed to make video frame writable");
+        return;
+    }
+
+    for (auto &source : m_videoOverlays) source.overlay.blend(frame);
+}
+
+void Caster::startAudioSource() {
+    const auto &props = audioProps();
+
+    switch (props.type) {
+        case AudioSourceType::Mic:
+        case AudioSourceType::Monitor:
+        case AudioSourceType::Playback:
+            startPa();
+            break;
+#ifdef USE_PIPEWIRE
+        case AudioSourceType::PwMic:
+        case AudioSourceType::PwMonitor:
+            m_pwDataReceived = false;
+            m_pwSource->start();
+            break;
+#endif
+#ifdef USE_ALSA
+        case AudioSourceType::Alsa:
+            m_alsaDataReceived = false;
+            m_alsaSource->start();
+            break;
+#endif
+        case AudioSourceType::Synth:
+            m_synthAudioDataReceived = false;
+            m_synthAudioSource->start();
+            break;
+        default:
+            break;
+    }
+}
+
+void Caster::pause() {
+    if (m_state != State::Started) {
+        LOGW("pause is only possible in not started state");
+        return;
+    }
+
+    if (m_outputCacheReplaying) {
+        LOGW("pause is not possible when cached output is sent");
+        return;
+    }
+
+    setState(State::Paused);
+
+    m_videoCv.notify_all();
+    if (m_avMuxingThread.joinable()) m_avMuxingThread.join();
+}
+
+void Caster::resume() {
+    if (m_state != State::Paused) {
+        LOGW("resume is only possible in paused state");
+        return;
+    }
+
+    reInitAvOutputFormat();
+    // first frame after resume is measured again
+    m_videoDataReceived = false;
+    setState(State::Started);
+    startMuxing();
+}
+
+void Caster::clean() {
+    if (m_avMuxingThread.joinable()) m_avMuxingThread.join();
+    LOGD("av muxing thread joined");
+    if (m_paLoop != nullptr) pa_mainloop_wakeup(m_paLoop);
+    if (m_audioPaThread.joinable()) m_audioPaThread.join();
+    LOGD("pa thread joined");
+    cleanPa();
+    LOGD("pa cleaned");
+    cleanAv();
+    LOGD("av cleaned");
+}
+
+std::string Caster::strForAvOpts(const AVDictionary *opts) {
+    if (opts == nullptr) return {};
+
+    std::ostringstream os;
+
+    AVDictionaryEntry *t = nullptr;
+    while ((t = av_dict_get(opts, "", t, AV_DICT_IGNORE_SUFFIX))) {
+        os << "[" << t->key << "=" << t->value << "],";
+    }
+
+    return os.str();
+}
+
+void Caster::cleanAvOutputFormat() {
+    if (m_outFormatCtx != nullptr) {
+        if (m_outFormatCtx->pb != nullptr) {
+            if (m_outFormatCtx->pb->buffer != nullptr &&
+                m_outFormatCtx->flags & AVFMT_FLAG_CUSTOM_IO)
+                av_freep(&m_outFormatCtx->pb->buffer);
+            avio_context_free(&m_outFormatCtx->pb);
         }
         avformat_free_context(m_outFormatCtx);
         m_outFormatCtx = nullptr;
@@ -1146,6 +2085,12 @@ void Caster::cleanAvAudioFifo() {
     }
 }
 
+void Caster::cleanAvAudioDriftResampler() {
+    if (m_audioSwrCtx != nullptr) swr_free(&m_audioSwrCtx);
+    if (m_audioFrameAfterSwr != nullptr) av_frame_free(&m_audioFrameAfterSwr);
+    m_audioCompensation = 0;
+}
+
 void Caster::cleanAvVideoFilters() {
     for (auto &p : m_videoFilterCtxMap) {
         if (p.second.in != nullptr) avfilter_inout_free(&p.second.in);
@@ -1162,13 +2107,24 @@ void Caster::cleanAvAudioFilters() {
     }
 }
 
+void Caster::cleanAvVideoBsf() {
+    if (m_videoBsfExtractExtraCtx != nullptr)
+        av_bsf_free(&m_videoBsfExtractExtraCtx);
+    if (m_videoBsfDumpExtraCtx != nullptr) av_bsf_free(&m_videoBsfDumpExtraCtx);
+}
+
 void Caster::cleanAv() {
     cleanAvVideoFilters();
     cleanAvAudioFilters();
+    cleanAvVideoBsf();
 
     if (m_videoFrameIn != nullptr) av_frame_free(&m_videoFrameIn);
     if (m_videoFrameAfterFilter != nullptr)
         av_frame_free(&m_videoFrameAfterFilter);
+#ifdef USE_V4L2
+    m_mjpegDecoder.reset();
+    if (m_v4l2Frame != nullptr) av_frame_free(&m_v4l2Frame);
+#endif
 
     if (m_audioFrameIn != nullptr) av_frame_free(&m_audioFrameIn);
     if (m_audioFrameAfterFilter != nullptr)
@@ -1180,6 +2136,7 @@ void Caster::cleanAv() {
     cleanAvAudioEncoder();
     cleanAvAudioDecoder();
     cleanAvAudioFifo();
+    cleanAvAudioDriftResampler();
 
     if (m_outVideoCtx != nullptr) avcodec_free_context(&m_outVideoCtx);
     if (m_inVideoCtx != nullptr) avcodec_free_context(&m_inVideoCtx);
@@ -1207,6 +2164,7 @@ void Caster::cleanPa() {
             m_paStream = nullptr;
         }
 
+        disconnectPaMixSources();
         unmuteAllPaSinkInputs();
 
         pa_context_unref(m_paCtx);
@@ -1415,7 +2373,7 @@ void Caster::initPa() {
     pa_context_set_state_callback(m_paCtx, paStateCallback, this);
 
     while(true) {
-        auto ret = pa_mainloop_iterate(m_paLoop, 0, nullptr);
+        auto ret = pa_mainloop_iterate(m_paLoop, 1, nullptr);
         auto state = pa_context_get_state(m_paCtx);
         if (ret < 0 || state == PA_CONTEXT_FAILED ||
             state == PA_CONTEXT_TERMINATED)
@@ -1582,6 +2540,9 @@ void Caster::initAvAudioEncoder() {
 
     setAudioEncoderOpts(type, &opts);
 
+    if (m_encoderParams.audioBitrate > 0)
+        av_dict_set_int(&opts, "b", m_encoderParams.audioBitrate * 1000LL, 0);
+
     if (avcodec_open2(m_outAudioCtx, encoder, &opts) < 0) {
         av_dict_free(&opts);
         throw std::runtime_error("avcodec_open2 for out audio error");
@@ -1851,7 +2812,8 @@ void Caster::initAvVideoFilters() {
                  << m_inVideoCtx->pix_fmt << " => " << m_outVideoCtx->pix_fmt);
             m_videoTrans = VideoTrans::Scale;
         } else if (m_inVideoCtx->width != m_outVideoCtx->width ||
-                   m_inVideoCtx->height != m_outVideoCtx->height) {
+                   m_inVideoCtx->height != m_outVideoCtx->height ||
+                   videoFilterDimFixed()) {
             LOGD("dim conversion required");
             m_videoTrans = VideoTrans::Scale;
         }
@@ -1912,14 +2874,26 @@ void Caster::initAvVideoFilters() {
     }
 }
 
+bool Caster::videoFilterDimFixed() const {
+    return m_videoFilterDim.width !=
+               static_cast<uint32_t>(m_outVideoCtx->width) ||
+           m_videoFilterDim.height !=
+               static_cast<uint32_t>(m_outVideoCtx->height);
+}
+
 void Caster::initAvVideoFilter(SensorDirection direction, VideoTrans trans,
                                const std::string &fmt) {
-    initAvVideoFilter(
-        m_videoFilterCtxMap[trans],
-        fmt::format(fmt, m_outVideoCtx->width, m_outVideoCtx->height,
-                    direction == SensorDirection::Front ? "cclock" : "clock",
-                    direction == SensorDirection::Front ? "clock" : "cclock")
-            .c_str());
+    auto arg = fmt::format(
+        fmt, m_videoFilterDim.width, m_videoFilterDim.height,
+        direction == SensorDirection::Front ? "cclock" : "clock",
+        direction == SensorDirection::Front ? "clock" : "cclock");
+
+    // scaled picture is stretched back to dim of the stream
+    if (videoFilterDimFixed())
+        arg += fmt::format(",scale=h={}:w={}", m_outVideoCtx->height,
+                           m_outVideoCtx->width);
+
+    initAvVideoFilter(m_videoFilterCtxMap[trans], arg.c_str());
 }
 
 void Caster::initAvAudioFilter(FilterCtx &ctx, const char *arg) {
@@ -2144,8 +3118,13 @@ Caster::bestVideoFormat(const AVCodec *encoder,
         return {*it, it->pixfmt};
     }
 
-    auto fmt = avcodec_find_best_pix_fmt_of_list(
-        encoder->pix_fmts, props.formats.front().pixfmt, 0, nullptr);
+    // compressed source has no pixfmt, mjpeg cams usually decode to yuvj422p
+    auto srcFmt = props.formats.front().pixfmt == AV_PIX_FMT_NONE
+                      ? AV_PIX_FMT_YUVJ422P
+                      : props.formats.front().pixfmt;
+
+    auto fmt = avcodec_find_best_pix_fmt_of_list(encoder->pix_fmts, srcFmt, 0,
+                                                 nullptr);
 
     if (useNiceFormats)
         return {props.formats.front(), toNicePixfmt(fmt, encoder->pix_fmts)};
@@ -2211,6 +3190,7 @@ std::string Caster::videoFormatAvName(VideoSourceType type) {
         case VideoSourceType::X11Capture:
             return "x11grab";
         case VideoSourceType::LipstickCapture:
+        case VideoSourceType::WlrCapture:
         case VideoSourceType::Test:
         case VideoSourceType::DroidCamRaw:
             return "rawvideo";
@@ -2279,7 +3259,7 @@ void Caster::initAvVideoEncoder(VideoEncoder type) {
 
     const auto &props = videoProps();
 
-    const auto &bestFormat = [&]() {
+    auto bestFormat = [&]() {
 #ifdef USE_V4L2
         if (type == VideoEncoder::V4l2)
             return bestVideoFormatForV4l2Encoder(props);
@@ -2289,6 +3269,15 @@ void Caster::initAvVideoEncoder(VideoEncoder type) {
             m_config.options & OptionsFlags::OnlyNiceVideoFormats);
     }();
 
+#ifdef USE_V4L2
+    if (m_config.options & OptionsFlags::V4l2Mjpeg) {
+        if (const auto *format = v4l2MjpegFormat(props, bestFormat.first)) {
+            LOGD("mjpeg format preferred over: " << bestFormat.first.get());
+            bestFormat.first = *format;
+        }
+    }
+#endif
+
     m_outVideoCtx->pix_fmt = bestFormat.second;
     if (m_outVideoCtx->pix_fmt == AV_PIX_FMT_NONE)
         throw std::runtime_error("failed to find pixfmt for video encoder");
@@ -2297,13 +3286,18 @@ void Caster::initAvVideoEncoder(VideoEncoder type) {
 
     m_videoFramerate = static_cast<int>(*fs.framerates.begin());
 
-    m_outVideoCtx->time_base = AVRational{1, m_videoFramerate};
+    // source frames above encoder framerate are dropped before encoding
+    m_outVideoCtx->time_base = AVRational{1, videoEncoderFramerate()};
     m_outVideoCtx->flags = AVFMT_FLAG_NOBUFFER | AVFMT_FLAG_FLUSH_PACKETS;
 
     m_inDim = fs.dim;
     m_inPixfmt = bestFormat.first.get().pixfmt;
+    m_inVideoCodecId = bestFormat.first.get().codecId;
 
-    auto outDim = computeTransDim(m_inDim, m_videoTrans, props.scale);
+    m_videoFilterDim = computeTransDim(
+        m_inDim, m_videoTrans,
+        m_encoderParams.videoScale.value_or(props.scale));
+    const auto outDim = m_videoFixedDim.value_or(m_videoFilterDim);
     m_outVideoCtx->width = static_cast<int>(outDim.width);
     m_outVideoCtx->height = static_cast<int>(outDim.height);
 
@@ -2311,6 +3305,15 @@ void Caster::initAvVideoEncoder(VideoEncoder type) {
 
     setVideoEncoderOpts(type, &opts);
 
+    if (m_encoderParams.videoBitrate > 0) {
+        // vbv of 1 s keeps bitrate close to the target
+        const auto bitrate = m_encoderParams.videoBitrate * 1000LL;
+        av_dict_set_int(&opts, "b", bitrate, 0);
+        av_dict_set_int(&opts, "maxrate", bitrate, 0);
+        av_dict_set_int(&opts, "bufsize", bitrate, 0);
+        if (type == VideoEncoder::Nvenc) av_dict_set(&opts, "rc", "cbr", 0);
+    }
+
     if (avcodec_open2(m_outVideoCtx, nullptr, &opts) < 0) {
         av_dict_free(&opts);
         throw std::runtime_error("avcodec_open2 for out video error");
@@ -2318,11 +3321,14 @@ void Caster::initAvVideoEncoder(VideoEncoder type) {
 
     cleanAvOpts(&opts);
 
+    m_videoEncoder = type;
+
     LOGD("video encoder: tb=" << m_outVideoCtx->time_base
                               << ", pixfmt=" << m_outVideoCtx->pix_fmt
                               << ", width=" << m_outVideoCtx->width
                               << ", height=" << m_outVideoCtx->height
-                              << ", framerate=" << m_videoFramerate);
+                              << ", framerate=" << m_videoFramerate
+                              << ", bitrate=" << m_outVideoCtx->bit_rate);
 
     LOGD("encoder successfuly inited");
 }
@@ -2358,6 +3364,8 @@ void Caster::addFile(std::string file) {
     LOGD("adding file: " << file);
 
     m_files.push(std::move(file));
+
+    discardOutputCache();
 }
 
 bool Caster::initAvAudioInputFormatFromFile() {
@@ -2399,7 +3407,11 @@ void Caster::initAvVideoInputRawFormat() {
     av_dict_set_int(&opts, "framerate", m_videoFramerate, 0);
 
     if (props.type == VideoSourceType::V4l2)
-        av_dict_set(&opts, "input_format", av_get_pix_fmt_name(m_inPixfmt), 0);
+        av_dict_set(&opts, "input_format",
+                    m_inVideoCodecId == AV_CODEC_ID_RAWVIDEO
+                        ? av_get_pix_fmt_name(m_inPixfmt)
+                        : avcodec_get_name(m_inVideoCodecId),
+                    0);
 
     AVFormatContext *in_cxt = nullptr;
     if (avformat_open_input(&in_cxt, props.dev.c_str(), in_video_format,
@@ -2421,77 +3433,141 @@ void Caster::allocAvOutputFormat() {
     }
 }
 
-void Caster::initAv() {
-    LOGD("av init started");
+void Caster::initAvAudio() {
+    const auto &props = audioProps();
 
-    if (audioEnabled()) {
-        const auto &props = audioProps();
+    switch (props.type) {
+        case AudioSourceType::Mic:
+        case AudioSourceType::Monitor:
+        case AudioSourceType::Playback:
+        case AudioSourceType::PwMic:
+        case AudioSourceType::PwMonitor:
+        case AudioSourceType::Alsa:
+        case AudioSourceType::Synth:
+            initAvAudioRawDecoderFromProps();
+            break;
+        case AudioSourceType::File:
+            if (!initAvAudioInputFormatFromFile())
+                throw std::runtime_error("no file to cast");
+            findAvAudioInputStreamIdx();
+            initAvAudioRawDecoderFromInputStream();
+            break;
+        default:
+            throw std::runtime_error("unknown audio source type");
+    }
 
-        switch (props.type) {
-            case AudioSourceType::Mic:
-            case AudioSourceType::Monitor:
-            case AudioSourceType::Playback:
-                initAvAudioRawDecoderFromProps();
-                break;
-            case AudioSourceType::File:
-                if (!initAvAudioInputFormatFromFile())
-                    throw std::runtime_error("no file to cast");
-                findAvAudioInputStreamIdx();
-                initAvAudioRawDecoderFromInputStream();
-                break;
-            default:
-                throw std::runtime_error("unknown audio source type");
-        }
+    auto time = av_gettime();
+    initAvAudioEncoder();
+    addStartupTime(StartupPhase::AudioEncoderOpen, time);
+
+    initAvAudioFifo();
+    initAvAudioFilters();
+    if (props.type != AudioSourceType::File) initAvAudioDriftResampler();
 
-        initAvAudioEncoder();
-        initAvAudioFifo();
-        initAvAudioFilters();
+    m_audioInFrameSize = av_samples_get_buffer_size(
+        nullptr, m_inAudioCtx->ch_layout.nb_channels, m_outAudioCtx->frame_size,
+        m_inAudioCtx->sample_fmt, 0);
 
-        m_audioInFrameSize = av_samples_get_buffer_size(
-            nullptr, m_inAudioCtx->ch_layout.nb_channels,
-            m_outAudioCtx->frame_size, m_inAudioCtx->sample_fmt, 0);
+    m_audioOutFrameSize = av_samples_get_buffer_size(
+        nullptr, m_outAudioCtx->ch_layout.nb_channels,
+        m_outAudioCtx->frame_size, m_outAudioCtx->sample_fmt, 0);
+}
 
-        m_audioOutFrameSize = av_samples_get_buffer_size(
-            nullptr, m_outAudioCtx->ch_layout.nb_channels,
-            m_outAudioCtx->frame_size, m_outAudioCtx->sample_fmt, 0);
-    }
+void Caster::initAvVideo() {
+    const auto &props = videoProps();
 
-    if (videoEnabled()) {
-        const auto &props = videoProps();
+    auto initEncoder = [this] {
+        auto time = av_gettime();
+        initAvVideoEncoder();
+        addStartupTime(StartupPhase::VideoEncoderOpen, time);
+    };
 
-        switch (props.type) {
-            case VideoSourceType::DroidCam:
-                initAvVideoForGst();
-                break;
-            case VideoSourceType::V4l2:
-            case VideoSourceType::X11Capture:
-                initAvVideoEncoder();
-                initAvVideoInputRawFormat();
-                findAvVideoInputStreamIdx();
-                initAvVideoRawDecoderFromInputStream();
+    switch (props.type) {
+        case VideoSourceType::DroidCam:
+            initAvVideoForGst();
+            break;
+        case VideoSourceType::V4l2:
+#ifdef USE_V4L2
+            if (const auto *format = v4l2PassthroughFormat()) {
+                initAvVideoForV4l2Passthrough(*format);
                 break;
-            case VideoSourceType::LipstickCapture:
-            case VideoSourceType::Test:
-            case VideoSourceType::DroidCamRaw:
-                initAvVideoEncoder();
+            }
+#endif
+            initEncoder();
+#ifdef USE_V4L2
+            if (v4l2CaptureEnabled()) {
+                initV4l2Capture();
                 initAvVideoRawDecoder();
-                initAvVideoFilters();
                 break;
-            default:
-                throw std::runtime_error("unknown video source type");
-        }
-
-        m_videoRealFrameDuration =
-            rescaleToUsec(1, AVRational{1, m_videoFramerate});
-        m_videoFrameDuration = m_videoRealFrameDuration / 2;
+            }
+#endif
+            initAvVideoInputRawFormat();
+            findAvVideoInputStreamIdx();
+            initAvVideoRawDecoderFromInputStream();
+#ifdef USE_V4L2
+            if (m_inVideoCodecId == AV_CODEC_ID_MJPEG) initMjpegDecoder();
+#endif
+            break;
+        case VideoSourceType::X11Capture:
+            initEncoder();
+            initAvVideoInputRawFormat();
+            findAvVideoInputStreamIdx();
+            initAvVideoRawDecoderFromInputStream();
+            break;
+        case VideoSourceType::LipstickCapture:
+        case VideoSourceType::WlrCapture:
+        case VideoSourceType::Test:
+        case VideoSourceType::DroidCamRaw:
+            initEncoder();
+            initAvVideoRawDecoder();
+            initAvVideoFilters();
+            break;
+        default:
+            throw std::runtime_error("unknown video source type");
+    }
+
+    initVideoOverlays();
+
+    m_videoRealFrameDuration =
+        rescaleToUsec(1, AVRational{1, m_videoFramerate});
+    m_videoFrameDuration = m_videoRealFrameDuration / 2;
+}
+
+void Caster::initAv() {
+    LOGD("av init started");
+
+    auto time = av_gettime();
+
+    // audio and video pipelines do not share any state until output format
+    // is allocated, so audio (including pa connection) is inited in parallel
+    // with video source and video encoder
+    std::future<void> audioInit;
+    if (audioEnabled()) {
+        audioInit = std::async(std::launch::async, [this] {
+            auto audioTime = av_gettime();
+            initAudioSource();
+            initAvAudio();
+            addStartupTime(StartupPhase::AudioInit, audioTime);
+        });
+    }
+
+    if (videoEnabled()) {
+        auto videoTime = av_gettime();
+        initVideoSource();
+        initAvVideo();
+        addStartupTime(StartupPhase::VideoInit, videoTime);
     }
 
+    if (audioInit.valid()) audioInit.get();
+
     LOGD("using muxer: " << m_config.streamFormat);
 
     allocAvOutputFormat();
 
     setState(State::Inited);
 
+    addStartupTime(StartupPhase::AvInit, time);
+
     LOGD("av init completed");
 }
 
@@ -2520,6 +3596,70 @@ void Caster::initAvAudioFifo() {
         throw std::runtime_error("av_audio_fifo_alloc error");
 }
 
+void Caster::initAvAudioDriftResampler() {
+    // resampler does not change format, it only stretches or squeezes
+    // captured audio to compensate drift between audio and system clocks
+    if (swr_alloc_set_opts2(&m_audioSwrCtx, &m_inAudioCtx->ch_layout,
+                            m_inAudioCtx->sample_fmt, m_inAudioCtx->sample_rate,
+                            &m_inAudioCtx->ch_layout, m_inAudioCtx->sample_fmt,
+                            m_inAudioCtx->sample_rate, 0, nullptr) != 0)
+        throw std::runtime_error("swr_alloc_set_opts2 error");
+
+    if (swr_init(m_audioSwrCtx) != 0)
+        throw std::runtime_error("swr_init error");
+
+    m_audioFrameAfterSwr = av_frame_alloc();
+    m_audioCompensation = 0;
+}
+
+void Caster::updateAudioDriftCompensation() {
+    double drift = 0.0;
+    {
+        std::lock_guard lock{m_audioMtx};
+        drift = m_audioDrift;
+    }
+
+    const auto rate = m_inAudioCtx->sample_rate;
+    const auto compensation = static_cast<int>(std::lround(drift * rate));
+
+    if (compensation == m_audioCompensation) return;
+
+    LOGD("audio drift compensation: drift=" << drift << ", samples per sec="
+                                            << compensation);
+
+    if (swr_set_compensation(m_audioSwrCtx, -compensation, rate) != 0)
+        throw std::runtime_error("swr_set_compensation error");
+
+    m_audioCompensation = compensation;
+}
+
+void Caster::writeAudioFifo(AVFrame *frame) {
+    if (m_audioSwrCtx != nullptr) {
+        updateAudioDriftCompensation();
+
+        av_channel_layout_copy(&m_audioFrameAfterSwr->ch_layout,
+                               &frame->ch_layout);
+        m_audioFrameAfterSwr->format = frame->format;
+        m_audioFrameAfterSwr->sample_rate = frame->sample_rate;
+
+        if (swr_convert_frame(m_audioSwrCtx, m_audioFrameAfterSwr, frame) != 0)
+            throw std::runtime_error("swr_convert_frame error");
+
+        frame = m_audioFrameAfterSwr;
+    }
+
+    if (av_audio_fifo_realloc(m_audioFifo, av_audio_fifo_size(m_audioFifo) +
+                                               frame->nb_samples) < 0)
+        throw std::runtime_error("av_audio_fifo_realloc error");
+
+    if (av_audio_fifo_write(m_audioFifo,
+                            reinterpret_cast<void **>(frame->data),
+                            frame->nb_samples) < frame->nb_samples)
+        throw std::runtime_error("av_audio_fifo_write error");
+
+    if (frame == m_audioFrameAfterSwr) av_frame_unref(m_audioFrameAfterSwr);
+}
+
 void Caster::initAvVideoBsf() {
     // extract_extradata
 
@@ -2707,6 +3847,9 @@ void Caster::initAvAudioOutStreamFromEncoder() {
 }
 
 void Caster::reInitAvOutputFormat() {
+    // output with more than one stream header is not cached
+    discardOutputCache();
+
     cleanAvOutputFormat();
     allocAvOutputFormat();
 
@@ -2718,8 +3861,14 @@ void Caster::reInitAvOutputFormat() {
                 initAvVideoOutStreamFromInputFormat();
                 break;
             case VideoSourceType::V4l2:
+                if (m_videoPassthrough) {
+                    initAvVideoOutStreamFromInputFormat();
+                    break;
+                }
+                [[fallthrough]];
             case VideoSourceType::X11Capture:
             case VideoSourceType::LipstickCapture:
+            case VideoSourceType::WlrCapture:
             case VideoSourceType::Test:
             case VideoSourceType::DroidCamRaw:
                 initAvVideoOutStreamFromEncoder();
@@ -2734,6 +3883,156 @@ void Caster::reInitAvOutputFormat() {
     initAvOutputFormat();
 }
 
+void Caster::reconfigureEncoders(const EncoderParams &params) {
+    if (!encoderParamsValid(params))
+        throw std::runtime_error("invalid encoder params");
+
+    std::lock_guard lock{m_encoderParamsMtx};
+
+    const auto &old = m_requestedEncoderParams;
+
+    if ((params.videoBitrate != old.videoBitrate ||
+         params.videoScale != old.videoScale ||
+         params.videoFramerate != old.videoFramerate) &&
+        (!videoEnabled() || m_videoPassthrough ||
+         videoProps().type == VideoSourceType::DroidCam))
+        throw std::runtime_error("video encoder reconfiguration not supported");
+
+    if (params.audioBitrate != old.audioBitrate && !audioEnabled())
+        throw std::runtime_error("audio encoder reconfiguration not supported");
+
+    LOGD("encoder reconfiguration requested: " << params);
+
+    discardOutputCache();
+
+    m_requestedEncoderParams = params;
+    m_encoderParamsPending = true;
+}
+
+Caster::EncoderParams Caster::encoderParams() const {
+    std::lock_guard lock{m_encoderParamsMtx};
+    return m_requestedEncoderParams;
+}
+
+void Caster::updateEncodersIfNeeded() {
+    if (!m_encoderParamsPending.exchange(false)) return;
+
+    auto oldParams = m_encoderParams;
+    {
+        std::lock_guard lock{m_encoderParamsMtx};
+        m_encoderParams = m_requestedEncoderParams;
+    }
+
+    LOGD("updating encoders: " << m_encoderParams);
+
+    if (videoEnabled() &&
+        (m_encoderParams.videoBitrate != oldParams.videoBitrate ||
+         m_encoderParams.videoScale != oldParams.videoScale ||
+         m_encoderParams.videoFramerate != oldParams.videoFramerate))
+        reInitAvVideoEncoder(oldParams);
+
+    if (audioEnabled() &&
+        m_encoderParams.audioBitrate != oldParams.audioBitrate)
+        reInitAvAudioEncoder();
+}
+
+void Caster::reInitAvVideoEncoder(const EncoderParams &oldParams) {
+    m_videoNextEncodeTime = 0;
+
+    // new GOP starts with changed params
+    m_forceVideoKeyframe = true;
+
+    // libx264 applies new abr bitrate to running encoder, sps is not changed
+    if (m_videoEncoder == VideoEncoder::X264 &&
+        m_encoderParams.videoBitrate > 0 && oldParams.videoBitrate > 0 &&
+        m_encoderParams.videoScale == oldParams.videoScale &&
+        m_encoderParams.videoFramerate == oldParams.videoFramerate) {
+        const auto bitrate = m_encoderParams.videoBitrate * 1000LL;
+        m_outVideoCtx->bit_rate = bitrate;
+        m_outVideoCtx->rc_max_rate = bitrate;
+        m_outVideoCtx->rc_buffer_size = static_cast<int>(bitrate);
+        LOGD("video encoder bitrate updated: " << bitrate);
+        return;
+    }
+
+    std::lock_guard lock{m_videoEncoderMtx};
+
+    const auto oldWidth = m_outVideoCtx->width;
+    const auto oldHeight = m_outVideoCtx->height;
+
+    // mp4 init segment describes video dim and it is sent only once, so
+    // encoder keeps dim and scaling only changes level of details
+    if (m_config.streamFormat == StreamFormat::Mp4 && !m_videoFixedDim)
+        m_videoFixedDim = Dim{static_cast<uint32_t>(oldWidth),
+                              static_cast<uint32_t>(oldHeight)};
+
+    avcodec_free_context(&m_outVideoCtx);
+    initAvVideoEncoder(m_videoEncoder);
+
+    // scale filter output has to match new encoder dim
+    cleanAvVideoFilters();
+    if (m_videoFrameAfterFilter != nullptr)
+        av_frame_free(&m_videoFrameAfterFilter);
+    initAvVideoFilters();
+
+    // new sps/pps is in the first key frame from re-opened encoder
+    m_videoExtradataStale = true;
+
+    // bsfs and stream params have to describe re-opened encoder
+    if (avcodec_parameters_from_context(m_outVideoStream->codecpar,
+                                        m_outVideoCtx) < 0)
+        throw std::runtime_error(
+            "avcodec_parameters_from_context for video error");
+    cleanAvVideoBsf();
+    initAvVideoBsf();
+
+    if (oldWidth == m_outVideoCtx->width &&
+        oldHeight == m_outVideoCtx->height)
+        return;
+
+    // overlays are re-created for new dim, so their sources are restarted
+    m_videoOverlays.clear();
+    initVideoOverlays();
+    for (auto &source : m_videoOverlays) source.start();
+
+    // switched source is re-created for new dim before the next frame
+    if (m_videoSwitchSource) {
+        std::lock_guard lock{m_videoSwitchMtx};
+        if (!m_pendingVideoSwitch)
+            m_pendingVideoSwitch = m_videoSwitchSourceName;
+    }
+}
+
+void Caster::reInitAvAudioEncoder() {
+    // frame size depends only on codec, so fifo and durations stay valid
+    cleanAvAudioEncoder();
+    initAvAudioEncoder();
+}
+
+int Caster::videoEncoderFramerate() const {
+    if (m_encoderParams.videoFramerate > 0)
+        return std::min(m_encoderParams.videoFramerate, m_videoFramerate);
+    return m_videoFramerate;
+}
+
+bool Caster::videoFrameDecimated() {
+    const auto framerate = videoEncoderFramerate();
+    if (framerate >= m_videoFramerate) return false;
+
+    const auto frameDur = rescaleToUsec(1, AVRational{1, framerate});
+    // half of source frame duration tolerates capture jitter
+    const auto tolerance =
+        rescaleToUsec(1, AVRational{1, m_videoFramerate}) / 2;
+
+    if (m_videoCaptureTime + tolerance < m_videoNextEncodeTime) return true;
+
+    m_videoNextEncodeTime =
+        std::max(m_videoNextEncodeTime, m_videoCaptureTime - tolerance) +
+        frameDur;
+
+    return false;
+}
+
 void Caster::initAvOutputFormat() {
     auto *outBuf = static_cast<uint8_t *>(av_malloc(m_videoBufSize));
     if (outBuf == nullptr) {
@@ -2748,6 +4047,21 @@ void Caster::initAvOutputFormat() {
         throw std::runtime_error("avio_alloc_context error");
     }
 
+    // data markers are needed to cache init segment and to find fragment
+    // boundaries
+    m_outFormatCtx->pb->write_data_type = avWriteDataTypeCallbackStatic;
+
+    {
+        std::lock_guard lock{m_dataReadyHandlerMtx};
+        m_initSegment.clear();
+        // old data can't be decoded with new init segment
+        if (m_timeShiftBuffer) m_timeShiftBuffer->clear();
+    }
+
+    m_outBlock.clear();
+    m_outBlock.reserve(m_outBlockSize);
+    m_lastDataMarker = {AVIO_DATA_MARKER_UNKNOWN, AV_NOPTS_VALUE};
+
     AVDictionary *opts = nullptr;
 
     if (m_config.streamFormat == StreamFormat::MpegTs) {
@@ -2773,11 +4087,19 @@ void Caster::initAvOutputFormat() {
         throw std::runtime_error("invalid stream format for video");
     }
 
-    m_outFormatCtx->flags |= AVFMT_FLAG_NOBUFFER | AVFMT_FLAG_FLUSH_PACKETS |
-                             AVFMT_FLAG_CUSTOM_IO | AVFMT_FLAG_AUTO_BSF;
+    m_outFormatCtx->flags |= AVFMT_FLAG_NOBUFFER | AVFMT_FLAG_CUSTOM_IO |
+                             AVFMT_FLAG_AUTO_BSF;
+
+    // with other policies output is flushed only when fragment is written
+    if (m_config.fragmentPolicy == FragmentPolicy::Frame)
+        m_outFormatCtx->flags |= AVFMT_FLAG_FLUSH_PACKETS;
+    else
+        m_outFormatCtx->flush_packets = 0;
 
     LOGD("writting format header");
+    auto time = av_gettime();
     auto ret = avformat_write_header(m_outFormatCtx, &opts);
+    addStartupTime(StartupPhase::HeaderWrite, time);
     if (ret != AVSTREAM_INIT_IN_WRITE_HEADER &&
         ret != AVSTREAM_INIT_IN_INIT_OUTPUT) {
         av_dict_free(&opts);
@@ -2799,6 +4121,8 @@ void Caster::startAv() {
     if (videoEnabled()) {
         const auto &props = videoProps();
 
+        auto time = av_gettime();
+
         switch (props.type) {
             case VideoSourceType::DroidCam:
                 initAvVideoInputCompressedFormat();
@@ -2807,6 +4131,22 @@ void Caster::startAv() {
                 extractVideoExtradataFromCompressedDemuxer();
                 break;
             case VideoSourceType::V4l2:
+                if (m_videoPassthrough) {
+                    initAvVideoOutStreamFromInputFormat();
+                    initAvVideoBsf();
+                    extractVideoExtradataFromCompressedDemuxer();
+                    break;
+                }
+#ifdef USE_V4L2
+                if (m_v4l2Source) {
+                    initAvVideoOutStreamFromEncoder();
+                    initAvVideoFilters();
+                    initAvVideoBsf();
+                    extractVideoExtradataFromRawBuf();
+                    break;
+                }
+#endif
+                [[fallthrough]];
             case VideoSourceType::X11Capture:
                 initAvVideoOutStreamFromEncoder();
                 initAvVideoFilters();
@@ -2814,6 +4154,7 @@ void Caster::startAv() {
                 extractVideoExtradataFromRawDemuxer();
                 break;
             case VideoSourceType::LipstickCapture:
+            case VideoSourceType::WlrCapture:
             case VideoSourceType::Test:
             case VideoSourceType::DroidCamRaw:
                 initAvVideoOutStreamFromEncoder();
@@ -2823,6 +4164,8 @@ void Caster::startAv() {
             default:
                 throw std::runtime_error("unknown video source type");
         }
+
+        addStartupTime(StartupPhase::VideoStreamInit, time);
     }
 
     if (audioEnabled()) {
@@ -2934,13 +4277,7 @@ void Caster::connectPaSinkInput() {
 
     if (muteSource) mutePaSinkInput(*si);
 
-    const pa_buffer_attr attr{
-        /*maxlength=*/
-        static_cast<uint32_t>(-1),
-        /*tlength=*/static_cast<uint32_t>(-1),
-        /*prebuf=*/static_cast<uint32_t>(-1),
-        /*minreq=*/static_cast<uint32_t>(-1),
-        /*fragsize=*/static_cast<uint32_t>(m_audioInFrameSize)};
+    const auto attr = paBufferAttr(spec);
 
     if (pa_stream_set_monitor_stream(m_paStream, idx) < 0) {
         if (muteSource) unmutePaSinkInput(*si);
@@ -2952,7 +4289,7 @@ void Caster::connectPaSinkInput() {
     m_connectedPaSinkInput = idx;
 
     if (pa_stream_connect_record(m_paStream, nullptr, &attr,
-                                 PA_STREAM_ADJUST_LATENCY) != 0) {
+                                 m_paStreamFlags) != 0) {
         if (muteSource) unmutePaSinkInput(*si);
         throw std::runtime_error("pa_stream_connect_record error");
     }
@@ -2962,40 +4299,144 @@ void Caster::connectPaSinkInput() {
             paCorrectedClientName(si->get().clientIdx));
 }
 
-void Caster::connectPaSource() {
-    const auto &props = audioProps();
-
-    pa_sample_spec spec{ff_tools::ff_codec_id_to_pulse_format(props.codec),
-                        props.rate, props.channels};
+void Caster::connectPaSource(const AudioSourceInternalProps &props) {
+    // spec of configured source also after switch, decoder and encoder
+    // are not changed
+    const auto &cprops = audioProps();
+    pa_sample_spec spec{ff_tools::ff_codec_id_to_pulse_format(cprops.codec),
+                        cprops.rate, cprops.channels};
 
     m_paStream =
         pa_stream_new(m_paCtx, m_config.streamTitle.c_str(), &spec, nullptr);
     pa_stream_set_read_callback(m_paStream, paStreamRequestCallbackStatic,
                                 this);
 
-    const pa_buffer_attr attr{
-        /*maxlength=*/static_cast<uint32_t>(-1),
-        /*tlength=*/static_cast<uint32_t>(-1),
-        /*prebuf=*/static_cast<uint32_t>(-1),
-        /*minreq=*/static_cast<uint32_t>(-1),
-        /*fragsize=*/static_cast<uint32_t>(m_audioInFrameSize)};
+    const auto attr = paBufferAttr(spec);
 
     LOGD("connecting pa source: " << props.dev);
 
     if (pa_stream_connect_record(
             m_paStream, props.dev.empty() ? nullptr : props.dev.c_str(), &attr,
-            PA_STREAM_ADJUST_LATENCY) != 0) {
+            m_paStreamFlags) != 0) {
         throw std::runtime_error("pa_stream_connect_record error");
     }
 }
 
+void Caster::switchAudioSource(const std::string &name) {
+    const auto paSource = [this](const std::string &name) {
+        const auto type = m_audioProps.at(name).type;
+        return type == AudioSourceType::Mic ||
+               type == AudioSourceType::Monitor;
+    };
+
+    if (!audioEnabled() || !paSource(m_config.audioSource))
+        throw std::runtime_error("audio source switching not supported");
+
+    const auto &target = name.empty() ? m_config.audioSource : name;
+
+    if (m_audioProps.count(target) == 0 || !paSource(target) ||
+        std::find(m_config.audioMixSources.cbegin(),
+                  m_config.audioMixSources.cend(),
+                  target) != m_config.audioMixSources.cend())
+        throw std::runtime_error("unsupported audio source: " + target);
+
+    {
+        std::lock_guard lock{m_audioMtx};
+        m_pendingAudioSource = target;
+    }
+
+    // pa objects are only touched in pa thread
+    if (m_paLoop != nullptr) pa_mainloop_wakeup(m_paLoop);
+}
+
+void Caster::switchPaSourceIfNeeded() {
+    std::lock_guard lock{m_audioMtx};
+
+    if (!m_pendingAudioSource) return;
+
+    auto name = std::move(*m_pendingAudioSource);
+    m_pendingAudioSource.reset();
+
+    if (name == m_activeAudioSource || m_paStream == nullptr) return;
+
+    LOGD("switching audio source: " << name);
+
+    pa_stream_disconnect(m_paStream);
+    pa_stream_unref(m_paStream);
+    m_paStream = nullptr;
+
+    // samples already buffered are encoded before samples from new source
+    connectPaSource(m_audioProps.at(name));
+    m_activeAudioSource = std::move(name);
+
+    // drift of new device is measured from scratch
+    m_audioFirstCaptureTime = 0;
+    m_audioDrift = 0.0;
+}
+
+void Caster::connectPaMixSources() {
+    if (m_config.audioMixSources.empty()) return;
+
+    const auto &props = audioProps();
+
+    // pa converts mix sources to audio-source spec, so one resampler and
+    // one encoder are needed regardless of number of sources
+    pa_sample_spec spec{ff_tools::ff_codec_id_to_pulse_format(props.codec),
+                        props.rate, props.channels};
+    const auto attr = paBufferAttr(spec);
+
+    for (const auto &name : m_config.audioMixSources) {
+        auto &source = m_audioMixSources.emplace_back(this, name);
+        const auto &mprops = m_audioProps.at(name);
+
+        source.stream = pa_stream_new(m_paCtx, m_config.streamTitle.c_str(),
+                                      &spec, nullptr);
+        if (source.stream == nullptr)
+            throw std::runtime_error("pa_stream_new error");
+
+        pa_stream_set_read_callback(source.stream,
+                                    paMixStreamRequestCallbackStatic, &source);
+
+        LOGD("connecting pa mix source: " << mprops.dev);
+
+        if (pa_stream_connect_record(
+                source.stream,
+                mprops.dev.empty() ? nullptr : mprops.dev.c_str(), &attr,
+                m_paStreamFlags) != 0) {
+            throw std::runtime_error("pa_stream_connect_record error");
+        }
+    }
+}
+
+void Caster::disconnectPaMixSources() {
+    for (auto &source : m_audioMixSources) {
+        if (source.stream == nullptr) continue;
+        pa_stream_disconnect(source.stream);
+        pa_stream_unref(source.stream);
+        source.stream = nullptr;
+    }
+
+    m_audioMixSources.clear();
+}
+
+pa_buffer_attr Caster::paBufferAttr(const pa_sample_spec &spec) {
+    // with PA_STREAM_ADJUST_LATENCY fragsize is a requested capture latency
+    return {/*maxlength=*/static_cast<uint32_t>(
+                pa_usec_to_bytes(m_paMaxBufferedTime, &spec)),
+            /*tlength=*/static_cast<uint32_t>(-1),
+            /*prebuf=*/static_cast<uint32_t>(-1),
+            /*minreq=*/static_cast<uint32_t>(-1),
+            /*fragsize=*/
+            static_cast<uint32_t>(pa_usec_to_bytes(m_paTargetLatency, &spec))};
+}
+
 void Caster::startPa() {
     LOGD("starting pa");
 
     switch (audioProps().type) {
         case AudioSourceType::Mic:
         case AudioSourceType::Monitor:
-            connectPaSource();
+            connectPaSource(audioProps());
             break;
         case AudioSourceType::Playback:
             connectPaSinkInput();
@@ -3004,6 +4445,10 @@ void Caster::startPa() {
             throw std::runtime_error("invalid audio source type");
     }
 
+    m_activeAudioSource = m_config.audioSource;
+
+    connectPaMixSources();
+
     m_paDataReceived = false;
 
     m_audioPaThread = std::thread(&Caster::doPaTask, this);
@@ -3033,26 +4478,168 @@ void Caster::paStreamRequestCallback(pa_stream *stream, size_t nbytes) {
     }
 
     if (m_state == State::Started) {
+        updateAudioDrift(stream);
         m_audioBuf.pushExactForce(
             static_cast<const decltype(m_audioBuf)::BufType *>(data), nbytes);
+        m_audioBytesCaptured += nbytes;
         if (!m_paDataReceived) {
             m_paDataReceived = true;
-            LOGD("first pa data received");
+            const auto *attr = pa_stream_get_buffer_attr(stream);
+            LOGD("first pa data received: fragsize="
+                 << (attr ? attr->fragsize : 0)
+                 << ", maxlength=" << (attr ? attr->maxlength : 0)
+                 << ", latency=" << m_audioCaptureLatency);
+            addStartupTime(StartupPhase::FirstAudioFrame);
         }
+    } else {
+        // drift is measured only on continuous capture
+        m_audioFirstCaptureTime = 0;
     }
 
     pa_stream_drop(stream);
 }
 
-void Caster::doPaTask() {
-    const uint32_t sleep = m_audioFrameDuration;
+void Caster::paMixStreamRequestCallbackStatic(pa_stream *stream,
+                                              size_t nbytes, void *userdata) {
+    auto *source = static_cast<AudioMixSource *>(userdata);
+    source->caster->paMixStreamRequestCallback(*source, stream, nbytes);
+}
+
+void Caster::paMixStreamRequestCallback(AudioMixSource &source,
+                                        pa_stream *stream, size_t nbytes) {
+    std::lock_guard lock{m_audioMtx};
+
+    const void *data;
+    if (pa_stream_peek(stream, &data, &nbytes) != 0) {
+        LOGW("pa_stream_peek error");
+        return;
+    }
+
+    // hole in the stream
+    if (data == nullptr && nbytes > 0) {
+        pa_stream_drop(stream);
+        return;
+    }
+
+    if (data == nullptr || nbytes == 0) return;
+
+    if (m_state == State::Started) {
+        source.buf.pushExactForce(
+            static_cast<const DataBuffer::BufType *>(data), nbytes);
+
+        // source that is ahead of audio-source would be delayed forever
+        const auto maxSize = pa_usec_to_bytes(
+            m_audioMixMaxDelay, pa_stream_get_sample_spec(stream));
+        if (source.buf.size() > maxSize)
+            source.buf.discard(source.buf.size() - maxSize);
+
+        if (!source.dataReceived) {
+            source.dataReceived = true;
+            LOGD("first pa mix data received: " << source.name);
+        }
+    } else {
+        // stale samples are not mixed after resume
+        source.buf.clear();
+    }
+
+    pa_stream_drop(stream);
+}
+
+bool Caster::audioMixCodecSupported(AVCodecID codec) {
+    return codec == AV_CODEC_ID_PCM_S16LE || codec == AV_CODEC_ID_PCM_S32LE ||
+           codec == AV_CODEC_ID_PCM_F32LE;
+}
+
+void Caster::mixAudio(uint8_t *data, size_t size) {
+    if (m_audioMixBuf.size() < size) m_audioMixBuf.resize(size);
+
+    const auto codec = audioProps().codec;
 
-    LOGD("starting pa thread, sleep=" << sleep);
+    for (auto &source : m_audioMixSources) {
+        // source that has not started yet or stalled is not mixed, it is
+        // realigned when data comes back
+        if (!source.buf.pullExact(m_audioMixBuf.data(), size)) continue;
+        mixAudioSamples(codec, data, m_audioMixBuf.data(), size);
+    }
+}
+
+// sum with saturation, plain loops are vectorized by compilers
+void Caster::mixAudioSamples(AVCodecID codec, uint8_t *dst,
+                             const uint8_t *src, size_t size) {
+    switch (codec) {
+        case AV_CODEC_ID_PCM_S16LE: {
+            auto *d = reinterpret_cast<int16_t *>(dst);
+            const auto *s = reinterpret_cast<const int16_t *>(src);
+            for (size_t i = 0; i < size / sizeof(int16_t); ++i)
+                d[i] = static_cast<int16_t>(std::clamp<int32_t>(
+                    static_cast<int32_t>(d[i]) + s[i], INT16_MIN, INT16_MAX));
+            break;
+        }
+        case AV_CODEC_ID_PCM_S32LE: {
+            auto *d = reinterpret_cast<int32_t *>(dst);
+            const auto *s = reinterpret_cast<const int32_t *>(src);
+            for (size_t i = 0; i < size / sizeof(int32_t); ++i)
+                d[i] = static_cast<int32_t>(std::clamp<int64_t>(
+                    static_cast<int64_t>(d[i]) + s[i], INT32_MIN, INT32_MAX));
+            break;
+        }
+        case AV_CODEC_ID_PCM_F32LE: {
+            auto *d = reinterpret_cast<float *>(dst);
+            const auto *s = reinterpret_cast<const float *>(src);
+            for (size_t i = 0; i < size / sizeof(float); ++i)
+                d[i] = std::clamp(d[i] + s[i], -1.0f, 1.0f);
+            break;
+        }
+        default:
+            throw std::runtime_error("audio mix codec not supported");
+    }
+}
+
+void Caster::updateAudioDrift(pa_stream *stream) {
+    pa_usec_t latency = 0;
+    int negative = 0;
+    if (pa_stream_get_latency(stream, &latency, &negative) != 0) return;
+
+    m_audioCaptureLatency = (negative ? -1 : 1) * static_cast<int64_t>(latency);
+
+    // capture time of the first sample in peeked data
+    const auto captureTime =
+        av_gettime() + (negative ? 1 : -1) * static_cast<int64_t>(latency);
+
+    if (m_audioFirstCaptureTime == 0) {
+        m_audioFirstCaptureTime = captureTime;
+        m_audioBytesCaptured = 0;
+        return;
+    }
+
+    const auto captureDuration = captureTime - m_audioFirstCaptureTime;
+    if (captureDuration < m_audioDriftWarmup) return;
+
+    const auto samplesDuration = static_cast<int64_t>(pa_bytes_to_usec(
+        m_audioBytesCaptured, pa_stream_get_sample_spec(stream)));
+
+    // positive drift means that audio device clock is faster than system
+    // clock
+    m_audioDrift = std::clamp(
+        static_cast<double>(samplesDuration - captureDuration) /
+            static_cast<double>(captureDuration),
+        -m_maxAudioDrift, m_maxAudioDrift);
+
+    LOGT("audio drift: " << m_audioDrift);
+}
+
+void Caster::doPaTask() {
+    LOGD("starting pa thread");
 
     try {
         while (!terminating()) {
-            if (pa_mainloop_iterate(m_paLoop, 0, nullptr) < 0) break;
-            av_usleep(sleep);
+            // waits for pa events, timeout is only needed to notice
+            // termination
+            if (pa_mainloop_prepare(m_paLoop, m_paMaxWait) < 0 ||
+                pa_mainloop_poll(m_paLoop) < 0 ||
+                pa_mainloop_dispatch(m_paLoop) < 0)
+                break;
+            switchPaSourceIfNeeded();
         }
     } catch (const std::runtime_error &e) {
         LOGE("error in pa thread: " << e.what());
@@ -3073,10 +4660,7 @@ void Caster::startAudioOnlyMuxing() {
         try {
             while (!terminating()) {
                 if (m_state != State::Started) break;
-                if (muxAudio(audio_pkt)) {
-                    av_write_frame(m_outFormatCtx,
-                                   nullptr);  // force fragment
-                }
+                if (muxAudio(audio_pkt)) updateFragment();
                 av_usleep(sleep);
             }
         } catch (const std::runtime_error &e) {
@@ -3096,6 +4680,8 @@ void Caster::startVideoOnlyMuxing() {
 
         auto *video_pkt = av_packet_alloc();
         m_nextVideoPts = 0;
+        m_lastVideoPts = -1;
+        m_videoFirstCaptureTime = 0;
         m_videoFlushed = false;
         m_videoTimeLastFrame = 0;
         m_videoRealFrameDuration =
@@ -3104,10 +4690,7 @@ void Caster::startVideoOnlyMuxing() {
         try {
             while (!terminating()) {
                 if (m_state != State::Started) break;
-                if (muxVideo(video_pkt)) {
-                    av_write_frame(m_outFormatCtx,
-                                   nullptr);  // force fragment
-                }
+                if (muxVideo(video_pkt)) updateFragment();
             }
         } catch (const std::runtime_error &e) {
             LOGE("error in video muxing thread: " << e.what());
@@ -3127,6 +4710,8 @@ void Caster::startVideoAudioMuxing() {
         auto *video_pkt = av_packet_alloc();
         auto *audio_pkt = av_packet_alloc();
         m_nextVideoPts = 0;
+        m_lastVideoPts = -1;
+        m_videoFirstCaptureTime = 0;
         m_nextAudioPts = 0;
         m_audioFlushed = false;
         m_videoFlushed = false;
@@ -3140,9 +4725,7 @@ void Caster::startVideoAudioMuxing() {
 
                 bool pktDone = muxVideo(video_pkt);
                 if (muxAudio(audio_pkt)) pktDone = true;
-                if (pktDone)
-                    av_write_frame(m_outFormatCtx,
-                                   nullptr);  // force fragment
+                if (pktDone) updateFragment();
             }
         } catch (const std::runtime_error &e) {
             LOGE("error in video-audio muxing thread: " << e.what());
@@ -3156,7 +4739,167 @@ void Caster::startVideoAudioMuxing() {
     });
 }
 
+void Caster::writeFragment() {
+    if (!m_fragmentPending) return;
+
+    av_write_frame(m_outFormatCtx, nullptr);  // force fragment
+    avio_flush(m_outFormatCtx->pb);
+    flushOutBlock();
+
+    m_fragmentPending = false;
+    m_lastFragmentTime = av_gettime();
+}
+
+void Caster::updateFragment() {
+    m_fragmentPending = true;
+
+    if (!m_outBlock.empty() && av_gettime() - m_outBlockTime >= m_outMaxDelay)
+        flushOutBlock();
+
+    switch (m_config.fragmentPolicy) {
+        case FragmentPolicy::Frame:
+            writeFragment();
+            break;
+        case FragmentPolicy::Gop:
+            // fragments are written before key frames in muxVideo
+            if (videoEnabled()) break;
+            [[fallthrough]];
+        case FragmentPolicy::Interval:
+            if (av_gettime() - m_lastFragmentTime >=
+                m_config.fragmentInterval * 1000LL)
+                writeFragment();
+            break;
+    }
+}
+
+bool Caster::outputCacheSupported() const {
+    // output has to depend only on files and config
+    return !m_config.outputCacheDir.empty() && !videoEnabled() &&
+           audioEnabled() && audioProps().type == AudioSourceType::File &&
+           m_config.fileSourceConfig &&
+           !(m_config.fileSourceConfig->flags & FileSourceFlags::Loop) &&
+           m_config.audioMixSources.empty();
+}
+
+void Caster::initOutputCache() {
+    std::ostringstream params;
+    params << m_config.streamFormat << "|" << m_config.audioVolume << "|"
+           << m_config.streamAuthor << "|" << m_config.streamTitle << "|"
+           << m_config.encoderParams.audioBitrate << "|"
+           << m_config.fileSourceConfig->flags;
+
+    auto key = OutputCache::makeKey(m_config.fileSourceConfig->files,
+                                    params.str());
+    if (!key) return;
+
+    m_outputCache.emplace(
+        OutputCache::Props{
+            m_config.outputCacheDir,
+            static_cast<size_t>(m_config.outputCacheMaxSize) * 0x100000},
+        std::move(*key));
+}
+
+void Caster::commitOutputCache() {
+    if (!m_outputCache) return;
+
+    // last fragment is still in muxer
+    writeFragment();
+
+    std::lock_guard lock{m_dataReadyHandlerMtx};
+    m_outputCache->commit(std::chrono::microseconds{
+        rescaleToUsec(m_nextAudioPts, m_outAudioStream->time_base)});
+}
+
+void Caster::discardOutputCache() {
+    if (!m_outputCache) return;
+
+    std::lock_guard lock{m_dataReadyHandlerMtx};
+    m_outputCache->discard();
+}
+
+void Caster::startOutputCacheReplay(OutputCache::Entry entry) {
+    m_outputCacheReplaying = true;
+
+    m_avMuxingThread = std::thread([this, entry = std::move(entry)]() {
+        LOGD("starting output cache replay");
+
+        try {
+            replayOutputCache(entry);
+        } catch (const std::runtime_error &e) {
+            LOGE("error in output cache replay: " << e.what());
+        }
+
+        // like file source, caster ends when all data is sent
+        reportError();
+
+        LOGD("output cache replay ended");
+    });
+}
+
+void Caster::replayOutputCache(const OutputCache::Entry &entry) {
+    std::unique_ptr<std::FILE, decltype(&std::fclose)> file{
+        std::fopen(entry.path.c_str(), "rb"), &std::fclose};
+    if (!file || std::fseek(file.get(), static_cast<long>(entry.offset),
+                            SEEK_SET) != 0)
+        throw std::runtime_error("failed to open output cache entry");
+
+    std::vector<uint8_t> buf(m_outputCacheReplayChunk);
+    const auto rate = static_cast<double>(entry.size) /
+                      static_cast<double>(entry.duration.count());
+    const auto startTime = av_gettime();
+    size_t sentSize = 0;
+
+    const auto &files = m_config.fileSourceConfig->files;
+    const auto &handler = m_config.fileSourceConfig->fileStreamingDoneHandler;
+    size_t doneFiles = 0;
+
+    // like without cache, handler is called when data of file is sent,
+    // file with unknown end ends with the stream
+    auto notifyDoneFiles = [&](std::chrono::microseconds sentTime) {
+        for (; doneFiles < files.size(); ++doneFiles) {
+            const auto end = doneFiles < entry.fileEnds.size()
+                                 ? entry.fileEnds[doneFiles]
+                                 : entry.duration;
+            if (end > sentTime) break;
+            if (handler)
+                handler(files[doneFiles], files.size() - doneFiles - 1);
+        }
+    };
+
+    while (!terminating() && !m_detached && sentSize < entry.size) {
+        // data is sent at bitrate of the stream, so client buffers are not
+        // flooded
+        const auto allowedSize =
+            static_cast<double>(av_gettime() - startTime +
+                                m_outputCacheReplayLead) *
+            rate;
+        if (static_cast<double>(sentSize) >= allowedSize) {
+            av_usleep(m_outputCacheReplaySleep);
+            continue;
+        }
+
+        auto size = std::fread(buf.data(), 1, buf.size(), file.get());
+        if (size == 0) throw std::runtime_error("output cache read error");
+
+        m_dataReadyHandler(buf.data(), size);
+        sentSize += size;
+
+        if (sentSize < entry.size)
+            notifyDoneFiles(std::chrono::microseconds{static_cast<int64_t>(
+                static_cast<double>(sentSize) / rate)});
+    }
+
+    if (sentSize < entry.size) return;
+
+    notifyDoneFiles(std::chrono::microseconds::max());
+
+    m_terminationReason = TerminationReason::Eof;
+}
+
 void Caster::startMuxing() {
+    m_fragmentPending = false;
+    m_lastFragmentTime = 0;
+
     if (videoEnabled()) {
         if (audioEnabled())
             startVideoAudioMuxing();
@@ -3192,10 +4935,14 @@ void Caster::setVideoStreamRotation(VideoOrientation requestedOrientation) {
     switch (props.type) {
         case VideoSourceType::DroidCam:
             break;
-        case VideoSourceType::Unknown:
         case VideoSourceType::V4l2:
+            // without encoder, rotation can only be signaled in metadata
+            if (m_videoPassthrough) break;
+            return;
+        case VideoSourceType::Unknown:
         case VideoSourceType::X11Capture:
         case VideoSourceType::LipstickCapture:
+        case VideoSourceType::WlrCapture:
         case VideoSourceType::Test:
         case VideoSourceType::DroidCamRaw:
             return;
@@ -3252,6 +4999,9 @@ bool Caster::readVideoFrameFromBuf(AVPacket *pkt) {
 
     m_videoBuf.pull(pkt->data, m_videoRawFrameSize);
 
+    m_videoCaptureTime =
+        m_videoBufCaptureTime > 0 ? m_videoBufCaptureTime : av_gettime();
+
     return true;
 }
 
@@ -3264,6 +5014,23 @@ void Caster::readVideoFrameFromDemuxer(AVPacket *pkt) {
 
         throw std::runtime_error("av_read_frame for video error");
     }
+
+    m_videoCaptureTime = captureTimeFromPkt(
+        pkt, m_inVideoFormatCtx->streams[pkt->stream_index]->time_base);
+
+    markVideoDataReceived();
+}
+
+int64_t Caster::captureTimeFromPkt(const AVPacket *pkt, AVRational timeBase) {
+    const auto now = av_gettime();
+
+    if (pkt->pts == AV_NOPTS_VALUE) return now;
+
+    // only wall clock timestamps (v4l2, x11grab) are capture timestamps
+    const auto time = av_rescale_q(pkt->pts, timeBase, AV_TIME_BASE_Q);
+    if (std::abs(now - time) > m_maxCaptureTimeSkew) return now;
+
+    return time;
 }
 
 bool Caster::filterVideoFrame(VideoTrans trans, AVFrame *frameIn,
@@ -3343,6 +5110,12 @@ AVFrame *Caster::filterVideoIfNeeded(AVFrame *frameIn) {
                     return transForYinverted(m_videoTrans,
                                              m_lipstickRecorder->yinverted());
                 }
+#endif
+#ifdef USE_WLR_CAPTURE
+                if (m_wlrCapture) {
+                    return transForYinverted(m_videoTrans,
+                                             m_wlrCapture->yinverted());
+                }
 #endif
                 break;
             case VideoTrans::Frame169:
@@ -3425,9 +5198,29 @@ bool Caster::encodeVideoFrame(AVPacket *pkt) {
     m_videoFrameIn->width = m_inVideoCtx->width;
     m_videoFrameIn->height = m_inVideoCtx->height;
 
-    auto *frameOut = filterVideoIfNeeded(m_videoFrameIn);
+    return encodeVideoFrame(m_videoFrameIn, pkt);
+}
+
+bool Caster::encodeVideoFrame(AVFrame *frameIn, AVPacket *pkt) {
+    if (videoFrameDecimated()) {
+        av_frame_unref(frameIn);
+        return false;
+    }
+
+    auto *frameOut = filterVideoIfNeeded(frameIn);
     if (frameOut == nullptr) return false;
 
+    return encodeFilteredVideoFrame(frameOut, pkt);
+}
+
+bool Caster::encodeFilteredVideoFrame(AVFrame *frameOut, AVPacket *pkt) {
+    if (!m_videoOverlays.empty()) blendVideoOverlays(frameOut);
+
+    if (m_forceVideoKeyframe.exchange(false)) {
+        LOGD("forcing video key frame");
+        frameOut->pict_type = AV_PICTURE_TYPE_I;
+    }
+
     if (auto ret = avcodec_send_frame(m_outVideoCtx, frameOut);
         ret != 0 && ret != AVERROR(EAGAIN)) {
         av_frame_unref(frameOut);
@@ -3541,21 +5334,38 @@ bool Caster::insertExtradata(AVPacket *pkt) const {
     return true;
 }
 
-bool Caster::muxVideo(AVPacket *pkt) {
-    const auto now = av_gettime();
-
-    LOGT("video read real frame");
-
+bool Caster::readVideoPktFromSource(AVPacket *pkt) {
     switch (videoProps().type) {
         case VideoSourceType::DroidCam:
             readVideoFrameFromDemuxer(pkt);
             break;
         case VideoSourceType::V4l2:
+            if (m_videoPassthrough) {
+                readVideoFrameFromDemuxer(pkt);
+                break;
+            }
+#ifdef USE_V4L2
+            if (m_v4l2Source) {
+                if (!readVideoFrameFromV4l2()) return false;
+                if (!encodeVideoFrame(m_videoFrameIn, pkt)) return false;
+                break;
+            }
+            if (m_mjpegDecoder) {
+                readVideoFrameFromDemuxer(pkt);
+                m_mjpegDecoder->push(pkt, m_videoCaptureTime);
+                if (!m_mjpegDecoder->pull(m_videoFrameIn, m_videoCaptureTime))
+                    return false;
+                if (!encodeVideoFrame(m_videoFrameIn, pkt)) return false;
+                break;
+            }
+#endif
+            [[fallthrough]];
         case VideoSourceType::X11Capture:
             readVideoFrameFromDemuxer(pkt);
             if (!encodeVideoFrame(pkt)) return false;
             break;
         case VideoSourceType::LipstickCapture:
+        case VideoSourceType::WlrCapture:
         case VideoSourceType::Test:
         case VideoSourceType::DroidCamRaw:
             if (!readVideoFrameFromBuf(pkt)) return false;
@@ -3565,28 +5375,98 @@ bool Caster::muxVideo(AVPacket *pkt) {
             throw std::runtime_error("unknown video source type");
     }
 
+    return true;
+}
+
+bool Caster::readVideoPktFromSwitchSource(AVPacket *pkt) {
+    // fresh frame of switched source paces encoding like capture does
+    if (!m_videoSwitchSource->overlay.fresh()) {
+        av_usleep(m_videoSwitchPollTime);
+        return false;
+    }
+
+    m_videoCaptureTime = av_gettime();
+
+    m_videoFrameIn->format = m_outVideoCtx->pix_fmt;
+    m_videoFrameIn->width = m_outVideoCtx->width;
+    m_videoFrameIn->height = m_outVideoCtx->height;
+    if (av_frame_get_buffer(m_videoFrameIn, 0) < 0)
+        throw std::runtime_error("av_frame_get_buffer for video error");
+
+    // picture is scaled to encoder dim, area around it is painted black
+    if (!m_videoSwitchSource->overlay.blend(m_videoFrameIn) ||
+        videoFrameDecimated()) {
+        av_frame_unref(m_videoFrameIn);
+        return false;
+    }
+
+    return encodeFilteredVideoFrame(m_videoFrameIn, pkt);
+}
+
+bool Caster::muxVideo(AVPacket *pkt) {
+    LOGT("video read real frame");
+
+    updateEncodersIfNeeded();
+    switchVideoSourceIfNeeded();
+
+    if (m_videoSwitchSource) {
+        if (!readVideoPktFromSwitchSource(pkt)) return false;
+    } else if (!readVideoPktFromSource(pkt)) {
+        return false;
+    }
+
     if (!avPktOk(pkt)) {
         av_packet_unref(pkt);
         return false;
     }
 
+    if (m_videoExtradataStale) {
+        m_pktSideData.clear();
+        extractExtradata(pkt);
+        m_videoExtradataStale = false;
+    }
+
     if (!insertExtradata(pkt)) return false;
 
-    updateVideoSampleStats(now);
+    updateVideoSampleStats(m_videoCaptureTime);
+
+    if (m_videoFirstCaptureTime == 0)
+        m_videoFirstCaptureTime = m_videoCaptureTime;
 
     LOGT("video: frd=" << m_videoRealFrameDuration << ", npts="
                        << m_nextVideoPts << ", lft=" << m_videoTimeLastFrame
+                       << ", ct="
+                       << m_videoCaptureTime - m_videoFirstCaptureTime
                        << ", os_tb=" << m_outVideoStream->time_base
                        << ", data=" << dataToStr(pkt->data, pkt->size));
 
+    // pts follows capture time, but it can't go back
+    const auto pts = std::max(
+        rescaleFromUsec(m_videoCaptureTime - m_videoFirstCaptureTime,
+                        m_outVideoStream->time_base),
+        m_lastVideoPts + 1);
+
     pkt->stream_index = m_outVideoStream->index;
-    pkt->pts = m_nextVideoPts;
-    pkt->dts = m_nextVideoPts;
+    pkt->pts = pts;
+    pkt->dts = pts;
+
+    // decimated frames last for encoder frame duration
+    const auto encoderFramerate = videoEncoderFramerate();
+    pkt->duration = rescaleFromUsec(
+        encoderFramerate < m_videoFramerate
+            ? rescaleToUsec(1, AVRational{1, encoderFramerate})
+            : m_videoRealFrameDuration,
+        m_outVideoStream->time_base);
 
-    pkt->duration =
-        rescaleFromUsec(m_videoRealFrameDuration, m_outVideoStream->time_base);
+    m_lastVideoPts = pts;
+    m_nextVideoPts = pts + pkt->duration;
 
-    m_nextVideoPts += pkt->duration;
+    // fragment should start with key frame
+    if (m_config.fragmentPolicy == FragmentPolicy::Gop &&
+        pkt->flags & AV_PKT_FLAG_KEY)
+        writeFragment();
+
+    if (pkt->flags & AV_PKT_FLAG_KEY) markSyncPoint(pkt, m_outVideoStream);
 
     if (auto ret = av_write_frame(m_outFormatCtx, pkt); ret < 0)
         throw std::runtime_error("av_interleaved_write_frame for video error");
@@ -3649,7 +5529,13 @@ bool Caster::readAudioPktFromBuf(AVPacket *pkt, bool nullWhenNoEnoughData) {
     std::lock_guard lock{m_audioMtx};
 
     if (!m_audioBuf.hasEnoughData(m_audioInFrameSize)) {
-        const auto pushNull = m_paStream == nullptr || nullWhenNoEnoughData;
+        // silence is pushed when there is no pa stream to capture
+        const auto type = audioProps().type;
+        const auto paSource = type == AudioSourceType::Mic ||
+                              type == AudioSourceType::Monitor ||
+                              type == AudioSourceType::Playback;
+        const auto pushNull =
+            (m_paStream == nullptr && paSource) || nullWhenNoEnoughData;
 
         if (pushNull) {
             LOGT("audio push null: "
@@ -3667,6 +5553,9 @@ bool Caster::readAudioPktFromBuf(AVPacket *pkt, bool nullWhenNoEnoughData) {
     if (!m_audioBuf.pullExact(pkt->data, m_audioInFrameSize))
         throw std::runtime_error("failed to pull from buf");
 
+    if (!m_audioMixSources.empty())
+        mixAudio(pkt->data, static_cast<size_t>(m_audioInFrameSize));
+
     return true;
 }
 
@@ -3677,6 +5566,13 @@ bool Caster::readAudioPktFromDemuxer(AVPacket *pkt) {
 
             if (audioProps().type == AudioSourceType::File) {
                 cleanAvAudioInputFormat();
+                if (m_outputCache) {
+                    // file boundary is replayed from cache too
+                    std::lock_guard lock{m_dataReadyHandlerMtx};
+                    m_outputCache->markFileEnd(std::chrono::microseconds{
+                        rescaleToUsec(m_nextAudioPts,
+                                      m_outAudioStream->time_base)});
+                }
                 if (m_config.fileSourceConfig &&
                     m_config.fileSourceConfig->fileStreamingDoneHandler)
                     m_config.fileSourceConfig->fileStreamingDoneHandler(
@@ -3692,6 +5588,7 @@ bool Caster::readAudioPktFromDemuxer(AVPacket *pkt) {
             }
 
             m_terminationReason = TerminationReason::Eof;
+            commitOutputCache();
         }
         throw std::runtime_error("av_read_frame from audio demuxer error");
     }
@@ -3737,15 +5634,7 @@ bool Caster::readAudioFrame(AVPacket *pkt, DataSource source,
                 "avcodec_receive_frame from audio decoder error");
         }
 
-        if (av_audio_fifo_realloc(m_audioFifo, av_audio_fifo_size(m_audioFifo) +
-                                                   m_audioFrameIn->nb_samples) <
-            0)
-            throw std::runtime_error("av_audio_fifo_realloc error");
-
-        if (av_audio_fifo_write(
-                m_audioFifo, reinterpret_cast<void **>(m_audioFrameIn->data),
-                m_audioFrameIn->nb_samples) < m_audioFrameIn->nb_samples)
-            throw std::runtime_error("av_audio_fifo_write error");
+        writeAudioFifo(m_audioFrameIn);
 
         av_frame_unref(m_audioFrameIn);
     }
@@ -3855,6 +5744,9 @@ bool Caster::encodeAudioFrame(AVPacket *pkt) {
 bool Caster::muxAudio(AVPacket *pkt) {
     bool pktDone = false;
 
+    // with video, encoders are updated in muxVideo
+    if (!videoEnabled()) updateEncodersIfNeeded();
+
     while (!terminating() && m_state != State::Paused) {
         auto now = av_gettime();
         const auto maxAudioDelay =
@@ -3903,6 +5795,9 @@ bool Caster::muxAudio(AVPacket *pkt) {
         LOGT("audio mux: tb=" << m_outAudioStream->time_base
                               << ", pkt=" << pkt);
 
+        // every audio frame can start stream when there is no video
+        if (!videoEnabled()) markSyncPoint(pkt, m_outAudioStream);
+
         if (auto ret = av_write_frame(m_outFormatCtx, pkt); ret < 0)
             throw std::runtime_error(
                 "av_interleaved_write_frame for audio error");
@@ -3942,17 +5837,131 @@ int Caster::avWritePacketCallback(uint8_t *buf, int bufSize) {
     LOGT("write packet: size=" << bufSize
                                << ", data=" << dataToStr(buf, bufSize));
 
-    if (!terminating() && m_dataReadyHandler) {
-        if (!m_muxedFlushed && m_avMuxingThread.joinable()) {
+    if (!terminating() && !m_detached && m_dataReadyHandler) {
+        // stream header is passed without delay
+        if (m_state != State::Started) {
+            flushOutBlock();
+            return static_cast<int>(m_dataReadyHandler(buf, bufSize));
+        }
+
+        if (!m_muxedFlushed) {
             LOGD("first av muxed data");
             m_muxedFlushed = true;
+            addStartupTime(StartupPhase::FirstMuxedData);
         }
-        return static_cast<int>(m_dataReadyHandler(buf, bufSize));
+
+        if (m_outBlock.empty()) m_outBlockTime = av_gettime();
+        m_outBlock.insert(m_outBlock.end(), buf, buf + bufSize);
+
+        if (m_outBlock.size() >= m_outBlockSize ||
+            av_gettime() - m_outBlockTime >= m_outMaxDelay)
+            flushOutBlock();
     }
 
     return bufSize;
 }
 
+void Caster::markSyncPoint(const AVPacket *pkt, const AVStream *stream) {
+    // mp4 muxer marks fragments by itself
+    if (m_config.streamFormat == StreamFormat::Mp4) return;
+
+    // buffered data is flushed, so next writeout starts with this packet,
+    // mpegts muxer writes only whole ts packets, so writeout is aligned too
+    avio_write_marker(
+        m_outFormatCtx->pb,
+        av_rescale_q(pkt->pts, stream->time_base, AV_TIME_BASE_Q),
+        AVIO_DATA_MARKER_SYNC_POINT);
+}
+
+void Caster::flushOutBlock() {
+    if (m_outBlock.empty()) return;
+
+    LOGT("flush out block: size=" << m_outBlock.size());
+
+    if (!terminating() && !m_detached && m_dataReadyHandler)
+        m_dataReadyHandler(m_outBlock.data(), m_outBlock.size());
+
+    m_outBlock.clear();
+}
+
+int Caster::avWriteDataTypeCallbackStatic(void *opaque, uint8_t *buf,
+                                          int bufSize, AVIODataMarkerType type,
+                                          int64_t time) {
+    return static_cast<Caster *>(opaque)->avWriteDataTypeCallback(
+        buf, bufSize, type, time);
+}
+
+int Caster::avWriteDataTypeCallback(uint8_t *buf, int bufSize,
+                                    AVIODataMarkerType type, int64_t time) {
+    if (bufSize < 0)
+        throw std::runtime_error("invalid write data type callback buf size");
+
+    const auto header = type == AVIO_DATA_MARKER_HEADER;
+    // stream can be joined only at writeout starting with key frame
+    // (fragment in mp4, see markSyncPoint for other formats), data bigger
+    // than avio buf is written in several writeouts with the same marker
+    const auto syncPoint = type == AVIO_DATA_MARKER_SYNC_POINT &&
+                           m_lastDataMarker != std::make_pair(type, time);
+    m_lastDataMarker = {type, time};
+
+    if (m_recorder) {
+        m_recorder->write(buf, static_cast<size_t>(bufSize),
+                          header      ? Recorder::DataType::Header
+                          : syncPoint ? Recorder::DataType::SyncPoint
+                                      : Recorder::DataType::Other);
+    }
+
+    std::unique_lock lock{m_dataReadyHandlerMtx};
+
+    if (header) {
+        m_initSegment.insert(m_initSegment.end(), buf, buf + bufSize);
+    } else if (m_pendingDataReadyHandler && syncPoint && !m_detached) {
+        LOGD("reattaching data ready handler, init segment size="
+             << m_initSegment.size());
+        flushOutBlock();
+        m_dataReadyHandler = std::move(*m_pendingDataReadyHandler);
+        m_pendingDataReadyHandler.reset();
+        if (!m_initSegment.empty())
+            m_dataReadyHandler(m_initSegment.data(), m_initSegment.size());
+        // playback from the past is only a lookup in buffered stream
+        if (m_timeShiftBuffer && m_pendingTimeShift.count() > 0)
+            m_timeShiftBuffer->read(m_pendingTimeShift, m_dataReadyHandler);
+    }
+
+    if (m_timeShiftBuffer && !header)
+        m_timeShiftBuffer->push(buf, static_cast<size_t>(bufSize), syncPoint);
+
+    if (m_outputCache) m_outputCache->write(buf, static_cast<size_t>(bufSize));
+
+    lock.unlock();
+
+    return avWritePacketCallback(buf, bufSize);
+}
+
+void Caster::reattach(DataReadyHandler cb, std::chrono::seconds timeShift) {
+    LOGD("data ready handler reattach requested, time-shift: "
+         << timeShift.count() << "s");
+
+    std::lock_guard lock{m_dataReadyHandlerMtx};
+    m_pendingDataReadyHandler.emplace(std::move(cb));
+    m_pendingTimeShift = timeShift;
+    m_forceVideoKeyframe = true;
+}
+
+void Caster::detach() {
+    LOGD("detaching caster");
+
+    m_detached = true;
+
+    // capture and encoding are not needed until caster is destroyed
+    if (m_state == State::Started && !m_outputCacheReplaying) pause();
+}
+
+std::vector<uint8_t> Caster::initSegment() const {
+    std::lock_guard lock{m_dataReadyHandlerMtx};
+    return m_initSegment;
+}
+
 int Caster::avReadPacketCallbackStatic(void *opaque, uint8_t *buf,
                                        int bufSize) {
     return static_cast<Caster *>(opaque)->avReadPacketCallback(buf, bufSize);
@@ -4007,13 +6016,18 @@ void Caster::setAudioVolume(int volume) {
 
     m_config.audioVolume = volume;
     m_audioVolumeUpdated = true;
+
+    discardOutputCache();
 }
 
 uint32_t Caster::hash(std::string_view str) {
     return std::accumulate(str.cbegin(), str.cend(), 0U) % 999;
 }
 
-Caster::VideoPropsMap Caster::detectVideoSources(uint32_t options) {
+Caster::VideoPropsMap Caster::detectVideoSources(
+    uint32_t options,
+    [[maybe_unused]] const TestSource::Props &testSourceProps,
+    [[maybe_unused]] int screenCaptureFramerate) {
     avdevice_register_all();
 
     VideoPropsMap props;
@@ -4032,10 +6046,15 @@ Caster::VideoPropsMap Caster::detectVideoSources(uint32_t options) {
 #endif
 #ifdef USE_LIPSTICK_RECORDER
     if (options & OptionsFlags::LipstickCaptureVideoSources)
-        props.merge(detectLipstickRecorderVideoSources());
+        props.merge(
+            detectLipstickRecorderVideoSources(screenCaptureFramerate));
+#endif
+#ifdef USE_WLR_CAPTURE
+    if (options & OptionsFlags::WlrCaptureVideoSources)
+        props.merge(detectWlrVideoSources(screenCaptureFramerate));
 #endif
 #ifdef USE_TESTSOURCE
-    props.merge(detectTestVideoSources());
+    props.merge(detectTestVideoSources(testSourceProps));
 #endif
     return props;
 }
@@ -4044,12 +6063,12 @@ Caster::SensorDirection Caster::videoDirection() const {
     return videoProps().sensorDirection;
 }
 
-Caster::VideoPropsMap Caster::detectTestVideoSources() {
+Caster::VideoPropsMap Caster::detectTestVideoSources(
+    const TestSource::Props &iprops) {
     LOGD("test video source detecton started");
     VideoPropsMap map;
 
     if (TestSource::supported()) {
-        auto iprops = TestSource::properties();
 
         {
             VideoSourceInternalProps props;
@@ -4113,13 +6132,23 @@ Caster::VideoPropsMap Caster::detectTestVideoSources() {
     return map;
 }
 
-void Caster::rawVideoDataReadyHandler(const uint8_t *data, size_t size) {
+void Caster::rawVideoDataReadyHandler(const uint8_t *data, size_t size,
+                                      int64_t captureTime) {
     if (terminating()) return;
 
-    LOGT("raw video data ready: size=" << size);
+    LOGT("raw video data ready: size=" << size << ", ct=" << captureTime);
+
+    markVideoDataReceived();
 
     std::lock_guard lock{m_videoMtx};
 
+    // source timestamp is used when it is close to delivery time
+    const auto now = av_gettime();
+    m_videoBufCaptureTime =
+        captureTime > 0 && std::abs(now - captureTime) <= m_maxCaptureTimeSkew
+            ? captureTime
+            : now;
+
     if (m_videoBuf.hasEnoughData(size)) {
         m_videoBuf.pushOverwriteTail(data, size);
     } else {
@@ -4132,6 +6161,8 @@ void Caster::compressedVideoDataReadyHandler(const uint8_t *data, size_t size) {
 
     LOGT("compressed video data ready: size=" << size);
 
+    markVideoDataReceived();
+
     std::unique_lock lock{m_videoMtx};
     m_videoCv.wait(lock, [this, size] {
         return terminating() || m_state == State::Paused ||
@@ -4479,7 +6510,11 @@ void Caster::addV4l2VideoFormatsExt(int fd, v4l2_buf_type type,
         if (c == AV_CODEC_ID_NONE) continue;
 
         auto pf = ff_tools::ff_fmt_v4l2ff(vfmt.pixelformat, c);
-        if (pf == AV_PIX_FMT_NONE) continue;
+        // h264 has no pixfmt, but it can be passed through without encoding,
+        // mjpeg pixfmt is known only after decoding
+        if (pf == AV_PIX_FMT_NONE && c != AV_CODEC_ID_H264 &&
+            c != AV_CODEC_ID_MJPEG)
+            continue;
 
         auto fs = detectV4l2FrameSpecs(fd, vfmt.pixelformat);
         if (fs.empty()) continue;
@@ -4575,6 +6610,11 @@ Caster::VideoPropsMap Caster::detectV4l2VideoSources() {
             continue;
         }
 
+        // encoder falls back to the first format, so raw formats go first
+        std::stable_partition(
+            outFormats.begin(), outFormats.end(),
+            [](const auto &f) { return f.codecId == AV_CODEC_ID_RAWVIDEO; });
+
         Caster::VideoSourceInternalProps props;
         props.type = VideoSourceType::V4l2;
         props.name = fmt::format(
@@ -4629,7 +6669,9 @@ void Caster::detectV4l2Encoders() {
         std::vector<VideoFormat> outFormats;
         addV4l2VideoFormats(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE, outFormats);
         addV4l2VideoFormats(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, outFormats);
-        if (outFormats.empty()) {
+        if (std::none_of(
+                outFormats.cbegin(), outFormats.cend(),
+                [](const auto &f) { return f.codecId == AV_CODEC_ID_H264; })) {
             LOGD("v4l2 encoder does not support h264");
             close(fd);
             continue;
@@ -4638,6 +6680,13 @@ void Caster::detectV4l2Encoders() {
         std::vector<VideoFormat> formats;
         addV4l2VideoFormats(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT, formats);
         addV4l2VideoFormats(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, formats);
+        // jpeg codecs share m2m interface, but only raw input can be encoded
+        formats.erase(std::remove_if(formats.begin(), formats.end(),
+                                     [](const auto &f) {
+                                         return f.codecId !=
+                                                AV_CODEC_ID_RAWVIDEO;
+                                     }),
+                      formats.end());
 
         if (!formats.empty()) {
             auto props = m_v4l2Encoders.emplace_back(
@@ -4693,14 +6742,157 @@ Caster::bestVideoFormatForV4l2Encoder(const VideoSourceInternalProps &props) {
     return {props.formats.front(),
             m_v4l2Encoders.front().formats.front().pixfmt};
 }
+
+const Caster::VideoFormatExt *Caster::v4l2PassthroughFormat() const {
+    if (!(m_config.options & OptionsFlags::V4l2Passthrough)) return nullptr;
+
+    // overlays, scaling and transformations are applied to raw frames
+    const auto &params = m_config.encoderParams;
+    if (!m_config.videoOverlaySources.empty() ||
+        m_videoTrans != VideoTrans::Off ||
+        params.videoScale.value_or(videoProps().scale) != VideoScale::Off ||
+        params.videoBitrate > 0 || params.videoFramerate > 0) {
+        LOGD("v4l2 passthrough not possible, video has to be encoded");
+        return nullptr;
+    }
+
+    const auto &formats = videoProps().formats;
+
+    auto it = std::find_if(formats.cbegin(), formats.cend(), [](const auto &f) {
+        return f.codecId == AV_CODEC_ID_H264;
+    });
+
+    return it == formats.cend() ? nullptr : &*it;
+}
+
+void Caster::initAvVideoForV4l2Passthrough(const VideoFormatExt &format) {
+    LOGD("initing video for v4l2 passthrough: " << format);
+
+    const auto &fs = format.frameSpecs.front();
+
+    m_videoFramerate = static_cast<int>(*fs.framerates.begin());
+    m_inDim = fs.dim;
+    m_inPixfmt = format.pixfmt;
+    m_inVideoCodecId = format.codecId;
+    m_videoPassthrough = true;
+
+    initAvVideoInputRawFormat();
+    findAvVideoInputStreamIdx();
+}
+
+const Caster::VideoFormatExt *Caster::v4l2MjpegFormat(
+    const VideoSourceInternalProps &props, const VideoFormatExt &raw) {
+    if (raw.codecId != AV_CODEC_ID_RAWVIDEO) return nullptr;
+
+    auto it = std::find_if(
+        props.formats.cbegin(), props.formats.cend(),
+        [](const auto &f) { return f.codecId == AV_CODEC_ID_MJPEG; });
+    if (it == props.formats.cend()) return nullptr;
+
+    const auto &rawFs = raw.frameSpecs.front();
+    const auto &mjpegFs = it->frameSpecs.front();
+
+    // raw formats are limited by usb bandwidth, so usually mjpeg gives
+    // higher resolution or framerate
+    if (rawFs.dim > mjpegFs.dim) return nullptr;
+    if (mjpegFs.dim > rawFs.dim ||
+        *mjpegFs.framerates.begin() > *rawFs.framerates.begin())
+        return &*it;
+
+    return nullptr;
+}
+
+void Caster::initMjpegDecoder() {
+    auto threads = MjpegDecoder::defaultThreadCount();
+    if (threads < 2) {
+        LOGD("single cpu, mjpeg decoded without threads");
+        return;
+    }
+
+    m_mjpegDecoder.emplace(
+        m_inVideoFormatCtx->streams[m_inVideoStreamIdx]->codecpar, threads);
+}
+
+bool Caster::v4l2CaptureEnabled() const {
+    // compressed formats still go through demuxer and decoder
+    return videoProps().type == VideoSourceType::V4l2 &&
+           m_inVideoCodecId == AV_CODEC_ID_RAWVIDEO &&
+           m_config.v4l2QueueDepth > 0;
+}
+
+void Caster::initV4l2Capture() {
+    const auto &props = videoProps();
+
+    // capture is re-created when switched source is dropped
+    if (m_v4l2Frame == nullptr) m_v4l2Frame = av_frame_alloc();
+
+    m_v4l2Source.emplace(
+        V4l2Source::Props{props.dev, m_inDim.width, m_inDim.height,
+                          static_cast<uint32_t>(m_videoFramerate), m_inPixfmt,
+                          static_cast<uint32_t>(m_config.v4l2QueueDepth)},
+        [this](AVFrame *frame, int64_t captureTime) {
+            v4l2FrameReadyHandler(frame, captureTime);
+        },
+        [this] {
+            LOGE("error in v4l2-source");
+            reportError();
+        });
+}
+
+void Caster::v4l2FrameReadyHandler(AVFrame *frame, int64_t captureTime) {
+    if (terminating()) {
+        av_frame_free(&frame);
+        return;
+    }
+
+    markVideoDataReceived();
+
+    {
+        std::lock_guard lock{m_videoMtx};
+
+        // stale frame is dropped, so its buffer goes back to the driver
+        av_frame_unref(m_v4l2Frame);
+        av_frame_move_ref(m_v4l2Frame, frame);
+        m_v4l2FrameCaptureTime = captureTime;
+    }
+
+    av_frame_free(&frame);
+
+    m_videoCv.notify_one();
+}
+
+bool Caster::readVideoFrameFromV4l2() {
+    std::unique_lock lock{m_videoMtx};
+
+    if (!m_videoCv.wait_for(
+            lock, std::chrono::microseconds{m_videoFrameDuration},
+            [this] { return terminating() || m_v4l2Frame->buf[0]; })) {
+        LOGT("v4l2 frame not ready");
+        return false;
+    }
+
+    if (terminating()) return false;
+
+    av_frame_move_ref(m_videoFrameIn, m_v4l2Frame);
+
+    const auto now = av_gettime();
+    m_videoCaptureTime =
+        std::abs(now - m_v4l2FrameCaptureTime) > m_maxCaptureTimeSkew
+            ? now
+            : m_v4l2FrameCaptureTime;
+
+    return true;
+}
 #endif  // USE_V4L2
 #ifdef USE_LIPSTICK_RECORDER
-Caster::VideoPropsMap Caster::detectLipstickRecorderVideoSources() {
+Caster::VideoPropsMap Caster::detectLipstickRecorderVideoSources(
+    int framerate) {
     LOGD("lipstick-recorder video source detecton started");
     VideoPropsMap map;
 
     if (LipstickRecorderSource::supported()) {
         auto lprops = LipstickRecorderSource::properties();
+        if (framerate > 0) lprops.framerate = static_cast<uint32_t>(framerate);
 
         {
             VideoSourceInternalProps props;
@@ -4745,3 +6937,190 @@ Caster::VideoPropsMap Caster::detectLipstickRecorderVideoSources() {
     return map;
 }
 #endif
+
+#ifdef USE_WLR_CAPTURE
+Caster::VideoPropsMap Caster::detectWlrVideoSources(int framerate) {
+    LOGD("wlr-capture video source detecton started");
+    VideoPropsMap map;
+
+    if (!WlrCaptureSource::supported()) return map;
+
+    std::vector<WlrCaptureSource::Props> outputs;
+    try {
+        outputs = WlrCaptureSource::properties();
+    } catch (const std::runtime_error &e) {
+        LOGW("failed to get wlr outputs: " << e.what());
+        return map;
+    }
+
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        const auto &wprops = outputs[i];
+
+        if (wprops.pixfmt == AV_PIX_FMT_NONE) continue;
+
+        // raw frames are passed without re-packing
+        if (wprops.stride != wprops.width * 4) {
+            LOGW("wlr output stride not supported: " << wprops.stride);
+            continue;
+        }
+
+        VideoSourceInternalProps props;
+        props.type = VideoSourceType::WlrCapture;
+        props.name = fmt::format("wlr-screen-{}", i + 1);
+        props.friendlyName =
+            fmt::format("Screen {} capture ({})", i + 1, wprops.outputName);
+        props.dev = std::to_string(i);
+
+        FrameSpec fs{Dim{wprops.width, wprops.height},
+                     {framerate > 0 ? static_cast<uint32_t>(framerate)
+                                    : wprops.framerate}};
+
+        props.orientation = fs.dim.orientation();
+        props.formats.push_back(
+            VideoFormatExt{AV_CODEC_ID_RAWVIDEO, wprops.pixfmt, {fs}});
+
+        LOGD("wlr-capture source found: " << props);
+
+        map.try_emplace(props.name, std::move(props));
+    }
+
+    LOGD("wlr-capture video source detecton completed");
+
+    return map;
+}
+#endif
+
+#ifdef USE_PIPEWIRE
+Caster::AudioPropsMap Caster::detectPwSources(uint32_t options) {
+    LOGD("pw audio sources detection started");
+
+    AudioPropsMap map;
+
+    for (auto &source : PipeWireSource::sources()) {
+        if (source.monitor && !(options & OptionsFlags::PwMonitorAudioSources))
+            continue;
+        if (!source.monitor && !(options & OptionsFlags::PwMicAudioSources))
+            continue;
+
+        AudioSourceInternalProps props{
+            /*name=*/source.monitor
+                ? fmt::format("{}monitor-{:03}", pwAudioSourcePrefix,
+                              hash(source.name))
+                : fmt::format("{}mic-{:03}", pwAudioSourcePrefix,
+                              hash(source.name)),
+            /*dev=*/source.name,
+            /*friendlyName=*/source.friendlyName,
+            /*codec=*/AV_CODEC_ID_PCM_S16LE,
+            /*channels=*/source.channels,
+            /*rate=*/source.rate,
+            /*bps=*/2,
+            /*type=*/source.monitor ? AudioSourceType::PwMonitor
+                                    : AudioSourceType::PwMic};
+
+        LOGD("pw audio source found: " << props);
+
+        map.try_emplace(props.name, std::move(props));
+    }
+
+    LOGD("pw audio sources detection completed");
+
+    return map;
+}
+
+void Caster::initPw() {
+    const auto &props = audioProps();
+
+    m_pwSource.emplace(
+        PipeWireSource::Props{props.dev, props.friendlyName,
+                              props.type == AudioSourceType::PwMonitor,
+                              props.rate, props.channels},
+        [this](const uint8_t *data, size_t size) {
+            pwAudioDataReadyHandler(data, size);
+        },
+        [this] {
+            LOGE("error in pipewire-source");
+            reportError();
+        });
+}
+
+void Caster::pwAudioDataReadyHandler(const uint8_t *data, size_t size) {
+    std::lock_guard lock{m_audioMtx};
+
+    if (m_state != State::Started) return;
+
+    m_audioBuf.pushExactForce(data, size);
+
+    if (!m_pwDataReceived) {
+        m_pwDataReceived = true;
+        LOGD("first pw data received");
+        addStartupTime(StartupPhase::FirstAudioFrame);
+    }
+}
+#endif
+
+bool Caster::alsaAudioSource(const std::string &name) {
+    return name.rfind(alsaAudioSourcePrefix, 0) == 0;
+}
+
+bool Caster::pwAudioSource(const std::string &name) {
+    return name.rfind(pwAudioSourcePrefix, 0) == 0;
+}
+
+#ifdef USE_ALSA
+Caster::AudioPropsMap Caster::detectAlsaSources() {
+    LOGD("alsa audio sources detection started");
+
+    AudioPropsMap map;
+
+    for (auto &source : AlsaSource::sources()) {
+        AudioSourceInternalProps props{
+            /*name=*/fmt::format("{}{:03}", alsaAudioSourcePrefix,
+                                 hash(source.name)),
+            /*dev=*/source.name,
+            /*friendlyName=*/source.friendlyName,
+            /*codec=*/AV_CODEC_ID_PCM_S16LE,
+            /*channels=*/source.channels,
+            /*rate=*/source.rate,
+            /*bps=*/2,
+            /*type=*/AudioSourceType::Alsa};
+
+        LOGD("alsa audio source found: " << props);
+
+        map.try_emplace(props.name, std::move(props));
+    }
+
+    LOGD("alsa audio sources detection completed");
+
+    return map;
+}
+
+void Caster::initAlsa() {
+    const auto &props = audioProps();
+
+    m_alsaSource.emplace(
+        AlsaSource::Props{props.dev, props.friendlyName, props.rate,
+                          props.channels,
+                          static_cast<uint32_t>(m_config.alsaPeriodSize)},
+        [this](const uint8_t *data, size_t size) {
+            alsaAudioDataReadyHandler(data, size);
+        },
+        [this] {
+            LOGE("error in alsa-source");
+            reportError();
+        });
+}
+
+void Caster::alsaAudioDataReadyHandler(const uint8_t *data, size_t size) {
+    std::lock_guard lock{m_audioMtx};
+
+    if (m_state != State::Started) return;
+
+    m_audioBuf.pushExactForce(data, size);
+
+    if (!m_alsaDataReceived) {
+        m_alsaDataReceived = true;
+        LOGD("first alsa data received");
+        addStartupTime(StartupPhase::FirstAudioFrame);
+    }
+}
+#endif
@@ -24,15 +24,19 @@ extern "C" {
 #include <libavformat/avformat.h>
 #include <libavutil/audio_fifo.h>
 #include <libavutil/time.h>
+#include <libswresample/swresample.h>
 }
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <cstdint>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <optional>
@@ -46,36 +50,72 @@ extern "C" {
 #include <vector>
 
 #include "databuffer.hpp"
+#include "outputcache.hpp"
+#include "recorder.hpp"
+#include "synthaudiosource.hpp"
 #include "testsource.hpp"
+#include "timeshiftbuffer.hpp"
+#include "videooverlay.hpp"
 
+#ifdef USE_V4L2
+#include "mjpegdecoder.hpp"
+#include "v4l2source.hpp"
+#endif
 #ifdef USE_LIPSTICK_RECORDER
 #include "lipstickrecordersource.hpp"
 #endif
+#ifdef USE_WLR_CAPTURE
+#include "wlrcapturesource.hpp"
+#endif
 #ifdef USE_DROIDCAM
 #include "droidcamsource.hpp"
 #include "orientationmonitor.hpp"
 #endif
+#ifdef USE_PIPEWIRE
+#include "pipewiresource.hpp"
+#endif
+#ifdef USE_ALSA
+#include "alsasource.hpp"
+#endif
 
 class Caster {
    public:
+    // time-shift window is replayed at once, so it has to fit in buffer
+    // of http connection (160 MiB) together with live data
+    static constexpr const int timeShiftMaxSizeLimit = 128;  // MB
+    // names of alsa audio sources start with that
+    static constexpr const char *alsaAudioSourcePrefix = "alsa-";
+    // names of pipewire audio sources start with that
+    static constexpr const char *pwAudioSourcePrefix = "pw-";
+
     enum OptionsFlags : uint32_t {
         OnlyNiceVideoFormats = 1 << 1,
         MuteAudioSource = 1 << 2,
+        V4l2Passthrough = 1 << 3,
+        V4l2Mjpeg = 1 << 4,
         V4l2VideoSources = 1 << 10,
         DroidCamVideoSources = 1 << 11,
         DroidCamRawVideoSources = 1 << 12,
         X11CaptureVideoSources = 1 << 13,
         LipstickCaptureVideoSources = 1 << 14,
+        WlrCaptureVideoSources = 1 << 15,
         PaMicAudioSources = 1 << 20,
         PaMonitorAudioSources = 1 << 21,
         PaPlaybackAudioSources = 1 << 22,
         AllPaAudioSources =
             PaMicAudioSources | PaMonitorAudioSources | PaPlaybackAudioSources,
         FileAudioSources = 1 << 23,
+        PwMicAudioSources = 1 << 24,
+        PwMonitorAudioSources = 1 << 25,
+        AllPwAudioSources = PwMicAudioSources | PwMonitorAudioSources,
+        AlsaAudioSources = 1 << 26,
+        // not included in AllAudioSources, synth sources are opt-in
+        SynthAudioSources = 1 << 27,
         AllVideoSources = V4l2VideoSources | DroidCamVideoSources |
                           DroidCamRawVideoSources | X11CaptureVideoSources |
-                          LipstickCaptureVideoSources,
-        AllAudioSources = AllPaAudioSources | FileAudioSources
+                          LipstickCaptureVideoSources | WlrCaptureVideoSources,
+        AllAudioSources = AllPaAudioSources | AllPwAudioSources |
+                          AlsaAudioSources | FileAudioSources
     };
     friend std::ostream &operator<<(std::ostream &os, OptionsFlags flags);
 
@@ -92,6 +132,27 @@ class Caster {
     enum class TerminationReason { Unknown, Eof, Error };
     friend std::ostream &operator<<(std::ostream &os, TerminationReason reason);
 
+    enum class StartupPhase {
+        SourceDetection,
+        AvInit,
+        AudioInit,
+        VideoInit,
+        AudioEncoderOpen,
+        VideoEncoderOpen,
+        VideoStreamInit,  // out stream, filters, bsf and extradata
+        HeaderWrite,
+        FirstVideoFrame,
+        FirstAudioFrame,
+        FirstMuxedData
+    };
+    friend std::ostream &operator<<(std::ostream &os, StartupPhase phase);
+
+    struct StartupPhaseTime {
+        StartupPhase phase = StartupPhase::SourceDetection;
+        int64_t start = 0;     // micro s, since caster creation
+        int64_t duration = 0;  // micro s
+    };
+
     enum class VideoOrientation {
         Auto,
         Portrait,
@@ -113,6 +174,10 @@ class Caster {
     enum class VideoEncoder { Auto, X264, Nvenc, V4l2 };
     friend std::ostream &operator<<(std::ostream &os, VideoEncoder encoder);
 
+    // when mp4 fragment is cut and muxed data is flushed to the client
+    enum class FragmentPolicy { Frame, Interval, Gop };
+    friend std::ostream &operator<<(std::ostream &os, FragmentPolicy policy);
+
     using DataReadyHandler = std::function<size_t(const uint8_t *, size_t)>;
     using StateChangedHandler = std::function<void(State state)>;
     using AudioSourceNameChangedHandler =
@@ -153,6 +218,28 @@ class Caster {
                                         const FileSourceConfig &config);
     };
 
+    enum class VideoScale { Off, Down25, Down50, Down75 };
+    friend std::ostream &operator<<(std::ostream &os, VideoScale scale);
+
+    // encoder params that can be changed while casting
+    struct EncoderParams {
+        int videoBitrate = 0;  // kbps, 0 means encoder default
+        std::optional<VideoScale> videoScale;  // unset means source default
+        int videoFramerate = 0;  // max fps, 0 means source framerate
+        int audioBitrate = 0;    // kbps, 0 means encoder default
+        inline bool operator==(const EncoderParams &rhs) const {
+            return videoBitrate == rhs.videoBitrate &&
+                   videoScale == rhs.videoScale &&
+                   videoFramerate == rhs.videoFramerate &&
+                   audioBitrate == rhs.audioBitrate;
+        }
+        inline bool operator!=(const EncoderParams &rhs) const {
+            return !(*this == rhs);
+        }
+        friend std::ostream &operator<<(std::ostream &os,
+                                        const EncoderParams &params);
+    };
+
     struct Config {
         StreamFormat streamFormat = StreamFormat::Mp4;
         std::string videoSource;
@@ -162,6 +249,33 @@ class Caster {
         std::string streamAuthor{"Caster"};
         std::string streamTitle{"Cast session"};
         VideoEncoder videoEncoder = VideoEncoder::Auto;
+        FragmentPolicy fragmentPolicy = FragmentPolicy::Frame;
+        int fragmentInterval = 100;  // ms, used with FragmentPolicy::Interval
+        int alsaPeriodSize = 240;    // frames, used with alsa sources
+        int v4l2QueueDepth = 4;      // 0 means v4l2 demuxer is used
+        int screenCaptureFramerate = 15;  // max, used with screen capture
+        EncoderParams encoderParams;
+        // picture-in-picture sources blended on top of video-source
+        std::vector<std::string> videoOverlaySources;
+        VideoOverlay::Position videoOverlayPosition =
+            VideoOverlay::Position::BottomRight;
+        int videoOverlaySize = 25;      // % of output width
+        int videoOverlayOpacity = 100;  // %
+        // pa mic or monitor sources mixed into pa audio-source
+        std::vector<std::string> audioMixSources;
+        // muxed stream is also recorded to files in this dir
+        std::string recordDir;
+        int recordMaxSize = 0;      // MB, 0 means no limit
+        int recordMaxDuration = 0;  // s, 0 means no limit
+        // window of muxed stream kept for playback from the past
+        int timeShiftDuration = 0;  // s, 0 means disabled
+        int timeShiftMaxSize = 64;  // MB, up to timeShiftMaxSizeLimit
+        // output of file sources is cached in this dir, so repeated
+        // streaming of the same files does not decode and encode again
+        std::string outputCacheDir;
+        int outputCacheMaxSize = 512;  // MB
+        TestSource::Props testSourceProps;
+        SynthAudioSource::Props synthAudioProps;  // signal is set by source
         std::optional<FileSourceConfig> fileSourceConfig;
         uint32_t options =
             OptionsFlags::AllVideoSources | OptionsFlags::AllAudioSources;
@@ -188,10 +302,20 @@ class Caster {
         uint32_t options = OptionsFlags::AllVideoSources);
     static std::vector<AudioSourceProps> audioSources(
         uint32_t options = OptionsFlags::AllAudioSources);
+    static bool alsaAudioSource(const std::string &name);
+    static bool pwAudioSource(const std::string &name);
 
     void start(bool startPaused = false);
     void pause();
     void resume();
+    // switches source without restarting encoder, empty name or name of
+    // configured source switches back to configured source
+    void switchVideoSource(const std::string &name);
+    void switchAudioSource(const std::string &name);
+    // params are applied by muxing thread before next video frame, so new
+    // GOP starts there, encoder is re-opened when it can't be updated
+    void reconfigureEncoders(const EncoderParams &params);
+    EncoderParams encoderParams() const;
     inline State state() const { return m_state; }
     inline auto terminating() const { return state() == State::Terminating; }
     inline auto terminationReason() const { return m_terminationReason; }
@@ -199,6 +323,19 @@ class Caster {
         return m_terminationReason == TerminationReason::Error;
     }
     inline const Config &config() const { return m_config; }
+    // sources in use with devices that can't be opened twice
+    std::vector<std::string> exclusiveSources() const;
+    inline bool hasVideoSource(const std::string &name) const {
+        return m_videoProps.count(name) != 0;
+    }
+    inline bool hasAudioSource(const std::string &name) const {
+        return m_audioProps.count(name) != 0;
+    }
+    std::vector<StartupPhaseTime> startupTimes() const;
+    // measured latency of audio capture in micro s, -1 when unknown
+    inline int64_t audioCaptureLatency() const {
+        return m_audioCaptureLatency;
+    }
     SensorDirection videoDirection() const;
     void setAudioVolume(int volume);
     inline void setStateChangedHandler(StateChangedHandler cb) {
@@ -208,6 +345,15 @@ class Caster {
     inline void setDataReadyCallback(DataReadyHandler cb) {
         m_dataReadyHandler = std::move(cb);
     }
+    // replaces data ready handler at next fragment boundary, new handler
+    // receives cached init segment first and then time-shifted data
+    void reattach(DataReadyHandler cb, std::chrono::seconds timeShift = {});
+    // cached output is sent from start of the entry, so it can't be joined
+    inline bool reattachable() const { return !m_outputCacheReplaying; }
+    // handlers are not called anymore and muxing is stopped, used when
+    // caster is waiting for destruction
+    void detach();
+    std::vector<uint8_t> initSegment() const;
     void addFile(std::string file);
 
    private:
@@ -218,11 +364,22 @@ class Caster {
         DroidCamRaw,
         X11Capture,
         LipstickCapture,
+        WlrCapture,
         Test
     };
     friend std::ostream &operator<<(std::ostream &os, VideoSourceType type);
 
-    enum class AudioSourceType { Unknown, Mic, Monitor, Playback, File };
+    enum class AudioSourceType {
+        Unknown,
+        Mic,
+        Monitor,
+        Playback,
+        File,
+        PwMic,
+        PwMonitor,
+        Alsa,
+        Synth
+    };
     friend std::ostream &operator<<(std::ostream &os, AudioSourceType type);
 
     enum class AudioEncoder { Aac, Mp3Lame };
@@ -253,9 +410,6 @@ class Caster {
     enum class AudioTrans { Off, Volume };
     friend std::ostream &operator<<(std::ostream &os, AudioTrans trans);
 
-    enum class VideoScale { Off, Down25, Down50, Down75 };
-    friend std::ostream &operator<<(std::ostream &os, VideoScale scale);
-
     struct FrameSpec {
         Dim dim;
         std::set<uint32_t, std::greater<uint32_t>> framerates;
@@ -288,6 +442,30 @@ class Caster {
     friend std::ostream &operator<<(std::ostream &os,
                                     const VideoSourceInternalProps &props);
 
+    // overlay and source that feeds it, source runs on its own thread
+    struct VideoOverlaySource {
+        VideoOverlay overlay;
+        std::optional<TestSource> testSource;
+        uint32_t framerate = 0;
+#ifdef USE_V4L2
+        std::optional<V4l2Source> v4l2Source;
+#endif
+#ifdef USE_WLR_CAPTURE
+        std::optional<WlrCaptureSource> wlrCapture;
+#endif
+        explicit VideoOverlaySource(const VideoOverlay::Props &props)
+            : overlay{props} {}
+        void start() {
+            if (testSource) testSource->start();
+#ifdef USE_V4L2
+            if (v4l2Source) v4l2Source->start();
+#endif
+#ifdef USE_WLR_CAPTURE
+            if (wlrCapture) wlrCapture->start();
+#endif
+        }
+    };
+
     struct V4l2H264EncoderProps {
         std::string dev;
         std::vector<VideoFormat> formats;
@@ -308,6 +486,18 @@ class Caster {
     friend std::ostream &operator<<(std::ostream &os,
                                     const AudioSourceInternalProps &props);
 
+    // pa stream mixed into audio-source, samples are converted by pa to
+    // audio-source format, so they can be added to it directly
+    struct AudioMixSource {
+        Caster *caster = nullptr;
+        std::string name;
+        pa_stream *stream = nullptr;
+        DataBuffer buf{m_audioBufSize, m_audioBufSize * 100};
+        bool dataReceived = false;
+        AudioMixSource(Caster *caster, std::string name)
+            : caster{caster}, name{std::move(name)} {}
+    };
+
     struct PaClient {
         uint32_t idx = PA_INVALID_INDEX;
         std::string name;
@@ -351,9 +541,39 @@ class Caster {
 
     static constexpr const unsigned int m_videoBufSize = 0x100000;
     static constexpr const unsigned int m_audioBufSize = 0x100000;
+    // muxed data is coalesced into blocks before it is passed to the
+    // data ready handler, block is passed when it is full, when fragment
+    // ends or when its oldest data exceeds max delay
+    static constexpr const size_t m_outBlockSize = 0x10000;
+    static constexpr const int64_t m_outMaxDelay = 20000;  // micro s
     static constexpr const uint64_t m_avMaxAnalyzeDuration =
         5000000;  // micro s
     static constexpr const int64_t m_avProbeSize = 5000;
+    // capture timestamps that differ more from the system clock are ignored
+    static constexpr const int64_t m_maxCaptureTimeSkew = 1000000;  // micro s
+    // new frame of switched video source is checked with this interval
+    static constexpr const int64_t m_videoSwitchPollTime = 5000;  // micro s
+    // clock drift is estimated after this time of continuous capture
+    static constexpr const int64_t m_audioDriftWarmup = 10000000;  // micro s
+    // max resampling correction applied to compensate audio clock drift
+    static constexpr const double m_maxAudioDrift = 0.005;
+    // gap between video overlays and frame edges, % of output width
+    static constexpr const uint32_t m_videoOverlayMargin = 2;
+    static constexpr const int64_t m_paTargetLatency = 10000;  // micro s
+    static constexpr const int64_t m_paMaxBufferedTime = 500000;  // micro s
+    // mix source data that is older is dropped to keep sources aligned
+    static constexpr const int64_t m_audioMixMaxDelay = 100000;  // micro s
+    static constexpr const int m_paMaxWait = 100000;  // micro s
+    // cached output is sent ahead of real time by that much
+    static constexpr const int64_t m_outputCacheReplayLead =
+        2000000;  // micro s
+    static constexpr const unsigned int m_outputCacheReplaySleep =
+        10000;  // micro s
+    static constexpr const size_t m_outputCacheReplayChunk = 0x10000;
+    static constexpr const pa_stream_flags_t m_paStreamFlags =
+        static_cast<pa_stream_flags_t>(PA_STREAM_ADJUST_LATENCY |
+                                       PA_STREAM_AUTO_TIMING_UPDATE |
+                                       PA_STREAM_INTERPOLATE_TIMING);
     static const int m_maxIters = 100;
 
     /* pix fmts supported by most players */
@@ -384,11 +604,13 @@ class Caster {
     AVBSFContext *m_videoBsfExtractExtraCtx = nullptr;
     AVBSFContext *m_videoBsfDumpExtraCtx = nullptr;
     AVAudioFifo *m_audioFifo = nullptr;
+    SwrContext *m_audioSwrCtx = nullptr;
     std::vector<uint8_t> m_pktSideData;
     std::unordered_map<VideoTrans, FilterCtx> m_videoFilterCtxMap;
     std::unordered_map<AudioTrans, FilterCtx> m_audioFilterCtxMap;
     AVFrame *m_audioFrameIn = nullptr;
     AVFrame *m_audioFrameAfterFilter = nullptr;
+    AVFrame *m_audioFrameAfterSwr = nullptr;
     AVFrame *m_videoFrameIn = nullptr;
     AVFrame *m_videoFrameAfterFilter = nullptr;
     pa_mainloop *m_paLoop = nullptr;
@@ -406,14 +628,52 @@ class Caster {
     int64_t m_audioTimeLastFrame = 0;       // micro s
     int64_t m_videoFrameDuration = 0;       // micro s
     int64_t m_videoRealFrameDuration = 0;   // micro s
+    int64_t m_videoCaptureTime = 0;         // micro s
+    int64_t m_videoFirstCaptureTime = 0;    // micro s
+    int64_t m_videoBufCaptureTime = 0;      // micro s
+    int64_t m_lastVideoPts = -1;
+    int64_t m_audioFirstCaptureTime = 0;    // micro s
+    uint64_t m_audioBytesCaptured = 0;
+    double m_audioDrift = 0.0;
+    int m_audioCompensation = 0;  // samples per second
     bool m_muxedFlushed = false;
     bool m_videoFlushed = false;
     bool m_audioFlushed = false;
+    bool m_fragmentPending = false;
+    int64_t m_lastFragmentTime = 0;  // micro s
     bool m_paDataReceived = false;
+    bool m_pwDataReceived = false;
+    bool m_alsaDataReceived = false;
+    bool m_synthAudioDataReceived = false;
+    std::atomic_bool m_videoDataReceived{false};
+    std::atomic_bool m_detached{false};
+    std::atomic<int64_t> m_audioCaptureLatency{-1};  // micro s
+    int64_t m_creationTime = av_gettime();  // micro s
+    mutable std::mutex m_startupTimesMtx;
+    std::vector<StartupPhaseTime> m_startupTimes;
+    mutable std::mutex m_dataReadyHandlerMtx;
+    std::optional<DataReadyHandler> m_pendingDataReadyHandler;
+    // marker of previous writeout, muxing thread only
+    std::pair<AVIODataMarkerType, int64_t> m_lastDataMarker{
+        AVIO_DATA_MARKER_UNKNOWN, AV_NOPTS_VALUE};
+    std::chrono::seconds m_pendingTimeShift{0};
+    std::optional<TimeShiftBuffer> m_timeShiftBuffer;
+    std::optional<OutputCache> m_outputCache;
+    bool m_outputCacheReplaying = false;
+    std::vector<uint8_t> m_initSegment;
+    std::vector<uint8_t> m_outBlock;
+    int64_t m_outBlockTime = 0;  // micro s
+    std::optional<Recorder> m_recorder;
+    std::atomic_bool m_forceVideoKeyframe{false};
     Dim m_inDim;
+    Dim m_videoFilterDim;  // output of scaling, before fitting to fixed dim
+    // dim of mp4 stream that can't be changed without new init segment
+    std::optional<Dim> m_videoFixedDim;
     VideoTrans m_videoTrans = VideoTrans::Off;
     AudioTrans m_audioTrans = AudioTrans::Off;
     AVPixelFormat m_inPixfmt = AV_PIX_FMT_NONE;
+    AVCodecID m_inVideoCodecId = AV_CODEC_ID_NONE;
+    bool m_videoPassthrough = false;  // compressed video is not re-encoded
     VideoPropsMap m_videoProps;
     AudioPropsMap m_audioProps;
     PaClientMap m_paClients;
@@ -422,12 +682,38 @@ class Caster {
     State m_state = State::Initing;
     TerminationReason m_terminationReason = TerminationReason::Unknown;
     std::optional<TestSource> m_imageProvider;
+    std::list<VideoOverlaySource> m_videoOverlays;
+    // source that replaces video-source in the pipeline after hot switch,
+    // capture of video-source is suspended meanwhile, muxing thread only
+    std::unique_ptr<VideoOverlaySource> m_videoSwitchSource;
+    bool m_videoCaptureSuspended = false;
+    mutable std::mutex m_videoSwitchMtx;
+    std::optional<std::string> m_pendingVideoSwitch;
+    std::string m_videoSwitchSourceName;
+    // guards video encoder ctx that is re-created by muxing thread
+    std::mutex m_videoEncoderMtx;
+    VideoEncoder m_videoEncoder = VideoEncoder::Auto;  // encoder in use
+    EncoderParams m_encoderParams;  // applied, used only in muxing thread
+    EncoderParams m_requestedEncoderParams;
+    mutable std::mutex m_encoderParamsMtx;
+    std::atomic_bool m_encoderParamsPending{false};
+    int64_t m_videoNextEncodeTime = 0;  // micro s
+    bool m_videoExtradataStale = false;
+    std::optional<SynthAudioSource> m_synthAudioSource;
+    std::list<AudioMixSource> m_audioMixSources;
+    std::vector<uint8_t> m_audioMixBuf;
+    std::optional<std::string> m_pendingAudioSource;
+    std::string m_activeAudioSource;  // used only in pa thread
     std::mutex m_filesMtx;
     std::queue<std::string> m_files;
     std::string m_currentFile;
     bool m_audioVolumeUpdated = false;
 #ifdef USE_V4L2
     std::vector<V4l2H264EncoderProps> m_v4l2Encoders;
+    std::optional<V4l2Source> m_v4l2Source;
+    AVFrame *m_v4l2Frame = nullptr;
+    int64_t m_v4l2FrameCaptureTime = 0;  // micro s
+    std::optional<MjpegDecoder> m_mjpegDecoder;
 #endif
 #ifdef USE_DROIDCAM
     std::optional<DroidCamSource> m_droidCamSource;
@@ -435,6 +721,15 @@ class Caster {
 #endif
 #ifdef USE_LIPSTICK_RECORDER
     std::optional<LipstickRecorderSource> m_lipstickRecorder;
+#endif
+#ifdef USE_WLR_CAPTURE
+    std::optional<WlrCaptureSource> m_wlrCapture;
+#endif
+#ifdef USE_PIPEWIRE
+    std::optional<PipeWireSource> m_pwSource;
+#endif
+#ifdef USE_ALSA
+    std::optional<AlsaSource> m_alsaSource;
 #endif
     static std::string strForAvError(int err);
     static std::string strForAvOpts(const AVDictionary *opts);
@@ -444,15 +739,27 @@ class Caster {
                                           int bufSize);
     static int avWritePacketCallbackStatic(void *opaque, uint8_t *buf,
                                            int bufSize);
+    static int avWriteDataTypeCallbackStatic(void *opaque, uint8_t *buf,
+                                             int bufSize,
+                                             AVIODataMarkerType type,
+                                             int64_t time);
     static void paStreamRequestCallbackStatic(pa_stream *stream, size_t nbytes,
                                               void *userdata);
+    static void paMixStreamRequestCallbackStatic(pa_stream *stream,
+                                                 size_t nbytes,
+                                                 void *userdata);
     static bool paClientShouldBeIgnored(const pa_client_info *info);
     static void paSourceInfoCallback(pa_context *ctx,
                                      const pa_source_info *info, int eol,
                                      void *userdata);
     int avReadPacketCallback(uint8_t *buf, int bufSize);
     int avWritePacketCallback(uint8_t *buf, int bufSize);
+    int avWriteDataTypeCallback(uint8_t *buf, int bufSize,
+                                AVIODataMarkerType type, int64_t time);
     void paStreamRequestCallback(pa_stream *stream, size_t nbytes);
+    void paMixStreamRequestCallback(AudioMixSource &source, pa_stream *stream,
+                                    size_t nbytes);
+    void updateAudioDrift(pa_stream *stream);
     static void paClientInfoCallback(pa_context *ctx,
                                      const pa_client_info *info, int eol,
                                      void *userdata);
@@ -467,6 +774,7 @@ class Caster {
     void doPaTask();
     void initAudioSource();
     void initVideoSource();
+    void initVideoCapture();
     void initFiles();
     void initAvAudioRawDecoderFromProps();
     void initAvAudioRawDecoderFromInputStream();
@@ -483,6 +791,7 @@ class Caster {
     void initAvVideoFilters();
     void initAvVideoFiltersFrame169(SensorDirection direction);
     void initAvVideoFiltersFrame169Vflip(SensorDirection direction);
+    bool videoFilterDimFixed() const;
     void initAvVideoFilter(SensorDirection direction, VideoTrans trans,
                            const std::string &fmt);
     void initAvVideoFilter(FilterCtx &ctx, const char *arg);
@@ -491,33 +800,84 @@ class Caster {
     void initAvVideoOutStreamFromInputFormat();
     void initAvVideoBsf();
     void initAvAudioFifo();
+    void initAvAudioDriftResampler();
+    void updateAudioDriftCompensation();
+    void writeAudioFifo(AVFrame *frame);
     void allocAvOutputFormat();
     void initAvOutputFormat();
     void reInitAvOutputFormat();
+    void reInitAvVideoEncoder(const EncoderParams &oldParams);
+    void reInitAvAudioEncoder();
+    void updateEncodersIfNeeded();
+    static bool encoderParamsValid(const EncoderParams &params);
+    int videoEncoderFramerate() const;
+    bool videoFrameDecimated();
     bool reInitAvAudioInput();
     void reInitAvAudioDecoder();
     void initVideoTrans();
     void initAudioTrans();
     void initAv();
+    void initAvAudio();
+    void initAvVideo();
     void initPa();
+    static pa_buffer_attr paBufferAttr(const pa_sample_spec &spec);
     void initAvAudioOutStreamFromEncoder();
     void findAvVideoInputStreamIdx();
     void findAvAudioInputStreamIdx();
     void startAudioSource();
     void startVideoSource();
+    void startVideoCapture();
+    void initVideoOverlays();
+    void initVideoOverlay(const VideoSourceInternalProps &props,
+                          uint32_t &offset);
+    void initVideoOverlaySource(VideoOverlaySource &source,
+                                const VideoSourceInternalProps &props,
+                                uint32_t width);
+    VideoOverlay::Props videoOverlayProps(const VideoSourceInternalProps &props,
+                                          uint32_t width) const;
+    static const VideoFormatExt &videoOverlayFormat(
+        const VideoSourceInternalProps &props);
+    static const FrameSpec &videoOverlayFrameSpec(const VideoFormatExt &format,
+                                                  uint32_t width);
+    void blendVideoOverlays(AVFrame *frame);
+    std::unique_ptr<VideoOverlaySource> makeVideoSwitchSource(
+        const std::string &name);
+    void switchVideoSourceIfNeeded();
+    void suspendVideoCapture();
+    void resumeVideoCapture();
+    bool videoOverlaySourceSupported(const std::string &name) const;
     void startAv();
     void startPa();
-    void connectPaSource();
+    void connectPaSource(const AudioSourceInternalProps &props);
+    void switchPaSourceIfNeeded();
+    void connectPaMixSources();
+    void disconnectPaMixSources();
+    void mixAudio(uint8_t *data, size_t size);
+    static void mixAudioSamples(AVCodecID codec, uint8_t *dst,
+                                const uint8_t *src, size_t size);
+    static bool audioMixCodecSupported(AVCodecID codec);
     void connectPaSinkInput();
     void disconnectPaSinkInput();
     void reconnectPaSinkInput();
     void startMuxing();
+    bool outputCacheSupported() const;
+    void initOutputCache();
+    void startOutputCacheReplay(OutputCache::Entry entry);
+    void replayOutputCache(const OutputCache::Entry &entry);
+    void commitOutputCache();
+    void discardOutputCache();
     void startVideoOnlyMuxing();
     void startAudioOnlyMuxing();
     void startVideoAudioMuxing();
     void startAudioSourceThread();
     bool muxVideo(AVPacket *pkt);
+    bool readVideoPktFromSource(AVPacket *pkt);
+    bool readVideoPktFromSwitchSource(AVPacket *pkt);
     bool muxAudio(AVPacket *pkt);
+    void writeFragment();
+    void markSyncPoint(const AVPacket *pkt, const AVStream *stream);
+    void flushOutBlock();
+    void updateFragment();
     void clean();
     void cleanAv();
     void cleanAvOutputFormat();
@@ -526,7 +886,9 @@ class Caster {
     void cleanAvAudioDecoder();
     void cleanAvAudioEncoder();
     void cleanAvAudioFifo();
+    void cleanAvAudioDriftResampler();
     void cleanAvVideoFilters();
+    void cleanAvVideoBsf();
     void cleanAvAudioFilters();
     void cleanPa();
     static void cleanAvOpts(AVDictionary **opts);
@@ -538,14 +900,22 @@ class Caster {
     void reportError();
     bool audioBoosted() const;
     void detectSources(uint32_t options);
-    static VideoPropsMap detectVideoSources(uint32_t options);
+    static VideoPropsMap detectVideoSources(
+        uint32_t options, const TestSource::Props &testSourceProps = {},
+        int screenCaptureFramerate = 0);
     static AudioPropsMap detectPaSources(uint32_t options);
     static AudioPropsMap detectAudioFileSources();
-    static AudioPropsMap detectAudioSources(uint32_t options);
+    static AudioPropsMap detectAudioSources(
+        uint32_t options, const SynthAudioSource::Props &synthAudioProps = {});
+    static AudioPropsMap detectSynthAudioSources(
+        const SynthAudioSource::Props &sprops);
+    void initSynthAudio();
+    void synthAudioDataReadyHandler(const uint8_t *data, size_t size);
     void initAvAudioDurations();
     bool readVideoFrameFromBuf(AVPacket *pkt);
     void readNullFrame(AVPacket *pkt);
     void readVideoFrameFromDemuxer(AVPacket *pkt);
+    static int64_t captureTimeFromPkt(const AVPacket *pkt, AVRational timeBase);
     bool readAudioFrame(AVPacket *pkt, DataSource source,
                         bool nullWhenNoEnoughData = false);
     bool readAudioFrameFromDemuxer(AVPacket *pkt);
@@ -553,6 +923,8 @@ class Caster {
     bool readAudioFrameFromBuf(AVPacket *pkt, bool nullWhenNoEnoughData);
     bool readAudioPktFromBuf(AVPacket *pkt, bool nullWhenNoEnoughData);
     bool encodeVideoFrame(AVPacket *pkt);
+    bool encodeVideoFrame(AVFrame *frameIn, AVPacket *pkt);
+    bool encodeFilteredVideoFrame(AVFrame *frameOut, AVPacket *pkt);
     bool encodeAudioFrame(AVPacket *pkt);
     void updateAudioVolumeFilter();
     bool filterVideoFrame(VideoTrans trans, AVFrame *frameIn,
@@ -587,8 +959,14 @@ class Caster {
     void unmutePaSinkInput(PaSinkInput &si);
     void unmuteAllPaSinkInputs();
     void setState(State newState, bool notify = true);
-    static VideoPropsMap detectTestVideoSources();
-    void rawVideoDataReadyHandler(const uint8_t *data, size_t size);
+    void addStartupTime(StartupPhase phase, int64_t startTime);
+    void addStartupTime(StartupPhase phase);
+    void markVideoDataReceived();
+    static VideoPropsMap detectTestVideoSources(
+        const TestSource::Props &iprops);
+    // capture time is in micro s, 0 when not known
+    void rawVideoDataReadyHandler(const uint8_t *data, size_t size,
+                                  int64_t captureTime = 0);
     void compressedVideoDataReadyHandler(const uint8_t *data, size_t size);
     static Dim computeTransDim(Dim dim, VideoTrans trans, VideoScale scale);
     static uint32_t hash(std::string_view str);
@@ -622,9 +1000,31 @@ class Caster {
                                                        uint32_t pixelformat);
     std::pair<std::reference_wrapper<const VideoFormatExt>, AVPixelFormat>
     bestVideoFormatForV4l2Encoder(const VideoSourceInternalProps &cam);
+    bool v4l2CaptureEnabled() const;
+    const VideoFormatExt *v4l2PassthroughFormat() const;
+    void initAvVideoForV4l2Passthrough(const VideoFormatExt &format);
+    static const VideoFormatExt *v4l2MjpegFormat(
+        const VideoSourceInternalProps &props, const VideoFormatExt &raw);
+    void initMjpegDecoder();
+    void initV4l2Capture();
+    void v4l2FrameReadyHandler(AVFrame *frame, int64_t captureTime);
+    bool readVideoFrameFromV4l2();
 #endif
 #ifdef USE_LIPSTICK_RECORDER
-    static VideoPropsMap detectLipstickRecorderVideoSources();
+    static VideoPropsMap detectLipstickRecorderVideoSources(int framerate);
+#endif
+#ifdef USE_WLR_CAPTURE
+    static VideoPropsMap detectWlrVideoSources(int framerate);
+#endif
+#ifdef USE_PIPEWIRE
+    static AudioPropsMap detectPwSources(uint32_t options);
+    void initPw();
+    void pwAudioDataReadyHandler(const uint8_t *data, size_t size);
+#endif
+#ifdef USE_ALSA
+    static AudioPropsMap detectAlsaSources();
+    void initAlsa();
+    void alsaAudioDataReadyHandler(const uint8_t *data, size_t size);
 #endif
 };
 
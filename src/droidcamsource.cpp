@@ -13,6 +13,8 @@
 #include <gst/gstinfo.h>
 #include <gst/gstsample.h>
 
+#include <chrono>
+
 #include "logger.hpp"
 
 DroidCamSource::DroidCamSource(bool compressed, int dev,
@@ -422,7 +424,8 @@ GstFlowReturn DroidCamSource::gstNewSampleCallback(GstElement *element) {
     if (m_terminating)
         ret = GST_FLOW_EOS;
     else if (m_dataReadyHandler)
-        m_dataReadyHandler(info.data, info.size);
+        m_dataReadyHandler(info.data, info.size,
+                           captureTime(sample, sample_buf));
 
     LOGT("gst sample written: ret=" << ret);
 
@@ -432,6 +435,29 @@ GstFlowReturn DroidCamSource::gstNewSampleCallback(GstElement *element) {
     return ret;
 }
 
+int64_t DroidCamSource::captureTime(GstSample *sample, GstBuffer *buf) const {
+    auto *segment = gst_sample_get_segment(sample);
+    if (segment == nullptr || !GST_BUFFER_PTS_IS_VALID(buf)) return 0;
+
+    // buffer pts is in running time of pipeline clock
+    auto runningTime = gst_segment_to_running_time(segment, GST_FORMAT_TIME,
+                                                   GST_BUFFER_PTS(buf));
+    if (!GST_CLOCK_TIME_IS_VALID(runningTime)) return 0;
+
+    auto *clock = gst_element_get_clock(m_gstPipe.pipeline);
+    if (clock == nullptr) return 0;
+
+    auto age = GST_CLOCK_DIFF(
+        gst_element_get_base_time(m_gstPipe.pipeline) + runningTime,
+        gst_clock_get_time(clock));
+    gst_object_unref(clock);
+
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+               .count() -
+           age / 1000;
+}
+
 [[maybe_unused]] GHashTable *DroidCamSource::getDroidCamDevTable() const {
     GHashTable *table = nullptr;
 
@@ -24,7 +24,9 @@ extern "C" {
 
 class DroidCamSource {
    public:
-    using DataReadyHandler = std::function<void(const uint8_t *, size_t)>;
+    // capture time is in micro s since epoch, 0 when not known
+    using DataReadyHandler =
+        std::function<void(const uint8_t *, size_t, int64_t)>;
     using ErrorHandler = std::function<void(void)>;
 
     struct Props {
@@ -65,6 +67,7 @@ class DroidCamSource {
     static GstFlowReturn gstNewSampleCallbackStatic(GstElement *element,
                                                     gpointer udata);
     GstFlowReturn gstNewSampleCallback(GstElement *element);
+    int64_t captureTime(GstSample *sample, GstBuffer *buf) const;
     GHashTable *getDroidCamDevTable() const;
     void doGstIteration();
     void init();
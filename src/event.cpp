@@ -27,6 +27,24 @@ std::ostream& operator<<(std::ostream& os, Event::Type event) {
         case Event::Type::CasterEnded:
             os << "caster-ended";
             break;
+        case Event::Type::CasterFirstData:
+            os << "caster-first-data";
+            break;
+        case Event::Type::CasterIdle:
+            os << "caster-idle";
+            break;
+        case Event::Type::CasterIdleTimeout:
+            os << "caster-idle-timeout";
+            break;
+        case Event::Type::ArmStandbyCaster:
+            os << "arm-standby-caster";
+            break;
+        case Event::Type::DisarmStandbyCaster:
+            os << "disarm-standby-caster";
+            break;
+        case Event::Type::CasterReaped:
+            os << "caster-reaped";
+            break;
     }
     return os;
 }
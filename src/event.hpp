@@ -21,7 +21,13 @@ enum class Type {
     StartCaster,
     StopCaster,
     CasterStarted,
-    CasterEnded
+    CasterEnded,
+    CasterFirstData,
+    CasterIdle,
+    CasterIdleTimeout,
+    ArmStandbyCaster,
+    DisarmStandbyCaster,
+    CasterReaped
 };
 
 struct Pack {
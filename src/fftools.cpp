@@ -39,8 +39,8 @@ static const struct fmt_map ff_fmt_conversion_table[] = {
     {AV_PIX_FMT_GRAY8, AV_CODEC_ID_RAWVIDEO, V4L2_PIX_FMT_GREY},
     {AV_PIX_FMT_GRAY16LE, AV_CODEC_ID_RAWVIDEO, V4L2_PIX_FMT_Y16},
     {AV_PIX_FMT_NV12, AV_CODEC_ID_RAWVIDEO, V4L2_PIX_FMT_NV12},
-    //    {AV_PIX_FMT_NONE, AV_CODEC_ID_MJPEG, V4L2_PIX_FMT_MJPEG},
-    //    {AV_PIX_FMT_NONE, AV_CODEC_ID_MJPEG, V4L2_PIX_FMT_JPEG},
+    {AV_PIX_FMT_NONE, AV_CODEC_ID_MJPEG, V4L2_PIX_FMT_MJPEG},
+    {AV_PIX_FMT_NONE, AV_CODEC_ID_MJPEG, V4L2_PIX_FMT_JPEG},
     {AV_PIX_FMT_NONE, AV_CODEC_ID_H264, V4L2_PIX_FMT_H264},
     //    {AV_PIX_FMT_NONE, AV_CODEC_ID_MPEG4, V4L2_PIX_FMT_MPEG4},
     //    {AV_PIX_FMT_NONE, AV_CODEC_ID_CPIA, V4L2_PIX_FMT_CPIA1},
@@ -75,6 +75,21 @@ AVCodecID ff_fmt_v4l2codec(uint32_t v4l2_fmt) {
 
     return AV_CODEC_ID_NONE;
 }
+
+uint32_t ff_fmt_ff2v4l(AVPixelFormat pix_fmt, AVCodecID codec_id) {
+    int i;
+
+    for (i = 0; ff_fmt_conversion_table[i].codec_id != AV_CODEC_ID_NONE; i++) {
+        if ((codec_id == AV_CODEC_ID_NONE ||
+             ff_fmt_conversion_table[i].codec_id == codec_id) &&
+            (pix_fmt == AV_PIX_FMT_NONE ||
+             ff_fmt_conversion_table[i].ff_fmt == pix_fmt)) {
+            return ff_fmt_conversion_table[i].v4l2_fmt;
+        }
+    }
+
+    return 0;
+}
 #endif  // USE_V4L2
 
 #ifdef USE_X11CAPTURE
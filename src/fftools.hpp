@@ -19,6 +19,7 @@ namespace ff_tools {
 #ifdef USE_V4L2
 AVPixelFormat ff_fmt_v4l2ff(uint32_t v4l2_fmt, AVCodecID codec_id);
 AVCodecID ff_fmt_v4l2codec(uint32_t v4l2_fmt);
+uint32_t ff_fmt_ff2v4l(AVPixelFormat pix_fmt, AVCodecID codec_id);
 #endif
 #ifdef USE_X11CAPTURE
 AVPixelFormat ff_fmt_x112ff(int bo, int depth, int bpp);
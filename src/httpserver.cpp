@@ -383,11 +383,9 @@ MHD_Result HttpServer::mhdConnectionHandler(
 
     std::vector<Header> responseHeaders;
 
-    if (auto code = server->m_connectionHandler(
-            ctx->get().id, url, requestHeaders, responseHeaders);
-        code >= 400) {
-        return rejectMhdConnection(connection, code);
-    }
+    auto code = server->m_connectionHandler(ctx->get().id, method, url,
+                                            requestHeaders, responseHeaders);
+    if (code >= 400) return rejectMhdConnection(connection, code);
 
     auto* resp = [&]() {
         if (ctx->get().buf.empty()) {
@@ -416,7 +414,8 @@ MHD_Result HttpServer::mhdConnectionHandler(
                       }
                   });
 
-    auto ret = MHD_queue_response(connection, MHD_HTTP_OK, resp);
+    auto ret = MHD_queue_response(
+        connection, code >= 200 && code < 300 ? code : MHD_HTTP_OK, resp);
     MHD_destroy_response(resp);
 
     return ret;
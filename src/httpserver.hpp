@@ -35,7 +35,7 @@ class HttpServer {
     using ConnectionId = unsigned int;
     using Header = std::pair<std::string, std::string>;
     using ConnectionHandler =
-        std::function<int(ConnectionId id, const char* url,
+        std::function<int(ConnectionId id, const char* method, const char* url,
                           const std::vector<Header>& requestHeaders,
                           std::vector<Header>& responseHeaders)>;
     using ConnectionRemovedHandler = std::function<void(ConnectionId id)>;
@@ -10,10 +10,19 @@
 #include <fmt/chrono.h>
 #include <fmt/format.h>
 #include <fmt/ranges.h>
+#include <strings.h>
 
 #include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <functional>
+#include <sstream>
+#include <utility>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+#include <libavutil/samplefmt.h>
+}
 
 #include "config.h"
 #include "logger.hpp"
@@ -38,6 +47,10 @@ Kamkast::Kamkast(Settings&& settings, [[maybe_unused]] int argc,
         m_loop.emplace(
             std::in_place_type_t<NoGuiEventLoop>{},
             [this](Event::Pack&& event) { handleEvent(std::move(event)); });
+
+    m_reaperThread = std::thread{[this] { doReaperTask(); }};
+    if (m_settings.sessionGracePeriod > 0)
+        m_idleTimerThread = std::thread{[this] { doIdleTimerTask(); }};
 }
 
 Kamkast::~Kamkast() {
@@ -48,6 +61,9 @@ Kamkast::~Kamkast() {
         LOGD(e.what());
     }
 
+    stopIdleTimer();
+    stopReaper();
+
     LOGD("kamkast shutdown completed");
 }
 
@@ -136,98 +152,274 @@ static bool audioOnlyFormat(Caster::StreamFormat format) {
     return false;
 }
 
-void Kamkast::startCaster(HttpServer::ConnectionId connId,
-                          Settings&& settings) {
-    try {
-        Caster::Config config;
-        config.streamAuthor = APP_NAME;
-        config.videoSource = settings.videoSourceName;
-        config.audioSource = settings.audioSourceName;
-        config.audioVolume = settings.audioVolume;
-        config.videoEncoder = [&]() {
-            if (settings.videoEncoder) {
-                switch (*settings.videoEncoder) {
-                    case Settings::VideoEncoder::Auto:
-                        return Caster::VideoEncoder::Auto;
-                    case Settings::VideoEncoder::Nvenc:
-                        return Caster::VideoEncoder::Nvenc;
-                    case Settings::VideoEncoder::V4l2:
-                        return Caster::VideoEncoder::V4l2;
-                    case Settings::VideoEncoder::X264:
-                        return Caster::VideoEncoder::X264;
-                }
+// comma separated list, main source is skipped because it can't be mixed
+// with itself
+static std::vector<std::string> additionalSourceNames(
+    const std::string& names, const std::string& mainSource) {
+    std::vector<std::string> list;
+    if (mainSource.empty()) return list;
+
+    std::istringstream is{names};
+    for (std::string name; std::getline(is, name, ',');) {
+        if (trim(name).empty() || name == mainSource) continue;
+        list.push_back(std::move(name));
+    }
+
+    return list;
+}
+
+// unset means default scale of video source
+static std::optional<Caster::VideoScale> casterVideoScale(
+    Settings::VideoScale scale) {
+    switch (scale) {
+        case Settings::VideoScale::Auto:
+            break;
+        case Settings::VideoScale::Off:
+            return Caster::VideoScale::Off;
+        case Settings::VideoScale::Down25:
+            return Caster::VideoScale::Down25;
+        case Settings::VideoScale::Down50:
+            return Caster::VideoScale::Down50;
+        case Settings::VideoScale::Down75:
+            return Caster::VideoScale::Down75;
+    }
+    return std::nullopt;
+}
+
+Caster::Config Kamkast::casterConfig(const Settings& settings) {
+    Caster::Config config;
+    config.streamAuthor = APP_NAME;
+    config.videoSource = settings.videoSourceName;
+    config.audioSource = settings.audioSourceName;
+    config.audioVolume = settings.audioVolume;
+    config.videoEncoder = [&]() {
+        if (settings.videoEncoder) {
+            switch (*settings.videoEncoder) {
+                case Settings::VideoEncoder::Auto:
+                    return Caster::VideoEncoder::Auto;
+                case Settings::VideoEncoder::Nvenc:
+                    return Caster::VideoEncoder::Nvenc;
+                case Settings::VideoEncoder::V4l2:
+                    return Caster::VideoEncoder::V4l2;
+                case Settings::VideoEncoder::X264:
+                    return Caster::VideoEncoder::X264;
             }
-            return Caster::VideoEncoder::Auto;
-        }();
-        config.streamFormat = [&]() {
-            if (settings.streamFormat) {
-                switch (*settings.streamFormat) {
-                    case Settings::StreamFormat::Mp4:
-                        return Caster::StreamFormat::Mp4;
-                    case Settings::StreamFormat::MpegTs:
-                        return Caster::StreamFormat::MpegTs;
-                    case Settings::StreamFormat::Mp3:
-                        return Caster::StreamFormat::Mp3;
-                }
+        }
+        return Caster::VideoEncoder::Auto;
+    }();
+    config.streamFormat = [&]() {
+        if (settings.streamFormat) {
+            switch (*settings.streamFormat) {
+                case Settings::StreamFormat::Mp4:
+                    return Caster::StreamFormat::Mp4;
+                case Settings::StreamFormat::MpegTs:
+                    return Caster::StreamFormat::MpegTs;
+                case Settings::StreamFormat::Mp3:
+                    return Caster::StreamFormat::Mp3;
             }
-            return Caster::StreamFormat::Mp4;
-        }();
-        config.videoOrientation = [&]() {
-            if (settings.videoOrientation) {
-                switch (*settings.videoOrientation) {
-                    case Settings::VideoOrientation::Auto:
-                        return Caster::VideoOrientation::Auto;
-                    case Settings::VideoOrientation::Landscape:
-                        return Caster::VideoOrientation::Landscape;
-                    case Settings::VideoOrientation::InvertedLandscape:
-                        return Caster::VideoOrientation::InvertedLandscape;
-                    case Settings::VideoOrientation::Portrait:
-                        return Caster::VideoOrientation::Portrait;
-                    case Settings::VideoOrientation::InvertedPortrait:
-                        return Caster::VideoOrientation::InvertedPortrait;
-                }
+        }
+        return Caster::StreamFormat::Mp4;
+    }();
+    config.videoOrientation = [&]() {
+        if (settings.videoOrientation) {
+            switch (*settings.videoOrientation) {
+                case Settings::VideoOrientation::Auto:
+                    return Caster::VideoOrientation::Auto;
+                case Settings::VideoOrientation::Landscape:
+                    return Caster::VideoOrientation::Landscape;
+                case Settings::VideoOrientation::InvertedLandscape:
+                    return Caster::VideoOrientation::InvertedLandscape;
+                case Settings::VideoOrientation::Portrait:
+                    return Caster::VideoOrientation::Portrait;
+                case Settings::VideoOrientation::InvertedPortrait:
+                    return Caster::VideoOrientation::InvertedPortrait;
             }
-            return Caster::VideoOrientation::Auto;
-        }();
-
-        if (settings.audioSourceMuted)
-            config.options |= Caster::OptionsFlags::MuteAudioSource;
-
-        if (audioOnlyFormat(config.streamFormat) &&
-            !config.videoSource.empty()) {
-            LOGW(
-                "stream-format does not support video, so disabling video "
-                "source");
-            config.videoSource.clear();
         }
+        return Caster::VideoOrientation::Auto;
+    }();
+    config.fragmentPolicy = [&]() {
+        if (settings.fragmentPolicy) {
+            switch (*settings.fragmentPolicy) {
+                case Settings::FragmentPolicy::Frame:
+                    return Caster::FragmentPolicy::Frame;
+                case Settings::FragmentPolicy::Interval:
+                    return Caster::FragmentPolicy::Interval;
+                case Settings::FragmentPolicy::Gop:
+                    return Caster::FragmentPolicy::Gop;
+            }
+        }
+        return Caster::FragmentPolicy::Frame;
+    }();
+    config.fragmentInterval = settings.fragmentInterval;
+    config.alsaPeriodSize = settings.alsaPeriodSize;
+    config.v4l2QueueDepth = settings.v4l2QueueDepth;
+    config.screenCaptureFramerate = settings.screenCaptureFramerate;
+    config.encoderParams.videoBitrate = settings.videoBitrate;
+    if (settings.videoScale)
+        config.encoderParams.videoScale =
+            casterVideoScale(*settings.videoScale);
+    config.encoderParams.videoFramerate = settings.videoFramerate;
+    config.encoderParams.audioBitrate = settings.audioBitrate;
+    config.videoOverlaySources =
+        additionalSourceNames(settings.videoOverlaySources, config.videoSource);
+    config.videoOverlayPosition = [&]() {
+        if (settings.videoOverlayPosition) {
+            switch (*settings.videoOverlayPosition) {
+                case Settings::VideoOverlayPosition::TopLeft:
+                    return VideoOverlay::Position::TopLeft;
+                case Settings::VideoOverlayPosition::TopRight:
+                    return VideoOverlay::Position::TopRight;
+                case Settings::VideoOverlayPosition::BottomLeft:
+                    return VideoOverlay::Position::BottomLeft;
+                case Settings::VideoOverlayPosition::BottomRight:
+                    return VideoOverlay::Position::BottomRight;
+            }
+        }
+        return VideoOverlay::Position::BottomRight;
+    }();
+    config.videoOverlaySize = settings.videoOverlaySize;
+    config.videoOverlayOpacity = settings.videoOverlayOpacity;
+    config.audioMixSources =
+        additionalSourceNames(settings.audioMixSources, config.audioSource);
+    config.recordDir = settings.recordDir;
+    config.recordMaxSize = settings.recordMaxSize;
+    config.recordMaxDuration = settings.recordMaxDuration;
+    config.timeShiftDuration = settings.timeShiftDuration;
+    config.timeShiftMaxSize = settings.timeShiftMaxSize;
+    config.testSourceProps.width = settings.testSourceWidth;
+    config.testSourceProps.height = settings.testSourceHeight;
+    config.testSourceProps.framerate = settings.testSourceFramerate;
+    config.testSourceProps.pixfmt =
+        av_get_pix_fmt(settings.testSourcePixfmt.c_str());
+    config.testSourceProps.pattern = [&]() {
+        if (settings.testSourcePattern) {
+            switch (*settings.testSourcePattern) {
+                case Settings::TestSourcePattern::Bars:
+                    return TestSource::Pattern::Bars;
+                case Settings::TestSourcePattern::Scroll:
+                    return TestSource::Pattern::Scroll;
+                case Settings::TestSourcePattern::Noise:
+                    return TestSource::Pattern::Noise;
+            }
+        }
+        return TestSource::Pattern::Bars;
+    }();
+    config.testSourceProps.motion = settings.testSourceMotion;
+    config.testSourceProps.entropy = settings.testSourceEntropy;
+    config.synthAudioProps.rate = settings.synthAudioRate;
+    config.synthAudioProps.channels = settings.synthAudioChannels;
+    config.synthAudioProps.sampleFmt =
+        av_get_sample_fmt(settings.synthAudioSampleFmt.c_str());
+    config.synthAudioProps.frequency = settings.synthAudioFrequency;
+
+    if (settings.audioSourceMuted)
+        config.options |= Caster::OptionsFlags::MuteAudioSource;
+    if (settings.v4l2Passthrough)
+        config.options |= Caster::OptionsFlags::V4l2Passthrough;
+    if (settings.v4l2Mjpeg) config.options |= Caster::OptionsFlags::V4l2Mjpeg;
+
+    if (audioOnlyFormat(config.streamFormat) && !config.videoSource.empty()) {
+        LOGW(
+            "stream-format does not support video, so disabling video "
+            "source");
+        config.videoSource.clear();
+    }
 
-        if (!config.videoSource.empty())
-            config.options |= Caster::OptionsFlags::V4l2VideoSources |
-                              Caster::OptionsFlags::DroidCamRawVideoSources |
-                              Caster::OptionsFlags::X11CaptureVideoSources |
-                              Caster::OptionsFlags::LipstickCaptureVideoSources;
-        if (!config.audioSource.empty())
-            config.options |= Caster::OptionsFlags::AllPaAudioSources;
-
-        m_caster.emplace(
-            config,
-            /* data ready handler */
-            [this, connId](const uint8_t* data, size_t size) {
-                auto pushedSize = m_server->pushData(connId, data, size);
-                if (pushedSize && *pushedSize != size) {
-                    throw std::runtime_error("failed to push data to server");
-                }
-                return size;
-            },
-            /* state changed handler */
-            [this, connId](Caster::State state) {
-                if (state == Caster::State::Started) {
-                    enqueueEvent({Event::Type::CasterStarted, connId, {}});
-                } else if (state == Caster::State::Terminating) {
-                    enqueueEvent({Event::Type::CasterEnded, connId, {}});
-                    enqueueEvent(Event::Type::StopCaster);
-                }
-            });
+    if (!config.videoSource.empty())
+        config.options |= Caster::OptionsFlags::V4l2VideoSources |
+                          Caster::OptionsFlags::DroidCamRawVideoSources |
+                          Caster::OptionsFlags::X11CaptureVideoSources |
+                          Caster::OptionsFlags::LipstickCaptureVideoSources |
+                          Caster::OptionsFlags::WlrCaptureVideoSources;
+    if (!config.audioSource.empty())
+        config.options |= Caster::OptionsFlags::AllPaAudioSources;
+    // pw and alsa detection is slow, so it is done only when needed
+    if (Caster::pwAudioSource(config.audioSource))
+        config.options |= Caster::OptionsFlags::AllPwAudioSources;
+    if (Caster::alsaAudioSource(config.audioSource))
+        config.options |= Caster::OptionsFlags::AlsaAudioSources;
+    if (settings.synthAudioSources)
+        config.options |= Caster::OptionsFlags::SynthAudioSources;
+
+    return config;
+}
+
+bool Kamkast::casterConfigsMatch(const Caster::Config& c1,
+                                 const Caster::Config& c2) {
+    return c1.streamFormat == c2.streamFormat &&
+           c1.videoSource == c2.videoSource &&
+           c1.audioSource == c2.audioSource &&
+           c1.videoOrientation == c2.videoOrientation &&
+           c1.audioVolume == c2.audioVolume &&
+           c1.videoEncoder == c2.videoEncoder &&
+           c1.fragmentPolicy == c2.fragmentPolicy &&
+           c1.fragmentInterval == c2.fragmentInterval &&
+           c1.alsaPeriodSize == c2.alsaPeriodSize &&
+           c1.v4l2QueueDepth == c2.v4l2QueueDepth &&
+           c1.screenCaptureFramerate == c2.screenCaptureFramerate &&
+           c1.encoderParams == c2.encoderParams &&
+           c1.videoOverlaySources == c2.videoOverlaySources &&
+           c1.videoOverlayPosition == c2.videoOverlayPosition &&
+           c1.videoOverlaySize == c2.videoOverlaySize &&
+           c1.videoOverlayOpacity == c2.videoOverlayOpacity &&
+           c1.audioMixSources == c2.audioMixSources &&
+           c1.recordDir == c2.recordDir &&
+           c1.recordMaxSize == c2.recordMaxSize &&
+           c1.recordMaxDuration == c2.recordMaxDuration &&
+           c1.timeShiftDuration == c2.timeShiftDuration &&
+           c1.timeShiftMaxSize == c2.timeShiftMaxSize &&
+           c1.options == c2.options;
+}
+
+Caster::DataReadyHandler Kamkast::casterDataReadyHandler(
+    HttpServer::ConnectionId connId, const Caster& caster) {
+    return [this, connId, &caster, first = true](const uint8_t* data,
+                                                 size_t size) mutable {
+        // data pushed before start is only a stream header
+        if (first && caster.state() == Caster::State::Started) {
+            first = false;
+            enqueueEvent({Event::Type::CasterFirstData, connId, {}});
+        }
+        auto pushedSize = m_server->pushData(connId, data, size);
+        if (pushedSize && *pushedSize != size) {
+            throw std::runtime_error("failed to push data to server");
+        }
+        return size;
+    };
+}
+
+Caster::StateChangedHandler Kamkast::casterStateChangedHandler(
+    HttpServer::ConnectionId connId) {
+    return [this, connId](Caster::State state) {
+        if (state == Caster::State::Started) {
+            enqueueEvent({Event::Type::CasterStarted, connId, {}});
+        } else if (state == Caster::State::Terminating) {
+            enqueueEvent({Event::Type::CasterEnded, connId, {}});
+            enqueueEvent({Event::Type::StopCaster, connId, {}});
+        }
+    };
+}
+
+void Kamkast::startCaster(HttpServer::ConnectionId connId,
+                          Settings&& settings) {
+    auto config = casterConfig(settings);
+
+    if (casterDevicesBusy(config)) {
+        // started again when reaper releases devices of old caster
+        LOGD("caster start deferred, devices are busy");
+        if (m_pendingCasterStart && m_pendingCasterStart->first != connId)
+            m_server->dropConnection(m_pendingCasterStart->first);
+        m_pendingCasterStart.emplace(connId, std::move(settings));
+        return;
+    }
+
+    try {
+        m_casterCreationTime = std::chrono::steady_clock::now();
+        m_caster = std::make_unique<Caster>(std::move(config),
+                                            Caster::DataReadyHandler{},
+                                            casterStateChangedHandler(connId));
+        m_caster->setDataReadyCallback(
+            casterDataReadyHandler(connId, *m_caster));
     } catch (const std::runtime_error& e) {
         LOGE("failed to init caster: " << e.what());
         m_server->dropConnection(connId);
@@ -242,7 +434,281 @@ void Kamkast::startCaster(HttpServer::ConnectionId connId,
         return;
     }
 
+    setCastingConnection(connId);
+}
+
+void Kamkast::armStandbyCaster() {
+    if (!m_settings.standby || !m_server || m_caster || m_pendingCasterStart)
+        return;
+
+    auto config = casterConfig(m_settings);
+
+    // armed again when reaper releases devices of old caster
+    if (casterDevicesBusy(config)) return;
+
+    LOGD("arming standby caster");
+
+    try {
+        // data is dropped until caster is promoted, muxer header is
+        // re-written on resume
+        m_casterCreationTime = std::chrono::steady_clock::now();
+        m_caster = std::make_unique<Caster>(
+            std::move(config), Caster::DataReadyHandler{},
+            [this](Caster::State state) {
+                if (state == Caster::State::Terminating)
+                    enqueueEvent(Event::Type::DisarmStandbyCaster);
+            });
+        m_casterStandby = true;
+        m_caster->start(/*startPaused=*/true);
+    } catch (const std::runtime_error& e) {
+        LOGW("failed to arm standby caster: " << e.what());
+        m_caster.reset();
+        m_casterStandby = false;
+        return;
+    }
+
+    if (m_caster->state() != Caster::State::Paused) {
+        LOGW("standby caster failed to start");
+        disarmStandbyCaster();
+        return;
+    }
+
+    LOGD("standby caster armed");
+}
+
+void Kamkast::disarmStandbyCaster() {
+    if (!m_caster || !m_casterStandby) return;
+
+    LOGD("disarming standby caster");
+
+    reapCaster();
+    m_casterStandby = false;
+}
+
+bool Kamkast::promoteStandbyCaster(HttpServer::ConnectionId connId,
+                                   const Settings& settings) {
+    if (!m_caster || !m_casterStandby) return false;
+
+    if (m_caster->state() != Caster::State::Paused ||
+        !casterConfigsMatch(m_caster->config(), casterConfig(settings))) {
+        LOGD("standby caster does not match request");
+        disarmStandbyCaster();
+        return false;
+    }
+
+    LOGD("promoting standby caster");
+
+    m_casterStandby = false;
+    m_caster->setDataReadyCallback(casterDataReadyHandler(connId, *m_caster));
+    m_caster->setStateChangedHandler(casterStateChangedHandler(connId));
+
+    try {
+        m_caster->resume();
+    } catch (const std::runtime_error& e) {
+        LOGE("failed to resume standby caster: " << e.what());
+        m_server->dropConnection(connId);
+        return true;
+    }
+
+    setCastingConnection(connId);
+
+    return true;
+}
+
+void Kamkast::setCasterIdle(HttpServer::ConnectionId connId) {
+    if (!m_caster || m_casterStandby || connId != m_castingConnId) return;
+
+    LOGD("caster is idle, grace period: " << m_settings.sessionGracePeriod
+                                          << "ms");
+
+    m_casterIdle = true;
+    startIdleTimer(connId);
+
+    notifyCastingEnded();
+}
+
+bool Kamkast::reattachCaster(HttpServer::ConnectionId connId,
+                             const Settings& settings) {
+    if (!m_caster || m_casterStandby ||
+        m_caster->state() != Caster::State::Started)
+        return false;
+
+    // new caster replays cached output from the start
+    if (!m_caster->reattachable()) {
+        LOGD("caster sends cached output, so it can't be reattached");
+        return false;
+    }
+
+    const auto timeShift = std::chrono::seconds{
+        m_caster->config().timeShiftDuration > 0 ? settings.timeShiftOffset
+                                                 : 0};
+
+    // request for playback from the past always takes over running caster
+    if (!m_casterIdle && timeShift.count() == 0) {
+        // renderers often open stream again right after first request,
+        // repeated request from the same client joins running caster
+        auto client = m_server->clientAddress(connId);
+        if (!client || client != m_castingClientAddress ||
+            std::chrono::steady_clock::now() - m_castingStartTime >
+                std::chrono::milliseconds{m_requestDedupWindow})
+            return false;
+    }
+
+    if (!casterConfigsMatch(m_caster->config(), casterConfig(settings))) {
+        LOGD("running caster does not match request");
+        return false;
+    }
+
+    if (m_casterIdle) {
+        LOGD("reattaching idle caster");
+        cancelIdleTimer();
+        m_casterIdle = false;
+    } else {
+        LOGD("reattaching caster to repeated request");
+    }
+
+    auto oldConnId = m_castingConnId;
+
+    m_caster->setStateChangedHandler(casterStateChangedHandler(connId));
+    m_caster->reattach(casterDataReadyHandler(connId, *m_caster), timeShift);
+
+    setCastingConnection(connId);
+
+    if (oldConnId && *oldConnId != connId)
+        m_server->dropConnection(*oldConnId);
+
+    enqueueEvent({Event::Type::CasterStarted, connId, {}});
+
+    return true;
+}
+
+void Kamkast::setCastingConnection(HttpServer::ConnectionId connId) {
     m_castingConnId = connId;
+    m_castingClientAddress = m_server->clientAddress(connId);
+    m_castingStartTime = std::chrono::steady_clock::now();
+    setCtrlCaster(m_caster.get());
+}
+
+void Kamkast::setCtrlCaster(Caster* caster) {
+    std::lock_guard lock{m_ctrlCasterMtx};
+    m_ctrlCaster = caster;
+}
+
+void Kamkast::updateProbeCache() {
+    if (!m_caster) return;
+
+    auto segment = m_caster->initSegment();
+
+    std::lock_guard lock{m_probeCacheMtx};
+
+    if (segment.empty()) {
+        m_probeCache.reset();
+        return;
+    }
+
+    LOGD("probe cache updated, init segment size=" << segment.size());
+
+    m_probeCache.emplace(ProbeCache{m_caster->config(), std::move(segment)});
+}
+
+void Kamkast::startIdleTimer(HttpServer::ConnectionId connId) {
+    {
+        std::lock_guard lock{m_idleTimerMtx};
+        auto gracePeriod =
+            std::chrono::milliseconds{m_settings.sessionGracePeriod};
+        m_idleTimerDeadline.emplace(
+            connId, std::chrono::steady_clock::now() + gracePeriod);
+    }
+
+    m_idleTimerCv.notify_all();
+}
+
+void Kamkast::cancelIdleTimer() {
+    {
+        std::lock_guard lock{m_idleTimerMtx};
+        m_idleTimerDeadline.reset();
+    }
+
+    m_idleTimerCv.notify_all();
+}
+
+void Kamkast::doIdleTimerTask() {
+    LOGD("idle timer started");
+
+    std::unique_lock lock{m_idleTimerMtx};
+
+    while (!m_idleTimerShutdown) {
+        if (!m_idleTimerDeadline) {
+            m_idleTimerCv.wait(lock);
+            continue;
+        }
+
+        auto deadline = *m_idleTimerDeadline;
+
+        m_idleTimerCv.wait_until(lock, deadline.second);
+
+        if (m_idleTimerShutdown || m_idleTimerDeadline != deadline ||
+            std::chrono::steady_clock::now() < deadline.second)
+            continue;
+
+        m_idleTimerDeadline.reset();
+
+        lock.unlock();
+        enqueueEvent({Event::Type::CasterIdleTimeout, deadline.first, {}});
+        lock.lock();
+    }
+
+    LOGD("idle timer ended");
+}
+
+void Kamkast::stopIdleTimer() {
+    {
+        std::lock_guard lock{m_idleTimerMtx};
+        m_idleTimerShutdown = true;
+    }
+
+    m_idleTimerCv.notify_all();
+
+    if (m_idleTimerThread.joinable()) m_idleTimerThread.join();
+}
+
+void Kamkast::updateStartupStats(HttpServer::ConnectionId connId) {
+    if (!m_caster || connId != m_castingConnId) return;
+
+    std::lock_guard lock{m_startupStatsMtx};
+
+    // caster creation time relative to stream request, negative when standby
+    // caster was promoted
+    int64_t casterOffset = 0;
+    if (m_streamRequestTime && m_streamRequestTime->first == connId) {
+        casterOffset = std::chrono::duration_cast<std::chrono::microseconds>(
+                           m_casterCreationTime - m_streamRequestTime->second)
+                           .count();
+    }
+
+    auto times = m_caster->startupTimes();
+
+    std::optional<int64_t> ttfb;
+
+    std::ostringstream os;
+    os << "{\"caster_offset_us\":" << casterOffset << ",\"phases\":[";
+    for (auto it = times.cbegin(); it != times.cend(); ++it) {
+        os << "{\"name\":\"" << it->phase << "\",\"start_us\":" << it->start
+           << ",\"duration_us\":" << it->duration << '}';
+        if (std::next(it) != times.cend()) os << ',';
+        if (it->phase == Caster::StartupPhase::FirstMuxedData)
+            ttfb = casterOffset + it->start;
+    }
+    os << ']';
+    if (ttfb) os << ",\"time_to_first_byte_us\":" << *ttfb;
+    if (auto latency = m_caster->audioCaptureLatency(); latency >= 0)
+        os << ",\"audio_capture_latency_us\":" << latency;
+    os << '}';
+
+    m_startupStats = os.str();
+
+    if (ttfb) LOGI("time to first byte: " << *ttfb / 1000 << "ms");
+    LOGD("startup stats: " << m_startupStats);
 }
 
 Kamkast::HttpRequestType Kamkast::determineRequestType(
@@ -271,11 +737,176 @@ Kamkast::HttpRequestType Kamkast::determineRequestType(
 }
 
 void Kamkast::stopCaster() {
-    if (m_caster) {
+    if (m_caster && !m_casterStandby) {
         if (m_castingConnId) m_server->dropConnection(*m_castingConnId);
-        m_caster.reset();
+        if (m_casterIdle) {
+            cancelIdleTimer();
+            m_casterIdle = false;
+        }
+        reapCaster();
         enqueueEvent(Event::Type::CasterEnded);
+        if (m_settings.standby) enqueueEvent(Event::Type::ArmStandbyCaster);
+    }
+}
+
+int Kamkast::switchCasterSources(const Settings& settings) {
+    // switching only validates request and sets flags for muxing thread
+    std::lock_guard lock{m_ctrlCasterMtx};
+
+    if (m_ctrlCaster == nullptr) {
+        LOGW("no active caster to switch sources");
+        return 409;
+    }
+
+    const auto& video = settings.videoSourceName;
+    const auto& audio = settings.audioSourceName;
+
+    if ((!video.empty() && !m_ctrlCaster->hasVideoSource(video)) ||
+        (!audio.empty() && !m_ctrlCaster->hasAudioSource(audio))) {
+        LOGW("switch request with unknown source");
+        return 404;
+    }
+
+    try {
+        if (!video.empty()) m_ctrlCaster->switchVideoSource(video);
+        if (!audio.empty()) m_ctrlCaster->switchAudioSource(audio);
+    } catch (const std::runtime_error& e) {
+        LOGW("failed to switch caster sources: " << e.what());
+        return 400;
+    }
+
+    return 200;
+}
+
+int Kamkast::reconfigureCaster(const Settings& settings) {
+    // reconfiguration only validates params and sets flags for muxing
+    // thread
+    std::lock_guard lock{m_ctrlCasterMtx};
+
+    if (m_ctrlCaster == nullptr) {
+        LOGW("no active caster to reconfigure");
+        return 409;
+    }
+
+    // negative value or unset scale keeps current param
+    auto params = m_ctrlCaster->encoderParams();
+    if (settings.videoBitrate >= 0) params.videoBitrate = settings.videoBitrate;
+    if (settings.videoScale)
+        params.videoScale = casterVideoScale(*settings.videoScale);
+    if (settings.videoFramerate >= 0)
+        params.videoFramerate = settings.videoFramerate;
+    if (settings.audioBitrate >= 0) params.audioBitrate = settings.audioBitrate;
+
+    try {
+        m_ctrlCaster->reconfigureEncoders(params);
+    } catch (const std::runtime_error& e) {
+        LOGW("failed to reconfigure caster: " << e.what());
+        return 400;
     }
+
+    return 200;
+}
+
+void Kamkast::reapCaster() {
+    if (!m_caster) return;
+
+    LOGD("handing caster over to reaper");
+
+    setCtrlCaster(nullptr);
+
+    // queued caster must not affect new session
+    m_caster->detach();
+
+    auto sources = m_caster->exclusiveSources();
+
+    std::lock_guard lock{m_reaperMtx};
+    m_reaperQueue.emplace_back(std::move(sources), std::move(m_caster));
+    m_reaperCv.notify_all();
+}
+
+bool Kamkast::casterDevicesBusy(const Caster::Config& config) {
+    std::vector<std::string> sources = config.videoOverlaySources;
+    sources.push_back(config.videoSource);
+    sources.push_back(config.audioSource);
+
+    // devices cannot be opened twice, so new caster has to wait until old
+    // caster using any of them is destroyed
+    std::lock_guard lock{m_reaperMtx};
+    return std::any_of(
+        m_reaperQueue.cbegin(), m_reaperQueue.cend(), [&](const auto& p) {
+            return std::any_of(
+                p.first.cbegin(), p.first.cend(), [&](const auto& name) {
+                    return std::find(sources.cbegin(), sources.cend(),
+                                     name) != sources.cend();
+                });
+        });
+}
+
+void Kamkast::startPendingCaster() {
+    if (!m_pendingCasterStart) {
+        armStandbyCaster();
+        return;
+    }
+
+    if (!m_server || casterDevicesBusy(casterConfig(
+                         m_pendingCasterStart->second))) {
+        if (!m_server) m_pendingCasterStart.reset();
+        return;
+    }
+
+    auto [connId, settings] = std::move(*m_pendingCasterStart);
+    m_pendingCasterStart.reset();
+
+    startCaster(connId, std::move(settings));
+}
+
+void Kamkast::waitForReaper() {
+    std::unique_lock lock{m_reaperMtx};
+    m_reaperCv.wait(lock, [this] { return m_reaperQueue.empty(); });
+}
+
+void Kamkast::doReaperTask() {
+    LOGD("reaper started");
+
+    std::unique_lock lock{m_reaperMtx};
+
+    while (true) {
+        m_reaperCv.wait(lock, [this] {
+            return m_reaperShutdown || !m_reaperQueue.empty();
+        });
+
+        if (m_reaperQueue.empty()) break;
+
+        // references to deque elements stay valid when new items are added
+        auto& caster = m_reaperQueue.front().second;
+
+        lock.unlock();
+        caster.reset();
+        lock.lock();
+
+        m_reaperQueue.pop_front();
+        m_reaperCv.notify_all();
+
+        LOGD("caster reaped");
+
+        // pending start or standby can use released devices now
+        lock.unlock();
+        enqueueEvent(Event::Type::CasterReaped);
+        lock.lock();
+    }
+
+    LOGD("reaper ended");
+}
+
+void Kamkast::stopReaper() {
+    {
+        std::lock_guard lock{m_reaperMtx};
+        m_reaperShutdown = true;
+    }
+
+    m_reaperCv.notify_all();
+
+    if (m_reaperThread.joinable()) m_reaperThread.join();
 }
 
 void Kamkast::updateSettingsFromUrlParams(HttpServer::ConnectionId id,
@@ -309,17 +940,79 @@ std::string Kamkast::contentType(Settings::StreamFormat format) {
     return {};
 }
 
+static std::optional<std::pair<size_t, size_t>> requestedByteRange(
+    const std::vector<HttpServer::Header>& headers) {
+    auto it = std::find_if(headers.cbegin(), headers.cend(), [](const auto& h) {
+        return strcasecmp(h.first.c_str(), "Range") == 0;
+    });
+    if (it == headers.cend()) return std::nullopt;
+
+    size_t first = 0;
+    size_t last = 0;
+    if (std::sscanf(it->second.c_str(), "bytes=%zu-%zu", &first, &last) != 2 ||
+        last < first)
+        return std::nullopt;
+
+    return std::pair{first, last};
+}
+
+std::optional<int> Kamkast::handleStreamProbeRequest(
+    const Settings& settings, HttpServer::ConnectionId id,
+    const std::vector<HttpServer::Header>& requestHeaders,
+    std::vector<HttpServer::Header>& responseHeaders) {
+    // only bounded range is considered as a probe, open range (bytes=0-) is
+    // a regular playback request
+    auto range = requestedByteRange(requestHeaders);
+    if (!range) return std::nullopt;
+
+    std::lock_guard lock{m_probeCacheMtx};
+
+    if (!m_probeCache || range->second >= m_probeCache->initSegment.size() ||
+        !casterConfigsMatch(m_probeCache->config, casterConfig(settings)))
+        return std::nullopt;
+
+    LOGD("range probe answered from cache: " << range->first << "-"
+                                             << range->second);
+
+    responseHeaders.emplace_back(
+        "Content-Range",
+        fmt::format("bytes {}-{}/*", range->first, range->second));
+
+    m_server->pushData(id, m_probeCache->initSegment.data() + range->first,
+                       range->second - range->first + 1);
+
+    return 206;
+}
+
 int Kamkast::handleStreamRequest(
-    Settings settings, HttpServer::ConnectionId id,
+    Settings settings, HttpServer::ConnectionId id, const char* method,
+    const std::vector<HttpServer::Header>& requestHeaders,
     std::vector<HttpServer::Header>& responseHeaders) {
     if (!settings.ignoreUrlParams) updateSettingsFromUrlParams(id, settings);
 
-    responseHeaders.reserve(2);
+    responseHeaders.reserve(3);
     responseHeaders.emplace_back("Content-Type",
                                  contentType(*settings.streamFormat));
+
+    if (std::string_view{method} == MHD_HTTP_METHOD_HEAD) {
+        LOGD("head request, so not starting caster");
+        responseHeaders.emplace_back("Accept-Ranges", "none");
+        return 200;
+    }
+
+    if (auto code = handleStreamProbeRequest(settings, id, requestHeaders,
+                                             responseHeaders))
+        return *code;
+
     responseHeaders.emplace_back("Accept-Ranges", "none");
 
-    enqueueEvent(Event::Type::StopCaster);
+    {
+        std::lock_guard lock{m_startupStatsMtx};
+        m_streamRequestTime.emplace(id, std::chrono::steady_clock::now());
+    }
+
+    // previous caster is stopped when start event is handled, unless it can
+    // be reused
     enqueueEvent({Event::Type::StartCaster, id, std::move(settings)});
 
     return 200;
@@ -328,20 +1021,115 @@ int Kamkast::handleStreamRequest(
 int Kamkast::handleCtrlRequest(
     HttpServer::ConnectionId id, const std::string& url,
     std::vector<HttpServer::Header>& responseHeaders) {
-    static const char infoStr[] = "/info";
-    if (url.rfind(infoStr, m_settings.urlPath.size() + sizeof(infoStr)) ==
-        std::string::npos) {
-        LOGW("unknown ctrl request");
-        return 404;
+    auto cmd = url.substr(m_settings.urlPath.size() +
+                          std::string_view{m_ctrlUrlPath}.size());
+
+    if (cmd == "/info") return handleCtrlInfoRequest(id, responseHeaders);
+    if (cmd == "/stats") return handleCtrlStatsRequest(id, responseHeaders);
+    if (cmd == "/switch") return handleCtrlSwitchRequest(id);
+    if (cmd == "/encoder") return handleCtrlEncoderRequest(id);
+
+    LOGW("unknown ctrl request");
+    return 404;
+}
+
+int Kamkast::handleCtrlSwitchRequest(HttpServer::ConnectionId id) {
+    // source that is not in the request is not changed
+    Settings settings = m_settings;
+    settings.videoSourceName =
+        trimmed(m_server->queryValue(id, Settings::videoSourceNameOpt)
+                    .value_or(std::string{}));
+    settings.audioSourceName =
+        trimmed(m_server->queryValue(id, Settings::audioSourceNameOpt)
+                    .value_or(std::string{}));
+
+    if (settings.videoSourceName.empty() && settings.audioSourceName.empty()) {
+        LOGW("switch request without sources");
+        return 400;
     }
 
+    return switchCasterSources(settings);
+}
+
+int Kamkast::handleCtrlEncoderRequest(HttpServer::ConnectionId id) {
+    // param that is not in the request is not changed
+    Settings settings = m_settings;
+    settings.videoBitrate = -1;
+    settings.videoScale.reset();
+    settings.videoFramerate = -1;
+    settings.audioBitrate = -1;
+
+    auto value = [&](const char* key) {
+        return trimmed(m_server->queryValue(id, key).value_or(std::string{}));
+    };
+
+    auto intValue = [&](const char* key, int& result) {
+        auto str = value(key);
+        if (str.empty()) return true;
+        try {
+            result = std::stoi(str);
+            return result >= 0;
+        } catch (const std::logic_error&) {
+            return false;
+        }
+    };
+
+    if (!intValue(Settings::videoBitrateOpt, settings.videoBitrate) ||
+        !intValue(Settings::videoFramerateOpt, settings.videoFramerate) ||
+        !intValue(Settings::audioBitrateOpt, settings.audioBitrate)) {
+        LOGW("encoder request with invalid value");
+        return 400;
+    }
+
+    if (auto scale = value(Settings::videoScaleOpt); !scale.empty()) {
+        settings.videoScale = Settings::videoScaleFromStr(scale);
+        if (!settings.videoScale) {
+            LOGW("encoder request with invalid video scale");
+            return 400;
+        }
+    }
+
+    if (settings.videoBitrate < 0 && !settings.videoScale &&
+        settings.videoFramerate < 0 && settings.audioBitrate < 0) {
+        LOGW("encoder request without params");
+        return 400;
+    }
+
+    return reconfigureCaster(settings);
+}
+
+int Kamkast::handleCtrlStatsRequest(
+    HttpServer::ConnectionId id,
+    std::vector<HttpServer::Header>& responseHeaders) {
+    std::string stats;
+
+    {
+        std::lock_guard lock{m_startupStatsMtx};
+        stats = m_startupStats.empty() ? "{}" : m_startupStats;
+    }
+
+    responseHeaders.emplace_back("Content-Type", "application/json");
+
+    m_server->pushData(id, stats);
+
+    return 200;
+}
+
+int Kamkast::handleCtrlInfoRequest(
+    HttpServer::ConnectionId id,
+    std::vector<HttpServer::Header>& responseHeaders) {
     auto videoSources =
         Caster::videoSources(Caster::OptionsFlags::V4l2VideoSources |
                              Caster::OptionsFlags::DroidCamRawVideoSources |
                              Caster::OptionsFlags::X11CaptureVideoSources |
-                             Caster::OptionsFlags::LipstickCaptureVideoSources);
-    auto audioSources =
-        Caster::audioSources(Caster::OptionsFlags::AllPaAudioSources);
+                             Caster::OptionsFlags::LipstickCaptureVideoSources |
+                             Caster::OptionsFlags::WlrCaptureVideoSources);
+    auto audioSourcesOptions = Caster::OptionsFlags::AllPaAudioSources |
+                               Caster::OptionsFlags::AllPwAudioSources |
+                               Caster::OptionsFlags::AlsaAudioSources;
+    if (m_settings.synthAudioSources)
+        audioSourcesOptions |= Caster::OptionsFlags::SynthAudioSources;
+    auto audioSources = Caster::audioSources(audioSourcesOptions);
 
     std::ostringstream os;
 
@@ -403,9 +1191,8 @@ void Kamkast::startServer() {
     m_server.emplace(
         config,
         /* new connection */
-        [&](HttpServer::ConnectionId id, const char* url,
-            [[maybe_unused]] const std::vector<HttpServer::Header>&
-                requestHeaders,
+        [&](HttpServer::ConnectionId id, const char* method, const char* url,
+            const std::vector<HttpServer::Header>& requestHeaders,
             std::vector<HttpServer::Header>& responseHeaders) {
             auto turl = trimmed(url, '/');
             switch (determineRequestType(turl)) {
@@ -420,7 +1207,8 @@ void Kamkast::startServer() {
                     return handleWebRequest(id, responseHeaders);
                 case HttpRequestType::Stream:
                     logConnection("stream request", id);
-                    return handleStreamRequest(m_settings, id, responseHeaders);
+                    return handleStreamRequest(m_settings, id, method,
+                                               requestHeaders, responseHeaders);
                 case HttpRequestType::Ctrl:
                     if (m_settings.disableCtrlApi) {
                         LOGD("ctrl api is disabled");
@@ -437,16 +1225,28 @@ void Kamkast::startServer() {
         },
         /* connection removed */
         [&](HttpServer::ConnectionId id) {
-            if (id == m_castingConnId && m_caster && !m_caster->terminating()) {
-                LOGD("connection was removed, so stopping caster");
-                enqueueEvent({Event::Type::StopCaster, id, {}});
+            if (id == m_castingConnId && m_caster && !m_casterStandby &&
+                !m_caster->terminating()) {
+                if (m_settings.sessionGracePeriod > 0) {
+                    LOGD("connection was removed, so caster is idle");
+                    enqueueEvent({Event::Type::CasterIdle, id, {}});
+                } else {
+                    LOGD("connection was removed, so stopping caster");
+                    enqueueEvent({Event::Type::StopCaster, id, {}});
+                }
             }
         });
 }
 
 void Kamkast::stopServer() {
-    m_server.reset();
+    m_pendingCasterStart.reset();
+    setCtrlCaster(nullptr);
     m_caster.reset();
+    // casters being destroyed can still push data to server
+    waitForReaper();
+    m_server.reset();
+    m_casterStandby = false;
+    m_casterIdle = false;
 }
 
 std::string Kamkast::videoSourcesTable() {
@@ -454,12 +1254,16 @@ std::string Kamkast::videoSourcesTable() {
         Caster::OptionsFlags::V4l2VideoSources |
         Caster::OptionsFlags::DroidCamRawVideoSources |
         Caster::OptionsFlags::X11CaptureVideoSources |
-        Caster::OptionsFlags::LipstickCaptureVideoSources));
+        Caster::OptionsFlags::LipstickCaptureVideoSources |
+        Caster::OptionsFlags::WlrCaptureVideoSources));
 }
 
 std::string Kamkast::audioSourcesTable() {
     return sourcesTable(
-        Caster::audioSources(Caster::OptionsFlags::AllPaAudioSources));
+        Caster::audioSources(Caster::OptionsFlags::AllPaAudioSources |
+                             Caster::OptionsFlags::AllPwAudioSources |
+                             Caster::OptionsFlags::AlsaAudioSources |
+                             Caster::OptionsFlags::SynthAudioSources));
 }
 
 std::pair<std::string, std::string> Kamkast::sourcesTable() {
@@ -502,12 +1306,20 @@ void Kamkast::handleEvent(Event::Pack&& event) {
         case Event::Type::StartServer:
             startServer();
             notifyServerStarted();
+            if (m_settings.standby) enqueueEvent(Event::Type::ArmStandbyCaster);
             break;
         case Event::Type::StartCaster:
+            if (reattachCaster(*event.connId, *event.settings)) break;
+            if (promoteStandbyCaster(*event.connId, *event.settings)) break;
             stopCaster();
             startCaster(*event.connId, std::move(*event.settings));
             break;
         case Event::Type::StopCaster:
+            // event of connection that is no longer casting
+            if (event.connId && m_castingConnId != *event.connId) {
+                LOGD("ignoring stop of stale connection: " << *event.connId);
+                break;
+            }
             stopCaster();
             break;
         case Event::Type::StopServer:
@@ -522,6 +1334,28 @@ void Kamkast::handleEvent(Event::Pack&& event) {
         case Event::Type::CasterEnded:
             notifyCastingEnded();
             break;
+        case Event::Type::CasterFirstData:
+            updateStartupStats(*event.connId);
+            updateProbeCache();
+            break;
+        case Event::Type::CasterIdle:
+            setCasterIdle(*event.connId);
+            break;
+        case Event::Type::CasterIdleTimeout:
+            if (m_casterIdle && event.connId == m_castingConnId) {
+                LOGD("grace period of idle caster expired");
+                stopCaster();
+            }
+            break;
+        case Event::Type::ArmStandbyCaster:
+            armStandbyCaster();
+            break;
+        case Event::Type::DisarmStandbyCaster:
+            disarmStandbyCaster();
+            break;
+        case Event::Type::CasterReaped:
+            startPendingCaster();
+            break;
         default:
             LOGW("unhandled event");
     }
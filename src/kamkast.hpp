@@ -10,12 +10,18 @@
 
 #include <fmt/format.h>
 
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <ostream>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <variant>
 
@@ -59,11 +65,50 @@ class Kamkast {
     static const constexpr char* m_streamUrlPath = "/stream";
     static const constexpr char* m_ctrlUrlPath = "/ctrl";
     static const constexpr uint32_t m_connectionLimit = 5;
+    static const constexpr int64_t m_requestDedupWindow = 3000;  // ms
+
+    struct ProbeCache {
+        Caster::Config config;
+        std::vector<uint8_t> initSegment;
+    };
 
     Settings m_settings;
     std::optional<LoopType> m_loop;
     std::optional<HttpServer::ConnectionId> m_castingConnId;
-    std::optional<Caster> m_caster;
+    std::optional<std::string> m_castingClientAddress;
+    std::chrono::steady_clock::time_point m_castingStartTime;
+    std::unique_ptr<Caster> m_caster;
+    bool m_casterStandby = false;
+    // casting caster used by ctrl requests on server thread, so they
+    // don't wait for event loop
+    Caster* m_ctrlCaster = nullptr;
+    std::mutex m_ctrlCasterMtx;
+    std::thread m_reaperThread;
+    std::mutex m_reaperMtx;
+    std::condition_variable m_reaperCv;
+    // casters waiting for destruction with their exclusive sources
+    std::deque<std::pair<std::vector<std::string>, std::unique_ptr<Caster>>>
+        m_reaperQueue;
+    // start request waiting until reaper releases its devices
+    std::optional<std::pair<HttpServer::ConnectionId, Settings>>
+        m_pendingCasterStart;
+    bool m_reaperShutdown = false;
+    bool m_casterIdle = false;
+    std::thread m_idleTimerThread;
+    std::mutex m_idleTimerMtx;
+    std::condition_variable m_idleTimerCv;
+    std::optional<std::pair<HttpServer::ConnectionId,
+                            std::chrono::steady_clock::time_point>>
+        m_idleTimerDeadline;
+    bool m_idleTimerShutdown = false;
+    std::chrono::steady_clock::time_point m_casterCreationTime;
+    std::mutex m_startupStatsMtx;
+    std::optional<std::pair<HttpServer::ConnectionId,
+                            std::chrono::steady_clock::time_point>>
+        m_streamRequestTime;
+    std::string m_startupStats;
+    std::mutex m_probeCacheMtx;
+    std::optional<ProbeCache> m_probeCache;
     std::optional<HttpServer> m_server;
     std::optional<std::ofstream> m_logFile;
 
@@ -100,18 +145,61 @@ class Kamkast {
     void notifyCastingEnded();
     void notifyServerStarted();
     void notifyServerEnded();
+    static Caster::Config casterConfig(const Settings& settings);
+    static bool casterConfigsMatch(const Caster::Config& c1,
+                                   const Caster::Config& c2);
+    Caster::DataReadyHandler casterDataReadyHandler(
+        HttpServer::ConnectionId connId, const Caster& caster);
+    Caster::StateChangedHandler casterStateChangedHandler(
+        HttpServer::ConnectionId connId);
     void startCaster(HttpServer::ConnectionId connId, Settings&& settings);
+    void armStandbyCaster();
+    void disarmStandbyCaster();
+    bool promoteStandbyCaster(HttpServer::ConnectionId connId,
+                              const Settings& settings);
+    void updateStartupStats(HttpServer::ConnectionId connId);
+    void updateProbeCache();
+    void setCastingConnection(HttpServer::ConnectionId connId);
+    void setCtrlCaster(Caster* caster);
+    void setCasterIdle(HttpServer::ConnectionId connId);
+    bool reattachCaster(HttpServer::ConnectionId connId,
+                        const Settings& settings);
+    void startIdleTimer(HttpServer::ConnectionId connId);
+    void cancelIdleTimer();
+    void doIdleTimerTask();
+    void stopIdleTimer();
     HttpRequestType determineRequestType(const std::string& url) const;
     void stopCaster();
+    int switchCasterSources(const Settings& settings);
+    int reconfigureCaster(const Settings& settings);
+    void reapCaster();
+    bool casterDevicesBusy(const Caster::Config& config);
+    void startPendingCaster();
+    void waitForReaper();
+    void doReaperTask();
+    void stopReaper();
     void updateSettingsFromUrlParams(HttpServer::ConnectionId id,
                                      Settings& settings);
     int handleWebRequest(HttpServer::ConnectionId id,
                          std::vector<HttpServer::Header>& responseHeaders);
     static std::string contentType(Settings::StreamFormat format);
-    int handleStreamRequest(Settings settings, HttpServer::ConnectionId id,
-                            std::vector<HttpServer::Header>& responseHeaders);
+    int handleStreamRequest(
+        Settings settings, HttpServer::ConnectionId id, const char* method,
+        const std::vector<HttpServer::Header>& requestHeaders,
+        std::vector<HttpServer::Header>& responseHeaders);
+    std::optional<int> handleStreamProbeRequest(
+        const Settings& settings, HttpServer::ConnectionId id,
+        const std::vector<HttpServer::Header>& requestHeaders,
+        std::vector<HttpServer::Header>& responseHeaders);
     int handleCtrlRequest(HttpServer::ConnectionId id, const std::string& url,
                           std::vector<HttpServer::Header>& responseHeaders);
+    int handleCtrlInfoRequest(HttpServer::ConnectionId id,
+                              std::vector<HttpServer::Header>& responseHeaders);
+    int handleCtrlStatsRequest(
+        HttpServer::ConnectionId id,
+        std::vector<HttpServer::Header>& responseHeaders);
+    int handleCtrlSwitchRequest(HttpServer::ConnectionId id);
+    int handleCtrlEncoderRequest(HttpServer::ConnectionId id);
     void startServer();
     void stopServer();
     Event::ServerProps makeServerProps() const;
@@ -13,6 +13,7 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <chrono>
 #include <cstdlib>
@@ -39,10 +40,12 @@ std::ostream &operator<<(std::ostream &os,
 }
 
 LipstickRecorderSource::LipstickRecorderSource(
-    DataReadyHandler dataReadyHandler, ErrorHandler errorHandler)
-    : m_dataReadyHandler{std::move(dataReadyHandler)}, m_errorHandler{std::move(
-                                                           errorHandler)} {
-    LOGD("creating lipstick-recorder");
+    uint32_t framerate, DataReadyHandler dataReadyHandler,
+    ErrorHandler errorHandler)
+    : m_dataReadyHandler{std::move(dataReadyHandler)},
+      m_errorHandler{std::move(errorHandler)},
+      m_frameDur{1000000 / std::max(framerate, 1u)} {
+    LOGD("creating lipstick-recorder: framerate=" << framerate);
 
     if (!checkCredentials())
         throw std::runtime_error("no permission to use lipstick-recorder");
@@ -203,13 +206,39 @@ LipstickRecorderSource::Props LipstickRecorderSource::properties() {
     return makeGlobals(nullptr).props;
 }
 
-void LipstickRecorderSource::repaintIfNeeded(std::chrono::microseconds maxDur) {
-    if (std::chrono::duration_cast<std::chrono::microseconds>(
-            std::chrono::steady_clock::now() - m_buf->tp) >= maxDur) {
-        LOGT("forcing repaint");
-        lipstick_recorder_repaint(m_globals.lrRec);
-        wl_display_flush(m_globals.display);
-    }
+void LipstickRecorderSource::deliverFrame(WlBufferWrapper *buf) {
+    LOGT("lr deliver frame: ts=" << buf->timestamp);
+
+    // re-sent frame is captured now
+    const auto captureTime = buf == m_lastBuf ? 0 : buf->captureTime;
+
+    m_yinverted = buf->yinverted;
+    m_lastBuf = buf;
+
+    if (m_dataReadyHandler)
+        m_dataReadyHandler(buf->data, buf->size, captureTime);
+}
+
+int64_t LipstickRecorderSource::captureTimeFromTimestamp(uint32_t timestamp) {
+    using namespace std::chrono;
+
+    // timestamp is wrapping 32-bit ms of compositor clock, which is either
+    // wall clock or monotonic clock, so age is checked against both
+    auto ageOf = [timestamp](auto now) {
+        return milliseconds{static_cast<uint32_t>(
+            static_cast<uint32_t>(
+                duration_cast<milliseconds>(now.time_since_epoch()).count()) -
+            timestamp)};
+    };
+
+    const auto now = system_clock::now();
+
+    auto age = ageOf(now);
+    if (age > m_maxTimestampAge) age = ageOf(steady_clock::now());
+    if (age > m_maxTimestampAge) return 0;
+
+    return duration_cast<microseconds>((now - age).time_since_epoch())
+        .count();
 }
 
 void LipstickRecorderSource::start() {
@@ -217,9 +246,11 @@ void LipstickRecorderSource::start() {
 
     LOGD("starting lipstick-recorder");
 
-    m_buf.emplace(m_globals.shm, m_globals.props.width, m_globals.props.height,
-                  m_globals.props.stride);
+    for (auto &buf : m_bufs)
+        buf.emplace(m_globals.shm, m_globals.props.width,
+                    m_globals.props.height, m_globals.props.stride);
 
+    // first frame is forced, so stream starts also when screen is static
     recordFrame();
     lipstick_recorder_repaint(m_globals.lrRec);
     wl_display_flush(m_globals.display);
@@ -227,21 +258,26 @@ void LipstickRecorderSource::start() {
     m_wlThread = std::thread([this] {
         LOGD("wl thread started");
 
-        const auto sleepDur = std::chrono::microseconds{
-            static_cast<int>(1000000.0 / m_globals.props.framerate)};
-        const auto repaintDur = sleepDur * 5;
+        // compositor sends frame only when screen has been repainted, first
+        // buffer has been already armed
+        WlFrameLoop loop{m_globals.display, m_frameDur,
+                         WlFrameLoop::Clock::now() + m_frameDur};
 
         while (!m_terminating) {
-            if (wl_display_roundtrip(m_globals.display) == -1) break;
-            LOGT("lr iteration");
-
-            if (m_dataReadyHandler) {
-                m_dataReadyHandler(m_buf->data, m_buf->size);
+            if (loop.requestDue(m_recordingBuf != nullptr)) recordFrame();
+
+            if (!loop.dispatchEvents(m_recordingBuf != nullptr,
+                                     m_lastBuf != nullptr))
+                break;
+
+            if (m_readyBuf != nullptr) {
+                deliverFrame(std::exchange(m_readyBuf, nullptr));
+                loop.frameDelivered();
+            } else if (m_lastBuf != nullptr && loop.keepAliveDue()) {
+                LOGT("lr keep alive");
+                deliverFrame(m_lastBuf);
+                loop.frameDelivered();
             }
-
-            repaintIfNeeded(repaintDur);
-
-            std::this_thread::sleep_for(sleepDur);
         }
 
         if (!m_terminating) {
@@ -299,22 +335,36 @@ LipstickRecorderSource::WlBufferWrapper::WlBufferWrapper(wl_shm *shm,
 }
 
 void LipstickRecorderSource::recordFrame() {
+    // buffer that was delivered last is never recorded to, because it may
+    // be re-sent as keep alive frame
+    auto *buf = &*m_bufs[m_nextBufIdx];
+    if (buf == m_lastBuf) {
+        m_nextBufIdx = (m_nextBufIdx + 1) % m_bufCount;
+        buf = &*m_bufs[m_nextBufIdx];
+    }
+    m_nextBufIdx = (m_nextBufIdx + 1) % m_bufCount;
+
     LOGT("lr record frame");
 
-    lipstick_recorder_record_frame(m_globals.lrRec, m_buf->buffer);
+    m_recordingBuf = buf;
+    lipstick_recorder_record_frame(m_globals.lrRec, buf->buffer);
 }
 
 void LipstickRecorderSource::wlLrFrameCallback(
-    [[maybe_unused]] void *data, [[maybe_unused]] lipstick_recorder *recorder,
-    wl_buffer *buffer, [[maybe_unused]] uint32_t timestamp, int transform) {
-    LOGT("lr frame: " << transform);
+    void *data, [[maybe_unused]] lipstick_recorder *recorder,
+    wl_buffer *buffer, uint32_t timestamp, int transform) {
+    LOGT("lr frame: ts=" << timestamp << ", transform=" << transform);
 
     auto *buf = static_cast<WlBufferWrapper *>(wl_buffer_get_user_data(buffer));
     buf->yinverted = transform == 2;
-    buf->tp = std::chrono::steady_clock::now();
+    buf->timestamp = timestamp;
+    buf->captureTime = captureTimeFromTimestamp(timestamp);
 
     auto *globals = static_cast<Globals *>(data);
-    if (globals->source) globals->source->recordFrame();
+    if (globals->source && globals->source->m_recordingBuf == buf) {
+        globals->source->m_recordingBuf = nullptr;
+        globals->source->m_readyBuf = buf;
+    }
 }
 
 void LipstickRecorderSource::wlLrFailedCallback(
@@ -324,8 +374,17 @@ void LipstickRecorderSource::wlLrFailedCallback(
 }
 
 void LipstickRecorderSource::wlLrCancelCallback(
-    [[maybe_unused]] void *data, [[maybe_unused]] lipstick_recorder *recorder,
-    [[maybe_unused]] wl_buffer *buffer) {}
+    void *data, [[maybe_unused]] lipstick_recorder *recorder,
+    wl_buffer *buffer) {
+    LOGT("lr cancel");
+
+    // buffer is free again, it will be re-armed in next iteration
+    auto *globals = static_cast<Globals *>(data);
+    if (globals->source &&
+        globals->source->m_recordingBuf ==
+            static_cast<WlBufferWrapper *>(wl_buffer_get_user_data(buffer)))
+        globals->source->m_recordingBuf = nullptr;
+}
 
 void LipstickRecorderSource::wlLrSetupCallback(
     void *data, [[maybe_unused]] lipstick_recorder *recorder, int width,
@@ -10,6 +10,9 @@
 
 #include <wayland-client.h>
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <optional>
@@ -22,10 +25,13 @@ extern "C" {
 }
 
 #include "wayland-lipstick-recorder-client-protocol.h"
+#include "wlframeloop.hpp"
 
 class LipstickRecorderSource {
    public:
-    using DataReadyHandler = std::function<void(const uint8_t *, size_t)>;
+    // capture time is in micro s since epoch, 0 when not known
+    using DataReadyHandler =
+        std::function<void(const uint8_t *, size_t, int64_t)>;
     using ErrorHandler = std::function<void(void)>;
 
     enum class Transform { Normal = 0, Rot90 = 1, Rot180 = 2, Rot270 = 3 };
@@ -35,20 +41,26 @@ class LipstickRecorderSource {
         uint32_t width = 0;
         uint32_t height = 0;
         uint32_t stride = 0;
-        uint32_t framerate = 5;
+        uint32_t framerate = 15;  // max, frames are delivered on change
         AVPixelFormat pixfmt = AV_PIX_FMT_NONE;
     };
 
-    explicit LipstickRecorderSource(DataReadyHandler dataReadyHandler,
-                                    ErrorHandler errorHandler);
+    LipstickRecorderSource(uint32_t framerate,
+                           DataReadyHandler dataReadyHandler,
+                           ErrorHandler errorHandler);
     ~LipstickRecorderSource();
     void start();
     static bool supported() noexcept;
     static Props properties();
     inline Transform transform() const { return m_transform; }
-    inline bool yinverted() const { return m_buf ? m_buf->yinverted : false; }
+    inline bool yinverted() const { return m_yinverted; }
 
    private:
+    // compositor records to one buffer while the other one is being read
+    static constexpr const size_t m_bufCount = 2;
+    // older frame timestamps are not trusted
+    static constexpr const std::chrono::milliseconds m_maxTimestampAge{1000};
+
     struct Globals {
         wl_display *display = nullptr;
         wl_registry *registry = nullptr;
@@ -69,8 +81,8 @@ class LipstickRecorderSource {
         uint8_t *data = nullptr;
         size_t size = 0;
         bool yinverted = false;
-        std::chrono::steady_clock::time_point tp =
-            std::chrono::steady_clock::now();
+        uint32_t timestamp = 0;    // ms, compositor clock
+        int64_t captureTime = 0;  // micro s since epoch
         explicit WlBufferWrapper(wl_shm *shm, uint32_t width, uint32_t height,
                                  uint32_t stride);
     };
@@ -78,17 +90,23 @@ class LipstickRecorderSource {
     DataReadyHandler m_dataReadyHandler;
     ErrorHandler m_errorHandler;
     Globals m_globals;
-    std::optional<WlBufferWrapper> m_buf;
+    std::chrono::microseconds m_frameDur;
+    std::array<std::optional<WlBufferWrapper>, m_bufCount> m_bufs;
+    size_t m_nextBufIdx = 0;
+    WlBufferWrapper *m_recordingBuf = nullptr;
+    WlBufferWrapper *m_readyBuf = nullptr;
+    WlBufferWrapper *m_lastBuf = nullptr;
     std::thread m_wlThread;
     Transform m_transform = Transform::Normal;
-    bool m_terminating = false;
+    std::atomic_bool m_yinverted{false};
+    std::atomic_bool m_terminating{false};
 
     void clean();
     void recordFrame();
+    void deliverFrame(WlBufferWrapper *buf);
+    static int64_t captureTimeFromTimestamp(uint32_t timestamp);
     static Globals makeGlobals(LipstickRecorderSource *wrapper);
     static bool checkCredentials();
-    void flipBufVertically();
-    void repaintIfNeeded(std::chrono::microseconds maxDur);
     static void wlRegister(Globals *globals);
     static void wlGlobalCallback(void *data, wl_registry *registry, uint32_t id,
                                  const char *interface, uint32_t version);
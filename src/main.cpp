@@ -26,7 +26,10 @@ static std::optional<Settings> processOpts(int argc, char** argv) {
                 "{}\n   "
                 "(params: {})\n",
                 options.help(), "http://[address]:[port]/[url-path]",
-                "http://[address]:[port]/[url-path]/ctrl/[cmd]", "info",
+                "http://[address]:[port]/[url-path]/ctrl/[cmd]",
+                "info, stats, switch?video-source=[name]&audio-source=[name], "
+                "encoder?video-bitrate=[kbps]&video-scale=[scale]&"
+                "video-framerate=[fps]&audio-bitrate=[kbps]",
                 "http://[address]:[port]/[url-path]/"
                 "stream?[param1]=[value1]&[paramN]=[valueN]",
                 fmt::join(Settings::urlOpts, ", "));
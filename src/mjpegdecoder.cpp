@@ -0,0 +1,170 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "mjpegdecoder.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "logger.hpp"
+
+MjpegDecoder::Job::Job() : pkt{av_packet_alloc()}, frame{av_frame_alloc()} {
+    if (pkt == nullptr || frame == nullptr)
+        throw std::runtime_error("mjpeg job alloc error");
+}
+
+MjpegDecoder::Job::~Job() {
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+}
+
+MjpegDecoder::MjpegDecoder(const AVCodecParameters *par,
+                           unsigned int threadCount) {
+    LOGD("creating mjpeg decoder: threads=" << threadCount);
+
+    const auto *decoder = avcodec_find_decoder(par->codec_id);
+    if (decoder == nullptr)
+        throw std::runtime_error("avcodec_find_decoder for mjpeg error");
+
+    try {
+        for (unsigned int i = 0; i < std::max(threadCount, 1u); ++i) {
+            auto *ctx = avcodec_alloc_context3(decoder);
+            if (ctx == nullptr)
+                throw std::runtime_error("avcodec_alloc_context3 for mjpeg");
+            m_ctxs.push_back(ctx);
+
+            if (avcodec_parameters_to_context(ctx, par) < 0)
+                throw std::runtime_error(
+                    "avcodec_parameters_to_context for mjpeg error");
+
+            // parallelism comes from decoding many frames at once
+            ctx->thread_count = 1;
+
+            if (avcodec_open2(ctx, nullptr, nullptr) != 0)
+                throw std::runtime_error("avcodec_open2 for mjpeg error");
+        }
+    } catch (...) {
+        clean();
+        throw;
+    }
+
+    for (auto *ctx : m_ctxs)
+        m_threads.emplace_back([this, ctx] { doDecode(ctx); });
+
+    LOGD("mjpeg decoder created");
+}
+
+MjpegDecoder::~MjpegDecoder() {
+    LOGD("mjpeg decoder termination started");
+    clean();
+    LOGD("mjpeg decoder termination completed");
+}
+
+void MjpegDecoder::clean() {
+    {
+        std::lock_guard lock{m_mtx};
+        m_termination = true;
+    }
+
+    m_queuedCv.notify_all();
+    m_doneCv.notify_all();
+
+    for (auto &thread : m_threads)
+        if (thread.joinable()) thread.join();
+    m_threads.clear();
+
+    for (auto *ctx : m_ctxs) avcodec_free_context(&ctx);
+    m_ctxs.clear();
+
+    m_jobs.clear();
+}
+
+unsigned int MjpegDecoder::defaultThreadCount() {
+    return std::clamp(std::thread::hardware_concurrency(), 1u, m_maxThreads);
+}
+
+MjpegDecoder::Job *MjpegDecoder::nextQueuedJob() {
+    auto it = std::find_if(m_jobs.begin(), m_jobs.end(), [](const auto &job) {
+        return job->state == Job::State::Queued;
+    });
+    return it == m_jobs.end() ? nullptr : it->get();
+}
+
+void MjpegDecoder::doDecode(AVCodecContext *ctx) {
+    LOGD("mjpeg decoder thread started");
+
+    std::unique_lock lock{m_mtx};
+
+    while (true) {
+        m_queuedCv.wait(
+            lock, [this] { return m_termination || nextQueuedJob(); });
+
+        if (m_termination) break;
+
+        auto *job = nextQueuedJob();
+        job->state = Job::State::Decoding;
+
+        lock.unlock();
+
+        auto ok = avcodec_send_packet(ctx, job->pkt) == 0 &&
+                  avcodec_receive_frame(ctx, job->frame) == 0;
+        av_packet_unref(job->pkt);
+
+        lock.lock();
+
+        job->state = ok ? Job::State::Done : Job::State::Failed;
+        if (!ok) LOGW("mjpeg frame decoding failed");
+
+        m_doneCv.notify_one();
+    }
+
+    LOGD("mjpeg decoder thread ended");
+}
+
+void MjpegDecoder::push(AVPacket *pkt, int64_t captureTime) {
+    {
+        std::lock_guard lock{m_mtx};
+
+        if (m_jobs.size() >= m_ctxs.size() * m_maxJobsPerThread) {
+            LOGW("mjpeg decoder is overloaded, dropping frame");
+            av_packet_unref(pkt);
+            return;
+        }
+
+        auto &job = m_jobs.emplace_back(std::make_unique<Job>());
+        av_packet_move_ref(job->pkt, pkt);
+        job->captureTime = captureTime;
+    }
+
+    m_queuedCv.notify_one();
+}
+
+bool MjpegDecoder::pull(AVFrame *frame, int64_t &captureTime) {
+    std::unique_lock lock{m_mtx};
+
+    while (true) {
+        while (!m_jobs.empty() &&
+               m_jobs.front()->state == Job::State::Failed)
+            m_jobs.pop_front();
+
+        if (m_jobs.empty() || m_termination) return false;
+
+        if (m_jobs.front()->state == Job::State::Done) break;
+
+        // pipeline is kept at most one frame per decoder deep
+        if (m_jobs.size() < m_ctxs.size()) return false;
+
+        m_doneCv.wait(lock);
+    }
+
+    av_frame_unref(frame);
+    av_frame_move_ref(frame, m_jobs.front()->frame);
+    captureTime = m_jobs.front()->captureTime;
+    m_jobs.pop_front();
+
+    return true;
+}
@@ -0,0 +1,62 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef MJPEGDECODER_HPP
+#define MJPEGDECODER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Every mjpeg packet is an independent image, so consecutive frames are
+// decoded in parallel on a pool of decoders and returned in capture order.
+class MjpegDecoder {
+   public:
+    MjpegDecoder(const AVCodecParameters *par, unsigned int threadCount);
+    ~MjpegDecoder();
+    // packet data is moved to the decoder
+    void push(AVPacket *pkt, int64_t captureTime);
+    // blocks only when all decoders are busy
+    bool pull(AVFrame *frame, int64_t &captureTime);
+    static unsigned int defaultThreadCount();
+
+   private:
+    static constexpr const unsigned int m_maxThreads = 4;
+    static constexpr const size_t m_maxJobsPerThread = 2;
+
+    struct Job {
+        enum class State { Queued, Decoding, Done, Failed };
+        AVPacket *pkt = nullptr;
+        AVFrame *frame = nullptr;
+        int64_t captureTime = 0;
+        State state = State::Queued;
+        Job();
+        ~Job();
+    };
+
+    std::vector<AVCodecContext *> m_ctxs;
+    std::vector<std::thread> m_threads;
+    std::deque<std::unique_ptr<Job>> m_jobs;
+    std::mutex m_mtx;
+    std::condition_variable m_queuedCv;
+    std::condition_variable m_doneCv;
+    bool m_termination = false;
+
+    void clean();
+    void doDecode(AVCodecContext *ctx);
+    Job *nextQueuedJob();
+};
+
+#endif  // MJPEGDECODER_HPP
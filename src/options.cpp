@@ -35,6 +35,10 @@ Options::Options(int argc, char** argv) : m_options{APP_NAME, APP_DESC} {
             cxxopts::value<int>()->default_value("0"))
         (DEFAULT_OPT(Settings::audioSourceMutedOpt), "Audio source is muted when streaming starts. This make sense only for playback capture.",
             cxxopts::value<bool>()->default_value("false"))
+        (DEFAULT_OPT(Settings::fragmentPolicyOpt), "Set the default policy of cutting mp4 fragments and flushing mpegts output. Supported policies: frame (after every frame, lowest latency), interval (every --default-fragment-interval milliseconds), gop (before every video key frame).",
+            cxxopts::value<std::string>()->default_value("frame"))
+        (DEFAULT_OPT(Settings::fragmentIntervalOpt), "Set the default fragment duration in milliseconds used by 'interval' fragment policy. Valid values are in a range from 10 to 10000.",
+            cxxopts::value<int>()->default_value("100"))
         (Settings::ignoreUrlParamsOpt, "URL parameters in a request are ignored. Only default options are used.",
             cxxopts::value<bool>()->default_value("false"))
         ("list-sources", "Show all video and audio sources detected.")
@@ -48,6 +52,72 @@ Options::Options(int argc, char** argv) : m_options{APP_NAME, APP_DESC} {
             cxxopts::value<bool>()->default_value("false"))
         (Settings::logFileOpt, "File where details of every received request are logged.",
             cxxopts::value<std::string>()->default_value(""))
+        (Settings::standbyOpt, "Keep a paused stream with default sources ready all the time, so casting starts almost immediately after the first request. Video and audio devices stay open even when nobody is watching.",
+            cxxopts::value<bool>()->default_value("false"))
+        (Settings::sessionGracePeriodOpt, "Time in milliseconds for which streaming session is kept alive after client disconnects. Client that reconnects within this time with the same parameters joins running session instead of starting a new one. Value 0 means that session ends immediately.",
+            cxxopts::value<int>()->default_value("0"))
+        (Settings::alsaPeriodSizeOpt, "Period size in frames used by ALSA audio sources. Smaller period means lower latency but more wakeups. Valid values are in a range from 32 to 8192.",
+            cxxopts::value<int>()->default_value("240"))
+        (Settings::v4l2QueueDepthOpt, "Number of mmap buffers queued in V4L2 camera driver. Frames are passed to the encoder without copying. Value 0 means that FFmpeg v4l2 demuxer is used instead. Valid values are in a range from 0 to 32.",
+            cxxopts::value<int>()->default_value("4"))
+        (Settings::screenCaptureFramerateOpt, "Maximum frame rate of screen capture. Frames are captured only when screen content changes, so static screen does not use CPU. Valid values are in a range from 1 to 60.",
+            cxxopts::value<int>()->default_value("15"))
+        (Settings::videoOverlaySourcesOpt, "Comma separated list of video sources shown as picture-in-picture on top of main video source. Every overlay source is captured with its own frame rate and blended into the main video before encoding. Supported are V4L2 cameras with raw formats, wlroots screen capture and test sources.",
+            cxxopts::value<std::string>()->default_value(""))
+        (Settings::videoOverlayPositionOpt, "Corner of the video where overlays are placed. Several overlays are stacked vertically. Supported positions: top-left, top-right, bottom-left, bottom-right.",
+            cxxopts::value<std::string>()->default_value("bottom-right"))
+        (Settings::videoOverlaySizeOpt, "Width of video overlay in percent of video width. Overlay height keeps aspect ratio of the overlay source. Valid values are in a range from 5 to 50.",
+            cxxopts::value<int>()->default_value("25"))
+        (Settings::videoOverlayOpacityOpt, "Opacity of video overlay in percent. Valid values are in a range from 1 to 100.",
+            cxxopts::value<int>()->default_value("100"))
+        (Settings::audioMixSourcesOpt, "Comma separated list of PulseAudio microphone or monitor sources mixed into main audio source (e.g. microphone commentary over application playback). Every source is captured with its own stream and converted by PulseAudio to the format of main audio source. Main audio source has to be a PulseAudio source.",
+            cxxopts::value<std::string>()->default_value(""))
+        (Settings::videoBitrateOpt, "Target bitrate of video encoder in kbps. Value 0 means that encoder default rate control is used. Valid values are 0 or a range from 100 to 100000. Can be changed on running stream with ctrl API.",
+            cxxopts::value<int>()->default_value("0"))
+        (Settings::videoScaleOpt, "Downscaling of video before encoding. Value auto means that default of video source is used. Supported values: auto, off, down-25, down-50, down-75. Can be changed on running stream with ctrl API.",
+            cxxopts::value<std::string>()->default_value("auto"))
+        (Settings::videoFramerateOpt, "Maximum frame rate of encoded video. Frames above this rate are dropped before encoding. Value 0 means that frame rate of video source is used. Valid values are in a range from 0 to 120. Can be changed on running stream with ctrl API.",
+            cxxopts::value<int>()->default_value("0"))
+        (Settings::audioBitrateOpt, "Target bitrate of audio encoder in kbps. Value 0 means that encoder default is used. Valid values are 0 or a range from 32 to 320. Can be changed on running stream with ctrl API.",
+            cxxopts::value<int>()->default_value("0"))
+        (Settings::recordDirOpt, "Directory where every stream is also recorded to files. Stream is saved as it is sent to the client, without re-encoding. Files are written in background, so slow storage does not delay the stream. Directory must be writable. When empty, stream is not recorded.",
+            cxxopts::value<std::string>()->default_value(""))
+        (Settings::recordMaxSizeOpt, "Size in MB after which new recording file is started. Value 0 means that size is not limited.",
+            cxxopts::value<int>()->default_value("0"))
+        (Settings::recordMaxDurationOpt, "Duration in seconds after which new recording file is started. Value 0 means that duration is not limited.",
+            cxxopts::value<int>()->default_value("0"))
+        (Settings::timeShiftDurationOpt, "Duration in seconds of time-shift window. Stream is kept in memory for that time, so client can start playback from the past by adding 'offset' param to stream URL (e.g. offset=-120s). Value 0 means that time-shift is disabled. Valid values are in a range from 0 to 3600.",
+            cxxopts::value<int>()->default_value("0"))
+        (Settings::timeShiftMaxSizeOpt, "Maximum size in MB of time-shift window. When reached, the oldest part of the window is dropped. Valid values are in a range from 1 to 128.",
+            cxxopts::value<int>()->default_value("64"))
+        (Settings::v4l2PassthroughOpt, "H.264 stream from V4L2 camera that supports it is sent without re-encoding. This uses almost no CPU. Video is encoded anyway when video-scale, video-orientation transform or video-overlay-sources are set. Switching of video source and reconfiguration of video encoder are not possible with pass-through stream.",
+            cxxopts::value<bool>()->default_value("false"))
+        (Settings::v4l2MjpegOpt, "MJPEG format is preferred when V4L2 camera delivers higher resolution or frame rate with it than with raw formats. Frames are decoded in parallel on several CPU cores.",
+            cxxopts::value<bool>()->default_value("true"))
+        (Settings::testSourceWidthOpt, "Frame width of synthetic test video source. Value has to be a multiple of 64. Test sources are available only in debug build.",
+            cxxopts::value<int>()->default_value("1280"))
+        (Settings::testSourceHeightOpt, "Frame height of synthetic test video source. Value has to be even.",
+            cxxopts::value<int>()->default_value("720"))
+        (Settings::testSourceFramerateOpt, "Frame rate of synthetic test video source. Valid values are in a range from 1 to 120.",
+            cxxopts::value<int>()->default_value("30"))
+        (Settings::testSourcePixfmtOpt, "Pixel format of synthetic test video source. Supported formats: 0rgb, bgr0, yuv420p, nv12.",
+            cxxopts::value<std::string>()->default_value("yuv420p"))
+        (Settings::testSourcePatternOpt, "Pattern generated by synthetic test video source. Supported patterns: bars (color bars with moving vertical bar), scroll (scrolling frame counter), noise (random data in every frame).",
+            cxxopts::value<std::string>()->default_value("bars"))
+        (Settings::testSourceMotionOpt, "Number of pixels by which moving elements of test video pattern shift in every frame. Value 0 means static image.",
+            cxxopts::value<int>()->default_value("4"))
+        (Settings::testSourceEntropyOpt, "Percent of test video frame rows overwritten with random data in every frame. More entropy means more work for video encoder. Valid values are in a range from 0 to 100.",
+            cxxopts::value<int>()->default_value("0"))
+        (Settings::synthAudioSourcesOpt, "Enable synthetic audio sources: synth-sine, synth-chirp (frequency sweep), synth-noise and synth-click (short beep at the beginning of every second, useful for A/V sync checks). These sources do not need any audio server.",
+            cxxopts::value<bool>()->default_value("false"))
+        (Settings::synthAudioRateOpt, "Sample rate of synthetic audio sources. Value has to be a multiple of 100 in a range from 8000 to 192000.",
+            cxxopts::value<int>()->default_value("48000"))
+        (Settings::synthAudioChannelsOpt, "Number of channels of synthetic audio sources. Valid values are in a range from 1 to 8.",
+            cxxopts::value<int>()->default_value("2"))
+        (Settings::synthAudioSampleFmtOpt, "Sample format of synthetic audio sources. Supported formats: s16, s32, flt.",
+            cxxopts::value<std::string>()->default_value("s16"))
+        (Settings::synthAudioFrequencyOpt, "Frequency in Hz of synth-sine and synth-click tone.",
+            cxxopts::value<int>()->default_value("1000"))
         (Settings::videoEncoderOpt, "Force specific video encoder. Supported values: auto, nvenc, v4l2, x264",
             cxxopts::value<std::string>()->default_value("auto"))
         ("g,"s + Settings::guiOpt, "Start native graphical UI. GUI is not supported on every platform.",
@@ -0,0 +1,311 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "outputcache.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <utility>
+
+extern "C" {
+#include <libavutil/mem.h>
+#include <libavutil/sha.h>
+}
+
+#include "logger.hpp"
+
+// entry header: magic followed by duration in micro s, entry trailer: end
+// time of every file in micro s followed by number of files
+static constexpr const std::array<char, 8> entryMagic = {'K', 'K', 'C', 'A',
+                                                         'C', 'H', 'E', '2'};
+static constexpr const size_t entryHeaderSize =
+    entryMagic.size() + sizeof(int64_t);
+
+std::ostream &operator<<(std::ostream &os, const OutputCache::Props &props) {
+    os << "dir=" << props.dir << ", max-size=" << props.maxSize;
+    return os;
+}
+
+OutputCache::OutputCache(Props props, std::string key)
+    : m_props{std::move(props)}, m_key{std::move(key)} {
+    LOGD("creating output cache: " << m_props << ", key=" << m_key);
+}
+
+OutputCache::~OutputCache() { discard(); }
+
+std::optional<std::string> OutputCache::makeKey(
+    const std::vector<std::string> &files, const std::string &params) {
+    std::ostringstream os;
+
+    os << "v1|" << params;
+
+    for (const auto &file : files) {
+        struct stat st {};
+        if (stat(file.c_str(), &st) != 0) {
+            LOGW("failed to stat file: " << file);
+            return std::nullopt;
+        }
+        os << "|" << file << ":" << st.st_size << ":" << st.st_mtim.tv_sec
+           << "." << st.st_mtim.tv_nsec;
+    }
+
+    auto data = os.str();
+
+    std::unique_ptr<AVSHA, decltype(&av_free)> sha{av_sha_alloc(), &av_free};
+    if (!sha || av_sha_init(sha.get(), 256) != 0) {
+        LOGW("failed to init sha");
+        return std::nullopt;
+    }
+
+    av_sha_update(sha.get(), reinterpret_cast<const uint8_t *>(data.data()),
+                  data.size());
+
+    std::array<uint8_t, 32> digest{};
+    av_sha_final(sha.get(), digest.data());
+
+    std::ostringstream key;
+    key << std::hex << std::setfill('0');
+    for (auto byte : digest) key << std::setw(2) << static_cast<int>(byte);
+
+    return key.str();
+}
+
+std::string OutputCache::entryPath() const {
+    return m_props.dir + '/' + m_key + m_entryExt;
+}
+
+std::optional<OutputCache::Entry> OutputCache::find() const {
+    auto path = entryPath();
+
+    auto *file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) return std::nullopt;
+
+    std::array<char, entryMagic.size()> magic{};
+    int64_t duration = 0;
+    auto ok = std::fread(magic.data(), 1, magic.size(), file) == magic.size() &&
+              magic == entryMagic &&
+              std::fread(&duration, sizeof duration, 1, file) == 1;
+
+    struct stat st {};
+    ok = ok && fstat(fileno(file), &st) == 0;
+
+    int64_t fileCount = 0;
+    ok = ok && std::fseek(file, -static_cast<long>(sizeof fileCount),
+                          SEEK_END) == 0 &&
+         std::fread(&fileCount, sizeof fileCount, 1, file) == 1;
+
+    const auto trailerSize =
+        static_cast<size_t>(std::max<int64_t>(fileCount + 1, 0)) *
+        sizeof(int64_t);
+    ok = ok && fileCount >= 0 &&
+         static_cast<size_t>(st.st_size) > entryHeaderSize + trailerSize;
+
+    std::vector<int64_t> fileEnds(ok ? static_cast<size_t>(fileCount) : 0);
+    ok = ok &&
+         std::fseek(file, -static_cast<long>(trailerSize), SEEK_END) == 0 &&
+         std::fread(fileEnds.data(), sizeof(int64_t), fileEnds.size(),
+                    file) == fileEnds.size();
+
+    std::fclose(file);
+
+    if (!ok || duration <= 0) {
+        LOGW("invalid output cache entry: " << path);
+        unlink(path.c_str());
+        return std::nullopt;
+    }
+
+    // mtime is used as last access time in eviction
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+
+    LOGD("output cache hit: " << path);
+
+    Entry entry{std::move(path), entryHeaderSize,
+                static_cast<size_t>(st.st_size) - entryHeaderSize -
+                    trailerSize,
+                std::chrono::microseconds{duration},
+                {}};
+    for (auto end : fileEnds) entry.fileEnds.emplace_back(end);
+
+    return entry;
+}
+
+void OutputCache::begin() {
+    discard();
+
+    // unique name, so concurrent writers of the same entry don't collide
+    m_tmpPath = entryPath() + m_tmpSuffix;
+    auto fd = mkstemp(m_tmpPath.data());
+    if (fd < 0) {
+        LOGW("failed to create output cache entry: " << m_tmpPath);
+        m_tmpPath.clear();
+        return;
+    }
+
+    m_file = fdopen(fd, "wb");
+    if (m_file == nullptr) {
+        LOGW("failed to open output cache entry: " << m_tmpPath);
+        close(fd);
+        unlink(m_tmpPath.c_str());
+        m_tmpPath.clear();
+        return;
+    }
+
+    // muxer does many small writes
+    m_fileBuf.resize(m_fileBufSize);
+    std::setvbuf(m_file, m_fileBuf.data(), _IOFBF, m_fileBuf.size());
+
+    // duration is not known yet
+    const int64_t duration = 0;
+    if (std::fwrite(entryMagic.data(), 1, entryMagic.size(), m_file) !=
+            entryMagic.size() ||
+        std::fwrite(&duration, sizeof duration, 1, m_file) != 1) {
+        LOGW("failed to write output cache entry");
+        discard();
+        return;
+    }
+
+    m_fileEnds.clear();
+
+    LOGD("output cache miss, writing new entry: " << m_tmpPath);
+}
+
+void OutputCache::write(const uint8_t *data, size_t size) {
+    if (m_file == nullptr) return;
+
+    if (std::fwrite(data, 1, size, m_file) != size) {
+        LOGW("failed to write output cache entry");
+        discard();
+    }
+}
+
+void OutputCache::markFileEnd(std::chrono::microseconds time) {
+    if (m_file == nullptr) return;
+
+    m_fileEnds.push_back(time.count());
+}
+
+void OutputCache::commit(std::chrono::microseconds duration) {
+    if (m_file == nullptr) return;
+
+    const int64_t dur = duration.count();
+    const auto fileCount = static_cast<int64_t>(m_fileEnds.size());
+    auto ok = std::fwrite(m_fileEnds.data(), sizeof(int64_t),
+                          m_fileEnds.size(), m_file) == m_fileEnds.size() &&
+              std::fwrite(&fileCount, sizeof fileCount, 1, m_file) == 1 &&
+              std::fseek(m_file, entryMagic.size(), SEEK_SET) == 0 &&
+              std::fwrite(&dur, sizeof dur, 1, m_file) == 1;
+    ok = std::fclose(m_file) == 0 && ok;
+    m_file = nullptr;
+    m_fileBuf.clear();
+
+    if (!ok || dur <= 0 ||
+        std::rename(m_tmpPath.c_str(), entryPath().c_str()) != 0) {
+        LOGW("failed to commit output cache entry");
+        unlink(m_tmpPath.c_str());
+        m_tmpPath.clear();
+        return;
+    }
+
+    m_tmpPath.clear();
+
+    LOGD("output cache entry committed: " << entryPath()
+                                          << ", duration=" << dur);
+
+    evict();
+}
+
+void OutputCache::discard() {
+    if (m_file == nullptr) return;
+
+    LOGD("output cache entry discarded");
+
+    std::fclose(m_file);
+    m_file = nullptr;
+    m_fileBuf.clear();
+
+    unlink(m_tmpPath.c_str());
+    m_tmpPath.clear();
+}
+
+void OutputCache::evict() const {
+    auto *dir = opendir(m_props.dir.c_str());
+    if (dir == nullptr) return;
+
+    struct Item {
+        std::string path;
+        size_t size = 0;
+        timespec mtime{};
+    };
+
+    std::vector<Item> items;
+    size_t totalSize = 0;
+
+    const auto extLen = std::strlen(m_entryExt);
+    const auto tmpExt = m_entryExt + std::string{m_tmpSuffix};
+    const auto now = std::chrono::system_clock::now();
+
+    auto hasExt = [](const std::string &name, const std::string &ext) {
+        return name.size() > ext.size() &&
+               name.compare(name.size() - ext.size(), ext.size(), ext) == 0;
+    };
+
+    auto isTmp = [&](const std::string &name) {
+        // suffix is random, only its length is known
+        return name.size() > tmpExt.size() &&
+               name.compare(name.size() - tmpExt.size(), extLen,
+                            m_entryExt) == 0;
+    };
+
+    while (auto *ent = readdir(dir)) {
+        std::string name{ent->d_name};
+        const auto tmp = isTmp(name);
+        if (!tmp && !hasExt(name, m_entryExt)) continue;
+
+        auto path = m_props.dir + '/' + name;
+        struct stat st {};
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+
+        if (tmp) {
+            const auto mtime = std::chrono::system_clock::from_time_t(
+                st.st_mtim.tv_sec);
+            if (now - mtime > m_staleTmpAge && path != m_tmpPath) {
+                LOGD("removing stale output cache file: " << path);
+                unlink(path.c_str());
+            }
+            continue;
+        }
+
+        totalSize += static_cast<size_t>(st.st_size);
+        items.push_back({std::move(path), static_cast<size_t>(st.st_size),
+                         st.st_mtim});
+    }
+
+    closedir(dir);
+
+    if (totalSize <= m_props.maxSize) return;
+
+    std::sort(items.begin(), items.end(), [](const auto &a, const auto &b) {
+        return a.mtime.tv_sec != b.mtime.tv_sec
+                   ? a.mtime.tv_sec < b.mtime.tv_sec
+                   : a.mtime.tv_nsec < b.mtime.tv_nsec;
+    });
+
+    for (const auto &item : items) {
+        if (totalSize <= m_props.maxSize) break;
+        LOGD("evicting output cache entry: " << item.path);
+        if (unlink(item.path.c_str()) == 0) totalSize -= item.size;
+    }
+}
@@ -0,0 +1,78 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef OUTPUTCACHE_HPP
+#define OUTPUTCACHE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// On-disk cache of muxed output of file sources. Entry key is SHA-256 of
+// files (path, size, mtime) and stream params, so changed file or settings
+// simply don't match. When dir size exceeds the limit, the least recently
+// used entries are removed.
+class OutputCache {
+   public:
+    struct Props {
+        std::string dir;
+        size_t maxSize = 0;  // bytes
+        friend std::ostream &operator<<(std::ostream &os, const Props &props);
+    };
+
+    struct Entry {
+        std::string path;
+        size_t offset = 0;  // data starts after entry header
+        size_t size = 0;    // data size
+        std::chrono::microseconds duration{0};
+        // stream time at which every file ends
+        std::vector<std::chrono::microseconds> fileEnds;
+    };
+
+    OutputCache(Props props, std::string key);
+    ~OutputCache();
+    OutputCache(const OutputCache &) = delete;
+    OutputCache &operator=(const OutputCache &) = delete;
+    // nullopt when any file is not accessible or digest fails
+    static std::optional<std::string> makeKey(
+        const std::vector<std::string> &files, const std::string &params);
+    // complete entry, it is marked as recently used
+    std::optional<Entry> find() const;
+    // new entry is written to temporary file and becomes visible on commit
+    void begin();
+    void write(const uint8_t *data, size_t size);
+    // stream time at which current file ends, stored with entry
+    void markFileEnd(std::chrono::microseconds time);
+    void commit(std::chrono::microseconds duration);
+    void discard();
+    inline bool writing() const { return m_file != nullptr; }
+
+   private:
+    static constexpr const char *m_entryExt = ".kcache";
+    // mkstemp template
+    static constexpr const char *m_tmpSuffix = ".XXXXXX";
+    // temporary file not modified for that long is left by killed writer
+    static constexpr const std::chrono::minutes m_staleTmpAge{10};
+    static constexpr const size_t m_fileBufSize = 0x100000;
+
+    Props m_props;
+    std::string m_key;
+    std::string m_tmpPath;
+    std::FILE *m_file = nullptr;
+    std::vector<char> m_fileBuf;
+    std::vector<int64_t> m_fileEnds;  // micro s
+
+    std::string entryPath() const;
+    void evict() const;
+};
+
+#endif  // OUTPUTCACHE_HPP
@@ -0,0 +1,267 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "pipewiresource.hpp"
+
+#include <spa/param/audio/format-utils.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+#include "logger.hpp"
+
+#ifndef PW_KEY_TARGET_OBJECT
+#define PW_KEY_TARGET_OBJECT PW_KEY_NODE_TARGET
+#endif
+
+std::ostream &operator<<(std::ostream &os,
+                         const PipeWireSource::Props &props) {
+    os << "name=" << props.name << ", friendly-name=" << props.friendlyName
+       << ", monitor=" << props.monitor << ", rate=" << props.rate
+       << ", channels=" << static_cast<int>(props.channels);
+    return os;
+}
+
+PipeWireSource::PipeWireSource(Props props, DataReadyHandler dataReadyHandler,
+                               ErrorHandler errorHandler)
+    : m_props{std::move(props)},
+      m_dataReadyHandler{std::move(dataReadyHandler)},
+      m_errorHandler{std::move(errorHandler)} {
+    LOGD("creating pipewire source: " << m_props);
+
+    init();
+
+    m_loop = pw_thread_loop_new("kamkast-pw", nullptr);
+    if (m_loop == nullptr) throw std::runtime_error("pw_thread_loop_new error");
+
+    auto *streamProps = pw_properties_new(
+        PW_KEY_MEDIA_TYPE, "Audio", PW_KEY_MEDIA_CATEGORY, "Capture",
+        PW_KEY_TARGET_OBJECT, m_props.name.c_str(), nullptr);
+    if (m_props.monitor)
+        pw_properties_set(streamProps, PW_KEY_STREAM_CAPTURE_SINK, "true");
+    // quantum sized buffers are delivered to process callback
+    pw_properties_setf(streamProps, PW_KEY_NODE_LATENCY, "%u/%u", m_quantum,
+                       m_props.rate);
+
+    static const auto streamEvents = [] {
+        pw_stream_events events{};
+        events.version = PW_VERSION_STREAM_EVENTS;
+        events.state_changed = streamStateChangedCallback;
+        events.process = streamProcessCallback;
+        return events;
+    }();
+
+    m_stream = pw_stream_new_simple(pw_thread_loop_get_loop(m_loop), "kamkast",
+                                    streamProps, &streamEvents, this);
+    if (m_stream == nullptr) {
+        clean();
+        throw std::runtime_error("pw_stream_new_simple error");
+    }
+
+    LOGD("pipewire source created");
+}
+
+PipeWireSource::~PipeWireSource() {
+    LOGD("pipewire source termination started");
+    clean();
+    LOGD("pipewire source termination completed");
+}
+
+void PipeWireSource::clean() {
+    if (m_loop != nullptr) pw_thread_loop_stop(m_loop);
+
+    if (m_stream != nullptr) {
+        pw_stream_destroy(m_stream);
+        m_stream = nullptr;
+    }
+
+    if (m_loop != nullptr) {
+        pw_thread_loop_destroy(m_loop);
+        m_loop = nullptr;
+    }
+}
+
+void PipeWireSource::init() {
+    static std::once_flag flag;
+    std::call_once(flag, [] { pw_init(nullptr, nullptr); });
+}
+
+bool PipeWireSource::supported() noexcept { return true; }
+
+void PipeWireSource::start() {
+    LOGD("starting pipewire source");
+
+    std::array<uint8_t, 1024> buf{};
+    spa_pod_builder builder{};
+    spa_pod_builder_init(&builder, buf.data(), buf.size());
+
+    spa_audio_info_raw info{};
+    info.format = SPA_AUDIO_FORMAT_S16_LE;
+    info.rate = m_props.rate;
+    info.channels = m_props.channels;
+    if (m_props.channels == 2) {
+        info.position[0] = SPA_AUDIO_CHANNEL_FL;
+        info.position[1] = SPA_AUDIO_CHANNEL_FR;
+    }
+
+    const spa_pod *params[] = {
+        spa_format_audio_raw_build(&builder, SPA_PARAM_EnumFormat, &info)};
+
+    if (pw_stream_connect(
+            m_stream, PW_DIRECTION_INPUT, PW_ID_ANY,
+            static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT |
+                                         PW_STREAM_FLAG_MAP_BUFFERS),
+            params, 1) < 0)
+        throw std::runtime_error("pw_stream_connect error");
+
+    if (pw_thread_loop_start(m_loop) < 0)
+        throw std::runtime_error("pw_thread_loop_start error");
+}
+
+void PipeWireSource::streamProcessCallback(void *userdata) {
+    auto *source = static_cast<PipeWireSource *>(userdata);
+
+    auto *buf = pw_stream_dequeue_buffer(source->m_stream);
+    if (buf == nullptr) {
+        LOGW("pw buffer underrun");
+        return;
+    }
+
+    const auto &data = buf->buffer->datas[0];
+
+    if (data.data != nullptr && data.chunk->size > 0) {
+        auto offset = std::min(data.chunk->offset, data.maxsize);
+        auto size = std::min(data.chunk->size, data.maxsize - offset);
+
+        LOGT("pw audio data: " << size);
+
+        source->m_dataReadyHandler(static_cast<const uint8_t *>(data.data) +
+                                       offset,
+                                   size);
+    }
+
+    pw_stream_queue_buffer(source->m_stream, buf);
+}
+
+void PipeWireSource::streamStateChangedCallback(
+    void *userdata, [[maybe_unused]] pw_stream_state oldState,
+    pw_stream_state state, const char *error) {
+    auto *source = static_cast<PipeWireSource *>(userdata);
+
+    LOGD("pw stream state: " << pw_stream_state_as_string(state));
+
+    if (state == PW_STREAM_STATE_ERROR) {
+        LOGE("pw stream error: " << (error ? error : ""));
+        if (source->m_errorHandler) source->m_errorHandler();
+    }
+}
+
+void PipeWireSource::registryGlobalCallback(
+    void *userdata, [[maybe_unused]] uint32_t id,
+    [[maybe_unused]] uint32_t permissions, const char *type,
+    [[maybe_unused]] uint32_t version, const spa_dict *props) {
+    if (props == nullptr || strcmp(type, PW_TYPE_INTERFACE_Node) != 0) return;
+
+    const auto *mediaClass = spa_dict_lookup(props, PW_KEY_MEDIA_CLASS);
+    const auto *name = spa_dict_lookup(props, PW_KEY_NODE_NAME);
+    if (mediaClass == nullptr || name == nullptr) return;
+
+    Props source;
+
+    if (strcmp(mediaClass, "Audio/Source") == 0)
+        source.monitor = false;
+    else if (strcmp(mediaClass, "Audio/Sink") == 0)
+        source.monitor = true;
+    else
+        return;
+
+    const auto *desc = spa_dict_lookup(props, PW_KEY_NODE_DESCRIPTION);
+
+    source.name = name;
+    source.friendlyName = desc ? desc : name;
+
+    LOGD("pw node found: " << source);
+
+    static_cast<SearchResult *>(userdata)->props.push_back(std::move(source));
+}
+
+void PipeWireSource::coreDoneCallback(void *userdata, uint32_t id, int seq) {
+    auto *result = static_cast<SearchResult *>(userdata);
+    if (id == PW_ID_CORE && seq == result->pending)
+        pw_main_loop_quit(result->loop);
+}
+
+void PipeWireSource::coreErrorCallback(void *userdata, uint32_t id,
+                                       [[maybe_unused]] int seq, int res,
+                                       const char *message) {
+    LOGW("pw core error: id=" << id << ", res=" << res
+                              << ", message=" << (message ? message : ""));
+    if (id == PW_ID_CORE)
+        pw_main_loop_quit(static_cast<SearchResult *>(userdata)->loop);
+}
+
+std::vector<PipeWireSource::Props> PipeWireSource::sources() {
+    LOGD("pw sources detection started");
+
+    init();
+
+    SearchResult result;
+
+    result.loop = pw_main_loop_new(nullptr);
+    if (result.loop == nullptr)
+        throw std::runtime_error("pw_main_loop_new error");
+
+    auto *ctx = pw_context_new(pw_main_loop_get_loop(result.loop), nullptr, 0);
+    if (ctx == nullptr) {
+        pw_main_loop_destroy(result.loop);
+        throw std::runtime_error("pw_context_new error");
+    }
+
+    auto *core = pw_context_connect(ctx, nullptr, 0);
+    if (core == nullptr) {
+        LOGD("pipewire is not running");
+        pw_context_destroy(ctx);
+        pw_main_loop_destroy(result.loop);
+        return {};
+    }
+
+    pw_registry_events registryEvents{};
+    registryEvents.version = PW_VERSION_REGISTRY_EVENTS;
+    registryEvents.global = registryGlobalCallback;
+
+    pw_core_events coreEvents{};
+    coreEvents.version = PW_VERSION_CORE_EVENTS;
+    coreEvents.done = coreDoneCallback;
+    coreEvents.error = coreErrorCallback;
+
+    spa_hook registryListener{};
+    spa_hook coreListener{};
+
+    auto *registry = pw_core_get_registry(core, PW_VERSION_REGISTRY, 0);
+    pw_registry_add_listener(registry, &registryListener, &registryEvents,
+                             &result);
+    pw_core_add_listener(core, &coreListener, &coreEvents, &result);
+
+    // done event for this sync is received after all globals
+    result.pending = pw_core_sync(core, PW_ID_CORE, 0);
+
+    pw_main_loop_run(result.loop);
+
+    spa_hook_remove(&coreListener);
+    spa_hook_remove(&registryListener);
+    pw_proxy_destroy(reinterpret_cast<pw_proxy *>(registry));
+    pw_core_disconnect(core);
+    pw_context_destroy(ctx);
+    pw_main_loop_destroy(result.loop);
+
+    LOGD("pw sources detection completed");
+
+    return std::move(result.props);
+}
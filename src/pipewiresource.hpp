@@ -0,0 +1,71 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef PIPEWIRESOURCE_HPP
+#define PIPEWIRESOURCE_HPP
+
+#include <pipewire/pipewire.h>
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class PipeWireSource {
+   public:
+    using DataReadyHandler = std::function<void(const uint8_t *, size_t)>;
+    using ErrorHandler = std::function<void(void)>;
+
+    struct Props {
+        std::string name;  // node name
+        std::string friendlyName;
+        bool monitor = false;
+        uint32_t rate = 48000;
+        uint8_t channels = 2;
+        friend std::ostream &operator<<(std::ostream &os, const Props &props);
+    };
+
+    PipeWireSource(Props props, DataReadyHandler dataReadyHandler,
+                   ErrorHandler errorHandler);
+    ~PipeWireSource();
+    void start();
+    static bool supported() noexcept;
+    static std::vector<Props> sources();
+
+   private:
+    // samples delivered in one buffer, 10 ms at 48 kHz
+    static const uint32_t m_quantum = 480;
+
+    struct SearchResult {
+        pw_main_loop *loop = nullptr;
+        std::vector<Props> props;
+        int pending = 0;
+    };
+
+    Props m_props;
+    DataReadyHandler m_dataReadyHandler;
+    ErrorHandler m_errorHandler;
+    pw_thread_loop *m_loop = nullptr;
+    pw_stream *m_stream = nullptr;
+
+    static void init();
+    void clean();
+    static void streamProcessCallback(void *userdata);
+    static void streamStateChangedCallback(void *userdata,
+                                           pw_stream_state oldState,
+                                           pw_stream_state state,
+                                           const char *error);
+    static void registryGlobalCallback(void *userdata, uint32_t id,
+                                       uint32_t permissions, const char *type,
+                                       uint32_t version, const spa_dict *props);
+    static void coreDoneCallback(void *userdata, uint32_t id, int seq);
+    static void coreErrorCallback(void *userdata, uint32_t id, int seq,
+                                  int res, const char *message);
+};
+
+#endif  // PIPEWIRESOURCE_HPP
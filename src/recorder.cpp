@@ -0,0 +1,264 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "recorder.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <utility>
+
+#include "logger.hpp"
+
+std::ostream &operator<<(std::ostream &os, const Recorder::Props &props) {
+    os << "dir=" << props.dir << ", ext=" << props.ext
+       << ", max-size=" << props.maxSize
+       << ", max-duration=" << props.maxDuration.count()
+       << ", packet-size=" << props.packetSize;
+    return os;
+}
+
+Recorder::Recorder(Props props) : m_props{std::move(props)} {
+    LOGD("creating recorder: " << m_props);
+
+    m_writerThread = std::thread{[this] { doWriterTask(); }};
+}
+
+Recorder::~Recorder() {
+    LOGD("recorder termination started");
+
+    if (m_chunk) queueChunk();
+
+    {
+        std::lock_guard lock{m_mtx};
+        m_terminating = true;
+    }
+    m_cv.notify_one();
+
+    // remaining queued data is written before exit
+    if (m_writerThread.joinable()) m_writerThread.join();
+
+    LOGD("recorder termination completed");
+}
+
+void Recorder::write(const uint8_t *data, size_t size, DataType type) {
+    if (type == DataType::Header) {
+        // header after stream data means that muxer was re-initialized,
+        // so current file can't be continued
+        if (m_lastType != DataType::Header) {
+            m_header.clear();
+            m_fileNeeded = true;
+            m_streamSize = 0;
+        }
+        m_header.insert(m_header.end(), data, data + size);
+        m_lastType = type;
+        return;
+    }
+
+    m_lastType = type;
+
+    // file can't start in the middle of container packet
+    if (type == DataType::SyncPoint && m_props.packetSize > 0 &&
+        m_streamSize % m_props.packetSize != 0) {
+        LOGW("sync point not aligned to packet size");
+        type = DataType::Other;
+    }
+
+    m_streamSize += size;
+
+    if (type == DataType::SyncPoint) {
+        const auto now = std::chrono::steady_clock::now();
+        if (m_fileNeeded ||
+            (m_props.maxSize > 0 && m_fileSize >= m_props.maxSize) ||
+            (m_props.maxDuration.count() > 0 &&
+             now - m_fileStartTime >= m_props.maxDuration)) {
+            startFile();
+        } else if (m_chunk && now - m_chunk->time >= m_maxChunkAge) {
+            // low bitrate stream, don't keep data in memory for too long
+            queueChunk();
+        }
+    }
+
+    // data before sync point is useless without previous part of the stream
+    if (m_fileNeeded) return;
+
+    append(data, size);
+}
+
+void Recorder::startFile() {
+    if (m_chunk) queueChunk();
+
+    m_chunk.emplace(takeFreeChunk());
+    m_chunk->path = nextFilePath();
+    m_fileNeeded = false;
+    m_fileSize = 0;
+    m_fileStartTime = std::chrono::steady_clock::now();
+
+    LOGD("starting new recording file: " << m_chunk->path);
+
+    append(m_header.data(), m_header.size());
+}
+
+void Recorder::append(const uint8_t *data, size_t size) {
+    m_fileSize += size;
+
+    while (size > 0) {
+        if (!m_chunk) m_chunk.emplace(takeFreeChunk());
+
+        const auto len = std::min(size, m_chunkSize - m_chunk->size);
+        std::memcpy(m_chunk->data.get() + m_chunk->size, data, len);
+        m_chunk->size += len;
+        data += len;
+        size -= len;
+
+        if (m_chunk->size == m_chunkSize) {
+            queueChunk();
+            // chunk was dropped
+            if (m_fileNeeded) return;
+        }
+    }
+}
+
+void Recorder::queueChunk() {
+    auto chunk = std::move(*m_chunk);
+    m_chunk.reset();
+
+    {
+        std::lock_guard lock{m_mtx};
+        if (m_queue.size() < m_maxQueuedChunks) {
+            m_queue.push_back(std::move(chunk));
+            m_cv.notify_one();
+            return;
+        }
+        if (m_freeChunks.size() < m_maxFreeChunks)
+            m_freeChunks.push_back(std::move(chunk));
+    }
+
+    // file would be corrupted anyway, next one is started at sync point
+    LOGW("recording storage is too slow, dropping data");
+    m_fileNeeded = true;
+}
+
+Recorder::Chunk Recorder::takeFreeChunk() {
+    Chunk chunk;
+
+    {
+        std::lock_guard lock{m_mtx};
+        if (!m_freeChunks.empty()) {
+            chunk = std::move(m_freeChunks.back());
+            m_freeChunks.pop_back();
+        }
+    }
+
+    if (!chunk.data) {
+        chunk.data.reset(static_cast<uint8_t *>(
+            std::aligned_alloc(m_chunkAlignment, m_chunkSize)));
+        if (!chunk.data) throw std::bad_alloc{};
+    }
+
+    chunk.size = 0;
+    chunk.path.clear();
+    chunk.time = std::chrono::steady_clock::now();
+
+    return chunk;
+}
+
+std::string Recorder::nextFilePath() const {
+    auto time = std::time(nullptr);
+    std::tm tm{};
+    localtime_r(&time, &tm);
+
+    char name[64];
+    std::strftime(name, sizeof name, "kamkast-%Y%m%d-%H%M%S", &tm);
+
+    return m_props.dir + '/' + name + '.' + m_props.ext;
+}
+
+void Recorder::doWriterTask() {
+    LOGD("recorder writer started");
+
+    std::unique_lock lock{m_mtx};
+
+    while (true) {
+        m_cv.wait(lock, [this] { return m_terminating || !m_queue.empty(); });
+        if (m_queue.empty()) break;
+
+        auto chunk = std::move(m_queue.front());
+        m_queue.pop_front();
+
+        lock.unlock();
+        writeChunk(chunk);
+        lock.lock();
+
+        if (m_freeChunks.size() < m_maxFreeChunks)
+            m_freeChunks.push_back(std::move(chunk));
+    }
+
+    lock.unlock();
+
+    closeFile();
+
+    LOGD("recorder writer ended");
+}
+
+void Recorder::writeChunk(const Chunk &chunk) {
+    if (!chunk.path.empty()) openFile(chunk.path);
+
+    if (m_fd < 0) return;
+
+    const auto *data = chunk.data.get();
+    auto size = chunk.size;
+
+    while (size > 0) {
+        auto ret = ::write(m_fd, data, size);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            LOGE("failed to write recording file: " << std::strerror(errno));
+            closeFile();
+            return;
+        }
+        data += ret;
+        size -= static_cast<size_t>(ret);
+    }
+}
+
+void Recorder::openFile(const std::string &path) {
+    closeFile();
+
+    // more than one file can be started in the same second
+    auto newPath = path;
+    for (int i = 1; i < 100; ++i) {
+        m_fd = ::open(newPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                      0644);
+        if (m_fd >= 0 || errno != EEXIST) break;
+        auto dot = path.rfind('.');
+        newPath = path.substr(0, dot) + '-' + std::to_string(i) +
+                  path.substr(dot);
+    }
+
+    if (m_fd < 0) {
+        LOGE("failed to open recording file: " << newPath << " "
+                                               << std::strerror(errno));
+        return;
+    }
+
+    LOGD("recording file opened: " << newPath);
+}
+
+void Recorder::closeFile() {
+    if (m_fd < 0) return;
+
+    ::close(m_fd);
+    m_fd = -1;
+
+    LOGD("recording file closed");
+}
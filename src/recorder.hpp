@@ -0,0 +1,104 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef RECORDER_HPP
+#define RECORDER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Tee of muxed stream to files on disk. Data is copied into large aligned
+// chunks on muxing thread and written by dedicated writer thread, so slow
+// storage never blocks the muxer. When writer can't keep up, data is
+// dropped and file is closed. Every file starts with init segment.
+class Recorder {
+   public:
+    enum class DataType {
+        Header,     // init segment
+        SyncPoint,  // key frame, new file can be started here
+        Other
+    };
+
+    struct Props {
+        std::string dir;
+        std::string ext;
+        size_t maxSize = 0;                   // bytes, 0 means no limit
+        std::chrono::seconds maxDuration{0};  // 0 means no limit
+        // files are split only at multiple of that, 0 means any offset
+        size_t packetSize = 0;
+        friend std::ostream &operator<<(std::ostream &os, const Props &props);
+    };
+
+    explicit Recorder(Props props);
+    ~Recorder();
+    Recorder(const Recorder &) = delete;
+    Recorder &operator=(const Recorder &) = delete;
+    // only called from muxing thread
+    void write(const uint8_t *data, size_t size, DataType type);
+
+   private:
+    static constexpr const size_t m_chunkAlignment = 4096;
+    static constexpr const size_t m_chunkSize = 0x100000;  // 1 MiB
+    // max data waiting for writer, above that data is dropped
+    static constexpr const size_t m_maxQueuedChunks = 32;
+    static constexpr const size_t m_maxFreeChunks = 4;
+    // partially filled chunk is queued at sync point when older than that
+    static constexpr const std::chrono::seconds m_maxChunkAge{2};
+
+    struct ChunkFree {
+        void operator()(uint8_t *data) const { std::free(data); }
+    };
+
+    struct Chunk {
+        std::unique_ptr<uint8_t, ChunkFree> data;
+        size_t size = 0;
+        std::string path;  // when not empty, new file is opened first
+        std::chrono::steady_clock::time_point time;
+    };
+
+    Props m_props;
+    // muxing thread only
+    std::vector<uint8_t> m_header;
+    DataType m_lastType = DataType::Other;
+    std::optional<Chunk> m_chunk;
+    bool m_fileNeeded = true;
+    size_t m_fileSize = 0;
+    size_t m_streamSize = 0;  // data after header
+    std::chrono::steady_clock::time_point m_fileStartTime;
+    // shared with writer thread
+    std::deque<Chunk> m_queue;
+    std::vector<Chunk> m_freeChunks;
+    bool m_terminating = false;
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    // writer thread only
+    int m_fd = -1;
+    std::thread m_writerThread;
+
+    void startFile();
+    void append(const uint8_t *data, size_t size);
+    void queueChunk();
+    Chunk takeFreeChunk();
+    std::string nextFilePath() const;
+    void doWriterTask();
+    void writeChunk(const Chunk &chunk);
+    void openFile(const std::string &path);
+    void closeFile();
+};
+
+#endif  // RECORDER_HPP
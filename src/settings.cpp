@@ -8,6 +8,7 @@
 #include "settings.hpp"
 
 #include <fmt/core.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <array>
@@ -89,6 +90,47 @@ void Settings::loadFromOpts(const cxxopts::ParseResult& options) {
     disableCtrlApi = options[disableCtrlApiOpt].as<bool>();
     logRequests = options[logRequestsOpt].as<bool>();
     logFile = options[logFileOpt].as<std::string>();
+    standby = options[standbyOpt].as<bool>();
+    sessionGracePeriod = options[sessionGracePeriodOpt].as<int>();
+    fragmentPolicy = fragmentPolicyFromStr(
+        trimmed(options[DEFAULT_OPT(fragmentPolicyOpt)].as<std::string>()));
+    fragmentInterval = options[DEFAULT_OPT(fragmentIntervalOpt)].as<int>();
+    alsaPeriodSize = options[alsaPeriodSizeOpt].as<int>();
+    v4l2QueueDepth = options[v4l2QueueDepthOpt].as<int>();
+    screenCaptureFramerate = options[screenCaptureFramerateOpt].as<int>();
+    v4l2Passthrough = options[v4l2PassthroughOpt].as<bool>();
+    v4l2Mjpeg = options[v4l2MjpegOpt].as<bool>();
+    videoOverlaySources =
+        trimmed(options[videoOverlaySourcesOpt].as<std::string>());
+    videoOverlayPosition = videoOverlayPositionFromStr(
+        trimmed(options[videoOverlayPositionOpt].as<std::string>()));
+    videoOverlaySize = options[videoOverlaySizeOpt].as<int>();
+    videoOverlayOpacity = options[videoOverlayOpacityOpt].as<int>();
+    audioMixSources = trimmed(options[audioMixSourcesOpt].as<std::string>());
+    videoBitrate = options[videoBitrateOpt].as<int>();
+    videoScale =
+        videoScaleFromStr(trimmed(options[videoScaleOpt].as<std::string>()));
+    videoFramerate = options[videoFramerateOpt].as<int>();
+    audioBitrate = options[audioBitrateOpt].as<int>();
+    recordDir = options[recordDirOpt].as<std::string>();
+    recordMaxSize = options[recordMaxSizeOpt].as<int>();
+    recordMaxDuration = options[recordMaxDurationOpt].as<int>();
+    timeShiftDuration = options[timeShiftDurationOpt].as<int>();
+    timeShiftMaxSize = options[timeShiftMaxSizeOpt].as<int>();
+    testSourceWidth = options[testSourceWidthOpt].as<int>();
+    testSourceHeight = options[testSourceHeightOpt].as<int>();
+    testSourceFramerate = options[testSourceFramerateOpt].as<int>();
+    testSourcePixfmt = trimmed(options[testSourcePixfmtOpt].as<std::string>());
+    testSourcePattern = testSourcePatternFromStr(
+        trimmed(options[testSourcePatternOpt].as<std::string>()));
+    testSourceMotion = options[testSourceMotionOpt].as<int>();
+    testSourceEntropy = options[testSourceEntropyOpt].as<int>();
+    synthAudioSources = options[synthAudioSourcesOpt].as<bool>();
+    synthAudioRate = options[synthAudioRateOpt].as<int>();
+    synthAudioChannels = options[synthAudioChannelsOpt].as<int>();
+    synthAudioSampleFmt =
+        trimmed(options[synthAudioSampleFmtOpt].as<std::string>());
+    synthAudioFrequency = options[synthAudioFrequencyOpt].as<int>();
 }
 
 void Settings::loadFromFile() {
@@ -139,6 +181,74 @@ void Settings::loadFromFile() {
         disableCtrlApi = toBool(sec[disableCtrlApiOpt]);
     if (sec.has(logRequestsOpt)) logRequests = toBool(sec[logRequestsOpt]);
     if (sec.has(logFileOpt)) logFile = sec[logFileOpt];
+    if (sec.has(standbyOpt)) standby = toBool(sec[standbyOpt]);
+    if (sec.has(sessionGracePeriodOpt))
+        sessionGracePeriod = toInt(sec[sessionGracePeriodOpt]);
+    if (sec.has(DEFAULT_OPT(fragmentPolicyOpt)))
+        fragmentPolicy =
+            fragmentPolicyFromStr(sec[DEFAULT_OPT(fragmentPolicyOpt)]);
+    if (sec.has(DEFAULT_OPT(fragmentIntervalOpt)))
+        fragmentInterval = toInt(sec[DEFAULT_OPT(fragmentIntervalOpt)]);
+    if (sec.has(alsaPeriodSizeOpt))
+        alsaPeriodSize = toInt(sec[alsaPeriodSizeOpt]);
+    if (sec.has(v4l2QueueDepthOpt))
+        v4l2QueueDepth = toInt(sec[v4l2QueueDepthOpt]);
+    if (sec.has(screenCaptureFramerateOpt))
+        screenCaptureFramerate = toInt(sec[screenCaptureFramerateOpt]);
+    if (sec.has(v4l2PassthroughOpt))
+        v4l2Passthrough = toBool(sec[v4l2PassthroughOpt]);
+    if (sec.has(v4l2MjpegOpt)) v4l2Mjpeg = toBool(sec[v4l2MjpegOpt]);
+    if (sec.has(videoOverlaySourcesOpt))
+        videoOverlaySources = sec[videoOverlaySourcesOpt];
+    if (sec.has(videoOverlayPositionOpt))
+        videoOverlayPosition =
+            videoOverlayPositionFromStr(sec[videoOverlayPositionOpt]);
+    if (sec.has(videoOverlaySizeOpt))
+        videoOverlaySize = toInt(sec[videoOverlaySizeOpt]);
+    if (sec.has(videoOverlayOpacityOpt))
+        videoOverlayOpacity = toInt(sec[videoOverlayOpacityOpt]);
+    if (sec.has(audioMixSourcesOpt))
+        audioMixSources = sec[audioMixSourcesOpt];
+    if (sec.has(videoBitrateOpt)) videoBitrate = toInt(sec[videoBitrateOpt]);
+    if (sec.has(videoScaleOpt))
+        videoScale = videoScaleFromStr(sec[videoScaleOpt]);
+    if (sec.has(videoFramerateOpt))
+        videoFramerate = toInt(sec[videoFramerateOpt]);
+    if (sec.has(audioBitrateOpt)) audioBitrate = toInt(sec[audioBitrateOpt]);
+    if (sec.has(recordDirOpt)) recordDir = sec[recordDirOpt];
+    if (sec.has(recordMaxSizeOpt))
+        recordMaxSize = toInt(sec[recordMaxSizeOpt]);
+    if (sec.has(recordMaxDurationOpt))
+        recordMaxDuration = toInt(sec[recordMaxDurationOpt]);
+    if (sec.has(timeShiftDurationOpt))
+        timeShiftDuration = toInt(sec[timeShiftDurationOpt]);
+    if (sec.has(timeShiftMaxSizeOpt))
+        timeShiftMaxSize = toInt(sec[timeShiftMaxSizeOpt]);
+    if (sec.has(testSourceWidthOpt))
+        testSourceWidth = toInt(sec[testSourceWidthOpt]);
+    if (sec.has(testSourceHeightOpt))
+        testSourceHeight = toInt(sec[testSourceHeightOpt]);
+    if (sec.has(testSourceFramerateOpt))
+        testSourceFramerate = toInt(sec[testSourceFramerateOpt]);
+    if (sec.has(testSourcePixfmtOpt))
+        testSourcePixfmt = sec[testSourcePixfmtOpt];
+    if (sec.has(testSourcePatternOpt))
+        testSourcePattern =
+            testSourcePatternFromStr(sec[testSourcePatternOpt]);
+    if (sec.has(testSourceMotionOpt))
+        testSourceMotion = toInt(sec[testSourceMotionOpt]);
+    if (sec.has(testSourceEntropyOpt))
+        testSourceEntropy = toInt(sec[testSourceEntropyOpt]);
+    if (sec.has(synthAudioSourcesOpt))
+        synthAudioSources = toBool(sec[synthAudioSourcesOpt]);
+    if (sec.has(synthAudioRateOpt))
+        synthAudioRate = toInt(sec[synthAudioRateOpt]);
+    if (sec.has(synthAudioChannelsOpt))
+        synthAudioChannels = toInt(sec[synthAudioChannelsOpt]);
+    if (sec.has(synthAudioSampleFmtOpt))
+        synthAudioSampleFmt = sec[synthAudioSampleFmtOpt];
+    if (sec.has(synthAudioFrequencyOpt))
+        synthAudioFrequency = toInt(sec[synthAudioFrequencyOpt]);
 }
 
 void Settings::check() {
@@ -166,6 +276,70 @@ void Settings::check() {
     if (audioVolume < 0.0 || audioVolume > 100.0)
         invalidOption(DEFAULT_OPT(audioVolumeOpt));
     if (!videoOrientation) invalidOption(DEFAULT_OPT(videoOrientationOpt));
+    if (sessionGracePeriod < 0) invalidOption(sessionGracePeriodOpt);
+    if (!fragmentPolicy) invalidOption(DEFAULT_OPT(fragmentPolicyOpt));
+    if (fragmentInterval < 10 || fragmentInterval > 10000)
+        invalidOption(DEFAULT_OPT(fragmentIntervalOpt));
+    if (alsaPeriodSize < 32 || alsaPeriodSize > 8192)
+        invalidOption(alsaPeriodSizeOpt);
+    if (v4l2QueueDepth < 0 || v4l2QueueDepth > 32)
+        invalidOption(v4l2QueueDepthOpt);
+    if (screenCaptureFramerate < 1 || screenCaptureFramerate > 60)
+        invalidOption(screenCaptureFramerateOpt);
+    trim(videoOverlaySources);
+    if (!videoOverlayPosition) invalidOption(videoOverlayPositionOpt);
+    if (videoOverlaySize < 5 || videoOverlaySize > 50)
+        invalidOption(videoOverlaySizeOpt);
+    if (videoOverlayOpacity < 1 || videoOverlayOpacity > 100)
+        invalidOption(videoOverlayOpacityOpt);
+    trim(audioMixSources);
+    if (videoBitrate != 0 && (videoBitrate < 100 || videoBitrate > 100000))
+        invalidOption(videoBitrateOpt);
+    if (!videoScale) invalidOption(videoScaleOpt);
+    if (videoFramerate < 0 || videoFramerate > 120)
+        invalidOption(videoFramerateOpt);
+    if (audioBitrate != 0 && (audioBitrate < 32 || audioBitrate > 320))
+        invalidOption(audioBitrateOpt);
+    trim(recordDir);
+    if (!recordDir.empty() && access(recordDir.c_str(), W_OK) != 0)
+        invalidOption(recordDirOpt);
+    if (recordMaxSize < 0) invalidOption(recordMaxSizeOpt);
+    if (recordMaxDuration < 0) invalidOption(recordMaxDurationOpt);
+    if (timeShiftDuration < 0 || timeShiftDuration > 3600)
+        invalidOption(timeShiftDurationOpt);
+    // whole window is replayed at once, so it has to fit in connection buf
+    if (timeShiftMaxSize < 1 || timeShiftMaxSize > 128)
+        invalidOption(timeShiftMaxSizeOpt);
+    // raw frames are read with lines aligned to 32 bytes
+    if (testSourceWidth < 64 || testSourceWidth > 7680 ||
+        testSourceWidth % 64 != 0)
+        invalidOption(testSourceWidthOpt);
+    if (testSourceHeight < 2 || testSourceHeight > 4320 ||
+        testSourceHeight % 2 != 0)
+        invalidOption(testSourceHeightOpt);
+    if (testSourceFramerate < 1 || testSourceFramerate > 120)
+        invalidOption(testSourceFramerateOpt);
+    trim(testSourcePixfmt);
+    if (std::find(testSourcePixfmts.cbegin(), testSourcePixfmts.cend(),
+                  testSourcePixfmt) == testSourcePixfmts.cend())
+        invalidOption(testSourcePixfmtOpt);
+    if (!testSourcePattern) invalidOption(testSourcePatternOpt);
+    if (testSourceMotion < 0 || testSourceMotion > testSourceWidth)
+        invalidOption(testSourceMotionOpt);
+    if (testSourceEntropy < 0 || testSourceEntropy > 100)
+        invalidOption(testSourceEntropyOpt);
+    // rate is split into 10 ms periods
+    if (synthAudioRate < 8000 || synthAudioRate > 192000 ||
+        synthAudioRate % 100 != 0)
+        invalidOption(synthAudioRateOpt);
+    if (synthAudioChannels < 1 || synthAudioChannels > 8)
+        invalidOption(synthAudioChannelsOpt);
+    trim(synthAudioSampleFmt);
+    if (std::find(synthAudioSampleFmts.cbegin(), synthAudioSampleFmts.cend(),
+                  synthAudioSampleFmt) == synthAudioSampleFmts.cend())
+        invalidOption(synthAudioSampleFmtOpt);
+    if (synthAudioFrequency < 1 || synthAudioFrequency >= synthAudioRate / 2)
+        invalidOption(synthAudioFrequencyOpt);
     trim(logFile);
     if (!logFile.empty() && !fileWrittable(logFile)) {
         LOGW("failed to create log file: " << logFile);
@@ -195,6 +369,41 @@ void Settings::saveToFile() const {
     sec[disableCtrlApiOpt] = std::to_string(disableCtrlApi);
     sec[logRequestsOpt] = std::to_string(logRequests);
     sec[logFileOpt] = logFile;
+    sec[standbyOpt] = std::to_string(standby);
+    sec[sessionGracePeriodOpt] = std::to_string(sessionGracePeriod);
+    sec[DEFAULT_OPT(fragmentPolicyOpt)] = fragmentPolicyToStr();
+    sec[DEFAULT_OPT(fragmentIntervalOpt)] = std::to_string(fragmentInterval);
+    sec[alsaPeriodSizeOpt] = std::to_string(alsaPeriodSize);
+    sec[v4l2QueueDepthOpt] = std::to_string(v4l2QueueDepth);
+    sec[screenCaptureFramerateOpt] = std::to_string(screenCaptureFramerate);
+    sec[v4l2PassthroughOpt] = std::to_string(v4l2Passthrough);
+    sec[v4l2MjpegOpt] = std::to_string(v4l2Mjpeg);
+    sec[videoOverlaySourcesOpt] = videoOverlaySources;
+    sec[videoOverlayPositionOpt] = videoOverlayPositionToStr();
+    sec[videoOverlaySizeOpt] = std::to_string(videoOverlaySize);
+    sec[videoOverlayOpacityOpt] = std::to_string(videoOverlayOpacity);
+    sec[audioMixSourcesOpt] = audioMixSources;
+    sec[videoBitrateOpt] = std::to_string(videoBitrate);
+    sec[videoScaleOpt] = videoScaleToStr();
+    sec[videoFramerateOpt] = std::to_string(videoFramerate);
+    sec[audioBitrateOpt] = std::to_string(audioBitrate);
+    sec[recordDirOpt] = recordDir;
+    sec[recordMaxSizeOpt] = std::to_string(recordMaxSize);
+    sec[recordMaxDurationOpt] = std::to_string(recordMaxDuration);
+    sec[timeShiftDurationOpt] = std::to_string(timeShiftDuration);
+    sec[timeShiftMaxSizeOpt] = std::to_string(timeShiftMaxSize);
+    sec[testSourceWidthOpt] = std::to_string(testSourceWidth);
+    sec[testSourceHeightOpt] = std::to_string(testSourceHeight);
+    sec[testSourceFramerateOpt] = std::to_string(testSourceFramerate);
+    sec[testSourcePixfmtOpt] = testSourcePixfmt;
+    sec[testSourcePatternOpt] = testSourcePatternToStr();
+    sec[testSourceMotionOpt] = std::to_string(testSourceMotion);
+    sec[testSourceEntropyOpt] = std::to_string(testSourceEntropy);
+    sec[synthAudioSourcesOpt] = std::to_string(synthAudioSources);
+    sec[synthAudioRateOpt] = std::to_string(synthAudioRate);
+    sec[synthAudioChannelsOpt] = std::to_string(synthAudioChannels);
+    sec[synthAudioSampleFmtOpt] = synthAudioSampleFmt;
+    sec[synthAudioFrequencyOpt] = std::to_string(synthAudioFrequency);
 
     // sec[guiOpt] = std::to_string(gui);
     // sec[debugOpt] = std::to_string(debug);
@@ -239,6 +448,24 @@ void Settings::updateFromStr(std::string_view opt, std::string_view value) {
             videoOrientation = v.value();
         else
             invalidValue(opt, value);
+    } else if (opt == fragmentPolicyOpt) {
+        if (auto v = fragmentPolicyFromStr(value))
+            fragmentPolicy = v.value();
+        else
+            invalidValue(opt, value);
+    } else if (opt == fragmentIntervalOpt) {
+        if (auto ivalue = toInt(std::string{value});
+            ivalue >= 10 && ivalue <= 10000)
+            fragmentInterval = ivalue;
+        else
+            invalidValue(opt, value);
+    } else if (opt == offsetOpt) {
+        // time in the past, e.g. -120s
+        if (auto ivalue = toInt(std::string{value});
+            ivalue <= 0 && ivalue >= -3600)
+            timeShiftOffset = -ivalue;
+        else
+            invalidValue(opt, value);
     } else {
         LOGW("invalid url param: " << opt);
     }
@@ -319,6 +546,103 @@ std::optional<Settings::VideoEncoder> Settings::videoEncoderFromStr(
     return std::nullopt;
 }
 
+std::string Settings::fragmentPolicyToStr() const {
+    if (fragmentPolicy) {
+        switch (*fragmentPolicy) {
+            case FragmentPolicy::Frame:
+                return "frame";
+            case FragmentPolicy::Interval:
+                return "interval";
+            case FragmentPolicy::Gop:
+                return "gop";
+        }
+    }
+    return "frame";
+}
+
+std::optional<Settings::FragmentPolicy> Settings::fragmentPolicyFromStr(
+    std::string_view str) {
+    if (str == "frame") return FragmentPolicy::Frame;
+    if (str == "interval") return FragmentPolicy::Interval;
+    if (str == "gop") return FragmentPolicy::Gop;
+    return std::nullopt;
+}
+
+std::string Settings::testSourcePatternToStr() const {
+    if (testSourcePattern) {
+        switch (*testSourcePattern) {
+            case TestSourcePattern::Bars:
+                return "bars";
+            case TestSourcePattern::Scroll:
+                return "scroll";
+            case TestSourcePattern::Noise:
+                return "noise";
+        }
+    }
+    return "bars";
+}
+
+std::optional<Settings::TestSourcePattern> Settings::testSourcePatternFromStr(
+    std::string_view str) {
+    if (str == "bars") return TestSourcePattern::Bars;
+    if (str == "scroll") return TestSourcePattern::Scroll;
+    if (str == "noise") return TestSourcePattern::Noise;
+    return std::nullopt;
+}
+
+std::string Settings::videoOverlayPositionToStr() const {
+    if (videoOverlayPosition) {
+        switch (*videoOverlayPosition) {
+            case VideoOverlayPosition::TopLeft:
+                return "top-left";
+            case VideoOverlayPosition::TopRight:
+                return "top-right";
+            case VideoOverlayPosition::BottomLeft:
+                return "bottom-left";
+            case VideoOverlayPosition::BottomRight:
+                return "bottom-right";
+        }
+    }
+    return "bottom-right";
+}
+
+std::optional<Settings::VideoOverlayPosition>
+Settings::videoOverlayPositionFromStr(std::string_view str) {
+    if (str == "top-left") return VideoOverlayPosition::TopLeft;
+    if (str == "top-right") return VideoOverlayPosition::TopRight;
+    if (str == "bottom-left") return VideoOverlayPosition::BottomLeft;
+    if (str == "bottom-right") return VideoOverlayPosition::BottomRight;
+    return std::nullopt;
+}
+
+std::string Settings::videoScaleToStr() const {
+    if (videoScale) {
+        switch (*videoScale) {
+            case VideoScale::Auto:
+                return "auto";
+            case VideoScale::Off:
+                return "off";
+            case VideoScale::Down25:
+                return "down-25";
+            case VideoScale::Down50:
+                return "down-50";
+            case VideoScale::Down75:
+                return "down-75";
+        }
+    }
+    return "auto";
+}
+
+std::optional<Settings::VideoScale> Settings::videoScaleFromStr(
+    std::string_view str) {
+    if (str == "auto") return VideoScale::Auto;
+    if (str == "off") return VideoScale::Off;
+    if (str == "down-25") return VideoScale::Down25;
+    if (str == "down-50") return VideoScale::Down50;
+    if (str == "down-75") return VideoScale::Down75;
+    return std::nullopt;
+}
+
 int Settings::toInt(const std::string& str) {
     try {
         return std::stoi(str);
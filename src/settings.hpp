@@ -28,6 +28,15 @@ struct Settings {
         InvertedLandscape
     };
     enum class VideoEncoder { Auto, X264, Nvenc, V4l2 };
+    enum class FragmentPolicy { Frame, Interval, Gop };
+    enum class TestSourcePattern { Bars, Scroll, Noise };
+    enum class VideoOverlayPosition {
+        TopLeft,
+        TopRight,
+        BottomLeft,
+        BottomRight
+    };
+    enum class VideoScale { Auto, Off, Down25, Down50, Down75 };
 
     static constexpr const char* sectionName = "General";
 
@@ -51,15 +60,64 @@ struct Settings {
     static constexpr const char* logRequestsOpt = "log-requests";
     static constexpr const char* logFileOpt = "log-file";
     static constexpr const char* audioSourceMutedOpt = "audio-source-muted";
+    static constexpr const char* standbyOpt = "standby";
+    static constexpr const char* sessionGracePeriodOpt = "session-grace-period";
+    static constexpr const char* fragmentPolicyOpt = "fragment-policy";
+    static constexpr const char* fragmentIntervalOpt = "fragment-interval";
+    static constexpr const char* alsaPeriodSizeOpt = "alsa-period-size";
+    static constexpr const char* v4l2QueueDepthOpt = "v4l2-queue-depth";
+    static constexpr const char* screenCaptureFramerateOpt =
+        "screen-capture-framerate";
+    static constexpr const char* v4l2PassthroughOpt = "v4l2-passthrough";
+    static constexpr const char* v4l2MjpegOpt = "v4l2-mjpeg";
+    static constexpr const char* videoOverlaySourcesOpt =
+        "video-overlay-sources";
+    static constexpr const char* videoOverlayPositionOpt =
+        "video-overlay-position";
+    static constexpr const char* videoOverlaySizeOpt = "video-overlay-size";
+    static constexpr const char* videoOverlayOpacityOpt =
+        "video-overlay-opacity";
+    static constexpr const char* audioMixSourcesOpt = "audio-mix-sources";
+    static constexpr const char* videoBitrateOpt = "video-bitrate";
+    static constexpr const char* videoScaleOpt = "video-scale";
+    static constexpr const char* videoFramerateOpt = "video-framerate";
+    static constexpr const char* audioBitrateOpt = "audio-bitrate";
+    static constexpr const char* recordDirOpt = "record-dir";
+    static constexpr const char* recordMaxSizeOpt = "record-max-size";
+    static constexpr const char* recordMaxDurationOpt = "record-max-duration";
+    static constexpr const char* timeShiftDurationOpt = "time-shift-duration";
+    static constexpr const char* timeShiftMaxSizeOpt = "time-shift-max-size";
+    // only url param
+    static constexpr const char* offsetOpt = "offset";
+    static constexpr const char* testSourceWidthOpt = "test-source-width";
+    static constexpr const char* testSourceHeightOpt = "test-source-height";
+    static constexpr const char* testSourceFramerateOpt =
+        "test-source-framerate";
+    static constexpr const char* testSourcePixfmtOpt = "test-source-pixfmt";
+    static constexpr const char* testSourcePatternOpt = "test-source-pattern";
+    static constexpr const char* testSourceMotionOpt = "test-source-motion";
+    static constexpr const char* testSourceEntropyOpt = "test-source-entropy";
+    static constexpr const char* synthAudioSourcesOpt = "synth-audio-sources";
+    static constexpr const char* synthAudioRateOpt = "synth-audio-rate";
+    static constexpr const char* synthAudioChannelsOpt = "synth-audio-channels";
+    static constexpr const char* synthAudioSampleFmtOpt =
+        "synth-audio-sample-fmt";
+    static constexpr const char* synthAudioFrequencyOpt =
+        "synth-audio-frequency";
 
     static constexpr const std::array urlOpts = {
-        streamFormatOpt, videoSourceNameOpt,  audioSourceNameOpt,
-        audioVolumeOpt,  audioSourceMutedOpt, videoOrientationOpt};
+        streamFormatOpt,   videoSourceNameOpt,  audioSourceNameOpt,
+        audioVolumeOpt,    audioSourceMutedOpt, videoOrientationOpt,
+        fragmentPolicyOpt, fragmentIntervalOpt, offsetOpt};
 
     static constexpr const std::array offValues = {
         "false", "no", "off", "0", "disable", "disabled"};
     static constexpr const std::array onValues = {"true", "yes",    "on",
                                                   "1",    "enable", "enabled"};
+    static constexpr const std::array testSourcePixfmts = {"0rgb", "bgr0",
+                                                           "yuv420p", "nv12"};
+    static constexpr const std::array synthAudioSampleFmts = {"s16", "s32",
+                                                              "flt"};
     bool debug = false;
     std::string debugFile;
     bool gui = false;
@@ -68,18 +126,54 @@ struct Settings {
     bool disableCtrlApi = false;
     bool logRequests = false;
     bool audioSourceMuted = false;
+    bool standby = false;
+    bool v4l2Passthrough = false;
+    bool v4l2Mjpeg = false;
+    bool synthAudioSources = false;
     int64_t port = 0;
     int audioVolume = 0;
+    int sessionGracePeriod = 0;  // ms
+    int fragmentInterval = 0;    // ms
+    int alsaPeriodSize = 0;      // frames
+    int v4l2QueueDepth = 0;
+    int screenCaptureFramerate = 0;
+    int videoOverlaySize = 0;     // % of output width
+    int videoOverlayOpacity = 0;  // %
+    int videoBitrate = 0;         // kbps
+    int videoFramerate = 0;
+    int audioBitrate = 0;       // kbps
+    int recordMaxSize = 0;      // MB
+    int recordMaxDuration = 0;  // s
+    int timeShiftDuration = 0;  // s
+    int timeShiftMaxSize = 0;   // MB
+    int timeShiftOffset = 0;    // s in the past, only from url
+    int testSourceWidth = 0;
+    int testSourceHeight = 0;
+    int testSourceFramerate = 0;
+    int testSourceMotion = 0;   // pixels per frame
+    int testSourceEntropy = 0;  // %
+    int synthAudioRate = 0;
+    int synthAudioChannels = 0;
+    int synthAudioFrequency = 0;  // Hz
     std::string urlPath;
     std::string ifname;
     std::string address;
     std::string logFile;
+    std::string recordDir;
     std::string configFile;
     std::string videoSourceName;
     std::string audioSourceName;
+    std::string testSourcePixfmt;
+    std::string videoOverlaySources;  // comma separated
+    std::string audioMixSources;      // comma separated
+    std::string synthAudioSampleFmt;
     std::optional<StreamFormat> streamFormat;
     std::optional<VideoOrientation> videoOrientation;
     std::optional<VideoEncoder> videoEncoder;
+    std::optional<FragmentPolicy> fragmentPolicy;
+    std::optional<TestSourcePattern> testSourcePattern;
+    std::optional<VideoOverlayPosition> videoOverlayPosition;
+    std::optional<VideoScale> videoScale;
 
     explicit Settings(const cxxopts::ParseResult& options);
     void updateFromStr(std::string_view key, std::string_view value);
@@ -92,6 +186,17 @@ struct Settings {
     std::string videoEncoderToStr() const;
     static std::optional<VideoEncoder> videoEncoderFromStr(
         std::string_view str);
+    std::string fragmentPolicyToStr() const;
+    static std::optional<FragmentPolicy> fragmentPolicyFromStr(
+        std::string_view str);
+    std::string testSourcePatternToStr() const;
+    static std::optional<TestSourcePattern> testSourcePatternFromStr(
+        std::string_view str);
+    std::string videoOverlayPositionToStr() const;
+    static std::optional<VideoOverlayPosition> videoOverlayPositionFromStr(
+        std::string_view str);
+    std::string videoScaleToStr() const;
+    static std::optional<VideoScale> videoScaleFromStr(std::string_view str);
 
     void saveToFile() const;
     void loadFromFile();
@@ -0,0 +1,208 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "synthaudiosource.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "logger.hpp"
+
+static constexpr const double twoPi = 2.0 * M_PI;
+
+std::ostream &operator<<(std::ostream &os, SynthAudioSource::Signal signal) {
+    switch (signal) {
+        case SynthAudioSource::Signal::Sine:
+            os << "sine";
+            break;
+        case SynthAudioSource::Signal::Chirp:
+            os << "chirp";
+            break;
+        case SynthAudioSource::Signal::Noise:
+            os << "noise";
+            break;
+        case SynthAudioSource::Signal::Click:
+            os << "click";
+            break;
+    }
+
+    return os;
+}
+
+std::ostream &operator<<(std::ostream &os,
+                         const SynthAudioSource::Props &props) {
+    os << "signal=" << props.signal << ", rate=" << props.rate
+       << ", channels=" << static_cast<int>(props.channels)
+       << ", sample-fmt=" << av_get_sample_fmt_name(props.sampleFmt)
+       << ", frequency=" << props.frequency;
+    return os;
+}
+
+SynthAudioSource::SynthAudioSource(Props props,
+                                   DataReadyHandler dataReadyHandler)
+    : m_props{props}, m_dataReadyHandler{std::move(dataReadyHandler)} {
+    LOGD("creating synth audio source: " << m_props);
+
+    if (!propsValid(m_props))
+        throw std::runtime_error("invalid synth audio source props");
+
+    const auto frames = m_props.rate / m_periodsPerSec;
+
+    m_samples.resize(frames * m_props.channels);
+    m_buf.resize(m_samples.size() *
+                 av_get_bytes_per_sample(m_props.sampleFmt));
+}
+
+SynthAudioSource::~SynthAudioSource() {
+    LOGD("synth audio source termination started");
+    m_termination = true;
+    if (m_thread.joinable()) m_thread.join();
+    LOGD("synth audio source termination completed");
+}
+
+bool SynthAudioSource::supported() noexcept { return true; }
+
+bool SynthAudioSource::propsValid(const Props &props) {
+    switch (props.sampleFmt) {
+        case AV_SAMPLE_FMT_S16:
+        case AV_SAMPLE_FMT_S32:
+        case AV_SAMPLE_FMT_FLT:
+            break;
+        default:
+            LOGW("synth audio sample fmt not supported: " << props.sampleFmt);
+            return false;
+    }
+
+    // rate has to be divisible into equal periods
+    if (props.rate < 8000 || props.rate > 192000 ||
+        props.rate % m_periodsPerSec != 0) {
+        LOGW("synth audio rate is invalid: " << props.rate);
+        return false;
+    }
+
+    if (props.channels < 1 || props.channels > 8) {
+        LOGW("synth audio channels is invalid: "
+             << static_cast<int>(props.channels));
+        return false;
+    }
+
+    if (props.frequency < 1 || props.frequency >= props.rate / 2) {
+        LOGW("synth audio frequency is invalid: " << props.frequency);
+        return false;
+    }
+
+    return true;
+}
+
+std::vector<SynthAudioSource::Signal> SynthAudioSource::signals() {
+    return {Signal::Sine, Signal::Chirp, Signal::Noise, Signal::Click};
+}
+
+float SynthAudioSource::nextSample() {
+    const auto rate = static_cast<double>(m_props.rate);
+    const auto pos = static_cast<double>(m_sampleCount++) / rate;
+
+    double value = 0.0;
+
+    switch (m_props.signal) {
+        case Signal::Sine:
+            value = std::sin(m_phase);
+            m_phase += twoPi * m_props.frequency / rate;
+            break;
+        case Signal::Chirp: {
+            const auto maxFreq = std::min(20000.0, 0.45 * rate);
+            const auto freq =
+                m_chirpMinFreq *
+                std::pow(maxFreq / m_chirpMinFreq,
+                         std::fmod(pos, m_chirpDuration) / m_chirpDuration);
+            value = std::sin(m_phase);
+            m_phase += twoPi * freq / rate;
+            break;
+        }
+        case Signal::Noise:
+            m_randState ^= m_randState << 13;
+            m_randState ^= m_randState >> 7;
+            m_randState ^= m_randState << 17;
+            value = static_cast<double>(m_randState >> 11) * 0x1.0p-52 - 1.0;
+            break;
+        case Signal::Click:
+            // beep starts exactly at second boundary of stream time
+            if (std::fmod(pos, 1.0) < m_clickDuration) {
+                value = std::sin(m_phase);
+                m_phase += twoPi * m_props.frequency / rate;
+            } else {
+                m_phase = 0.0;
+            }
+            break;
+    }
+
+    if (m_phase > twoPi) m_phase -= twoPi;
+
+    return static_cast<float>(m_amplitude * value);
+}
+
+void SynthAudioSource::convertSamples() {
+    switch (m_props.sampleFmt) {
+        case AV_SAMPLE_FMT_S16: {
+            auto *out = reinterpret_cast<int16_t *>(m_buf.data());
+            std::transform(m_samples.cbegin(), m_samples.cend(), out,
+                           [](float s) {
+                               return static_cast<int16_t>(
+                                   std::lrint(s * INT16_MAX));
+                           });
+            break;
+        }
+        case AV_SAMPLE_FMT_S32: {
+            auto *out = reinterpret_cast<int32_t *>(m_buf.data());
+            std::transform(m_samples.cbegin(), m_samples.cend(), out,
+                           [](float s) {
+                               return static_cast<int32_t>(std::lrint(
+                                   static_cast<double>(s) * INT32_MAX));
+                           });
+            break;
+        }
+        case AV_SAMPLE_FMT_FLT:
+            memcpy(m_buf.data(), m_samples.data(), m_buf.size());
+            break;
+        default:
+            throw std::runtime_error("unsupported synth audio sample fmt");
+    }
+}
+
+void SynthAudioSource::generate() {
+    for (auto it = m_samples.begin(); it != m_samples.end();
+         it += m_props.channels)
+        std::fill_n(it, m_props.channels, nextSample());
+
+    convertSamples();
+}
+
+void SynthAudioSource::start() {
+    m_thread = std::thread([this] {
+        LOGD("synth audio source thread started");
+
+        const auto startTime = std::chrono::steady_clock::now();
+
+        while (!m_termination) {
+            generate();
+
+            // deadline is derived from total number of samples, so timer
+            // error does not accumulate
+            std::this_thread::sleep_until(
+                startTime + std::chrono::microseconds{static_cast<int64_t>(
+                                m_sampleCount * 1000000 / m_props.rate)});
+
+            if (m_dataReadyHandler)
+                m_dataReadyHandler(m_buf.data(), m_buf.size());
+        }
+
+        LOGD("synth audio source thread ended");
+    });
+}
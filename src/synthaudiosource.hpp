@@ -0,0 +1,72 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SYNTHAUDIOSOURCE_HPP
+#define SYNTHAUDIOSOURCE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavutil/samplefmt.h>
+}
+
+class SynthAudioSource {
+   public:
+    using DataReadyHandler = std::function<void(const uint8_t *, size_t)>;
+
+    enum class Signal {
+        Sine,
+        Chirp,  // logarithmic sweep, repeated every m_chirpDuration
+        Noise,
+        Click  // short beep at the beginning of every second
+    };
+    friend std::ostream &operator<<(std::ostream &os, Signal signal);
+
+    struct Props {
+        Signal signal = Signal::Sine;
+        uint32_t rate = 48000;
+        uint8_t channels = 2;
+        AVSampleFormat sampleFmt = AV_SAMPLE_FMT_S16;
+        uint32_t frequency = 1000;  // Hz, used with sine and click
+        friend std::ostream &operator<<(std::ostream &os, const Props &props);
+    };
+
+    SynthAudioSource(Props props, DataReadyHandler dataReadyHandler);
+    ~SynthAudioSource();
+    void start();
+    static bool supported() noexcept;
+    static bool propsValid(const Props &props);
+    static std::vector<Signal> signals();
+
+   private:
+    static const uint32_t m_periodsPerSec = 100;  // 10 ms periods
+    static constexpr const double m_amplitude = 0.5;
+    static constexpr const double m_chirpDuration = 5.0;  // s
+    static constexpr const double m_chirpMinFreq = 20.0;  // Hz
+    static constexpr const double m_clickDuration = 0.01;  // s
+
+    Props m_props;
+    DataReadyHandler m_dataReadyHandler;
+    std::vector<uint8_t> m_buf;
+    std::vector<float> m_samples;
+    uint64_t m_sampleCount = 0;
+    double m_phase = 0.0;
+    uint64_t m_randState = 0x2545F4914F6CDD1DULL;
+    std::thread m_thread;
+    std::atomic_bool m_termination{false};
+
+    void generate();
+    float nextSample();
+    void convertSamples();
+};
+
+#endif  // SYNTHAUDIOSOURCE_HPP
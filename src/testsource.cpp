@@ -7,14 +7,101 @@
 
 #include "testsource.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <cstring>
+#include <stdexcept>
+#include <string>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
 
 #include "logger.hpp"
 
-TestSource::TestSource(DataReadyHandler dataReadyHandler)
-    : m_dataReadyHandler{std::move(dataReadyHandler)}, m_props(properties()) {
-    LOGD("creating test source");
+std::ostream &operator<<(std::ostream &os, TestSource::Pattern pattern) {
+    switch (pattern) {
+        case TestSource::Pattern::Bars:
+            os << "bars";
+            break;
+        case TestSource::Pattern::Scroll:
+            os << "scroll";
+            break;
+        case TestSource::Pattern::Noise:
+            os << "noise";
+            break;
+    }
+
+    return os;
+}
+
+std::ostream &operator<<(std::ostream &os, const TestSource::Props &props) {
+    os << "width=" << props.width << ", height=" << props.height
+       << ", framerate=" << props.framerate
+       << ", pixfmt=" << av_get_pix_fmt_name(props.pixfmt)
+       << ", pattern=" << props.pattern << ", motion=" << props.motion
+       << ", entropy=" << props.entropy;
+    return os;
+}
+
+// 3x5 digit glyphs, one byte per glyph row
+static constexpr const uint8_t digitGlyphs[10][5] = {
+    {0b111, 0b101, 0b101, 0b101, 0b111}, {0b010, 0b110, 0b010, 0b010, 0b111},
+    {0b111, 0b001, 0b111, 0b100, 0b111}, {0b111, 0b001, 0b111, 0b001, 0b111},
+    {0b101, 0b101, 0b111, 0b001, 0b001}, {0b111, 0b100, 0b111, 0b001, 0b111},
+    {0b111, 0b100, 0b111, 0b101, 0b111}, {0b111, 0b001, 0b001, 0b001, 0b001},
+    {0b111, 0b101, 0b111, 0b101, 0b111}, {0b111, 0b101, 0b111, 0b001, 0b111}};
+
+static std::array<uint8_t, 3> rgbToYuv(uint8_t r, uint8_t g, uint8_t b) {
+    // bt.601 limited range
+    return {static_cast<uint8_t>(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8)),
+            static_cast<uint8_t>(128 +
+                                 ((-38 * r - 74 * g + 112 * b + 128) >> 8)),
+            static_cast<uint8_t>(128 +
+                                 ((112 * r - 94 * g - 18 * b + 128) >> 8))};
+}
+
+// span is filled by doubling already written part, so long spans are
+// copied with wide stores instead of pixel by pixel
+static void fillSpan(uint8_t *dst, const uint8_t *px, size_t pxSize,
+                     size_t count) {
+    const auto total = pxSize * count;
+    if (total == 0) return;
+
+    memcpy(dst, px, pxSize);
+
+    for (size_t filled = pxSize; filled < total;) {
+        const auto size = std::min(filled, total - filled);
+        memcpy(dst + filled, dst, size);
+        filled += size;
+    }
+}
+
+static void fillBlock(uint8_t *dst, int linesize, int rows, const uint8_t *px,
+                      size_t pxSize, size_t count) {
+    fillSpan(dst, px, pxSize, count);
+    for (int i = 1; i < rows; ++i)
+        memcpy(dst + i * linesize, dst, pxSize * count);
+}
+
+TestSource::TestSource(Props props, DataReadyHandler dataReadyHandler)
+    : m_props{props}, m_dataReadyHandler{std::move(dataReadyHandler)} {
+    LOGD("creating test source: " << m_props);
+
+    if (!propsValid(m_props))
+        throw std::runtime_error("invalid test source props");
+
+    const auto w = static_cast<int>(m_props.width);
+    const auto h = static_cast<int>(m_props.height);
+
+    m_frame.resize(av_image_get_buffer_size(m_props.pixfmt, w, h, 1));
+
+    if (av_image_fill_arrays(m_planes.data(), m_linesizes.data(),
+                             m_frame.data(), m_props.pixfmt, w, h, 1) < 0)
+        throw std::runtime_error("av_image_fill_arrays error");
+
+    renderBackground();
+    m_background = m_frame;
 }
 
 TestSource::~TestSource() {
@@ -26,56 +113,257 @@ TestSource::~TestSource() {
 
 bool TestSource::supported() noexcept { return true; }
 
-TestSource::Props TestSource::properties() {
-    return {200, 800, 15, AV_PIX_FMT_0RGB};
+bool TestSource::propsValid(const Props &props) {
+    switch (props.pixfmt) {
+        case AV_PIX_FMT_0RGB:
+        case AV_PIX_FMT_BGR0:
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_NV12:
+            break;
+        default:
+            LOGW("test source pixfmt not supported: " << props.pixfmt);
+            return false;
+    }
+
+    // caster expects raw frames with lines aligned to 32 bytes, so even
+    // chroma lines have to be aligned without padding
+    if (props.width == 0 || props.width % 64 != 0 || props.height == 0 ||
+        props.height % 2 != 0) {
+        LOGW("test source dim is invalid: " << props.width << "x"
+                                            << props.height);
+        return false;
+    }
+
+    if (props.framerate == 0 || props.framerate > 120) {
+        LOGW("test source framerate is invalid: " << props.framerate);
+        return false;
+    }
+
+    if (props.entropy > 100) {
+        LOGW("test source entropy is invalid: " << props.entropy);
+        return false;
+    }
+
+    return true;
 }
 
-std::vector<uint8_t> TestSource::generateImage(uint32_t width,
-                                               uint32_t height) {
-    const size_t stride = 4 * static_cast<size_t>(width);
+void TestSource::fillRect(int x, int y, int w, int h, Color color) {
+    const auto width = static_cast<int>(m_props.width);
+    const auto height = static_cast<int>(m_props.height);
 
-    const uint8_t red[] = {0x00, 0xFF, 0x00, 0x00};
-    const uint8_t green[] = {0x00, 0x00, 0xFF, 0x00};
-    const uint8_t blue[] = {0x00, 0x00, 0x00, 0xFF};
+    const auto x0 = std::clamp(x, 0, width);
+    const auto x1 = std::clamp(x + w, 0, width);
+    const auto y0 = std::clamp(y, 0, height);
+    const auto y1 = std::clamp(y + h, 0, height);
+    if (x0 >= x1 || y0 >= y1) return;
 
-    std::vector<uint8_t> data;
-    data.resize(stride * height);
+    const auto cols = static_cast<size_t>(x1 - x0);
+    const auto rows = y1 - y0;
 
-    const auto* pixel = red;
-    const auto rowHeight = height / 3;
+    switch (m_props.pixfmt) {
+        case AV_PIX_FMT_0RGB: {
+            const uint8_t px[] = {0, color.r, color.g, color.b};
+            fillBlock(m_planes[0] + y0 * m_linesizes[0] + x0 * 4,
+                      m_linesizes[0], rows, px, 4, cols);
+            break;
+        }
+        case AV_PIX_FMT_BGR0: {
+            const uint8_t px[] = {color.b, color.g, color.r, 0};
+            fillBlock(m_planes[0] + y0 * m_linesizes[0] + x0 * 4,
+                      m_linesizes[0], rows, px, 4, cols);
+            break;
+        }
+        case AV_PIX_FMT_YUV420P:
+        case AV_PIX_FMT_NV12: {
+            const auto yuv = rgbToYuv(color.r, color.g, color.b);
 
-    for (size_t i = 0; i < height; ++i) {
-        auto* beg = &data[i * stride];
+            fillBlock(m_planes[0] + y0 * m_linesizes[0] + x0, m_linesizes[0],
+                      rows, &yuv[0], 1, cols);
 
-        for (size_t ii = 0; ii < stride; ii += 4) memcpy(&beg[ii], pixel, 4);
+            const auto cx0 = x0 / 2;
+            const auto cy0 = y0 / 2;
+            const auto ccols = static_cast<size_t>((x1 + 1) / 2 - cx0);
+            const auto crows = (y1 + 1) / 2 - cy0;
 
-        if (i > 0 && i % rowHeight == 0) {
-            if (pixel == red)
-                pixel = green;
-            else if (pixel == green)
-                pixel = blue;
-            else
-                pixel = red;
+            if (m_props.pixfmt == AV_PIX_FMT_NV12) {
+                fillBlock(m_planes[1] + cy0 * m_linesizes[1] + cx0 * 2,
+                          m_linesizes[1], crows, &yuv[1], 2, ccols);
+            } else {
+                fillBlock(m_planes[1] + cy0 * m_linesizes[1] + cx0,
+                          m_linesizes[1], crows, &yuv[1], 1, ccols);
+                fillBlock(m_planes[2] + cy0 * m_linesizes[2] + cx0,
+                          m_linesizes[2], crows, &yuv[2], 1, ccols);
+            }
+            break;
         }
+        default:
+            throw std::runtime_error("unsupported test source pixfmt");
     }
+}
+
+void TestSource::renderBackground() {
+    const auto w = static_cast<int>(m_props.width);
+    const auto h = static_cast<int>(m_props.height);
+
+    switch (m_props.pattern) {
+        case Pattern::Bars: {
+            const Color top[] = {{191, 191, 191}, {191, 191, 0}, {0, 191, 191},
+                                 {0, 191, 0},     {191, 0, 191}, {191, 0, 0},
+                                 {0, 0, 191}};
+            const Color middle[] = {{0, 0, 191},   {19, 19, 19},
+                                    {191, 0, 191}, {19, 19, 19},
+                                    {0, 191, 191}, {19, 19, 19},
+                                    {191, 191, 191}};
+            const Color bottom[] = {
+                {0, 33, 76}, {255, 255, 255}, {50, 0, 106}, {19, 19, 19}};
+
+            const auto topH = h * 2 / 3;
+            const auto middleH = h / 12;
+
+            for (int i = 0; i < 7; ++i) {
+                const auto x = w * i / 7;
+                const auto bw = w * (i + 1) / 7 - x;
+                fillRect(x, 0, bw, topH, top[i]);
+                fillRect(x, topH, bw, middleH, middle[i]);
+            }
 
-    return data;
+            for (int i = 0; i < 4; ++i) {
+                const auto x = w * i / 4;
+                fillRect(x, topH + middleH, w * (i + 1) / 4 - x,
+                         h - topH - middleH, bottom[i]);
+            }
+            break;
+        }
+        case Pattern::Scroll:
+            fillRect(0, 0, w, h, {});
+            break;
+        case Pattern::Noise:
+            break;
+    }
+}
+
+void TestSource::renderScrollText() {
+    const auto w = static_cast<int>(m_props.width);
+    const auto h = static_cast<int>(m_props.height);
+
+    const auto scale = std::max(h / 48, 1);
+    const auto lineHeight = 7 * scale;
+    const auto advance = 4 * scale;
+
+    auto text = std::to_string(m_frameCount);
+    text.insert(0, text.size() < 8 ? 8 - text.size() : 0, '0');
+
+    const auto period = static_cast<int>(text.size() + 2) * advance;
+    const auto shift =
+        static_cast<int>((m_frameCount * m_props.motion) % period);
+
+    for (int line = 0; line * lineHeight < h; ++line) {
+        // neighbour lines scroll in opposite directions
+        const auto offset = line % 2 == 0 ? -shift : shift - period;
+        const auto y = line * lineHeight + scale;
+
+        for (auto x = offset; x < w; x += period) {
+            for (size_t i = 0; i < text.size(); ++i) {
+                const auto &glyph = digitGlyphs[text[i] - '0'];
+                const auto gx = x + static_cast<int>(i) * advance;
+
+                for (int row = 0; row < 5; ++row)
+                    for (int col = 0; col < 3; ++col)
+                        if (glyph[row] & (0b100 >> col))
+                            fillRect(gx + col * scale, y + row * scale, scale,
+                                     scale, {255, 255, 255});
+            }
+        }
+    }
+}
+
+void TestSource::fillNoise(uint8_t *data, size_t size) {
+    // four independent xorshift lanes, so generator can be vectorized
+    uint64_t lanes[4];
+    for (int i = 0; i < 4; ++i)
+        lanes[i] = m_randState ^ (0x9E3779B97F4A7C15ULL * (i + 1));
+
+    size_t i = 0;
+    for (; i + sizeof(lanes) <= size; i += sizeof(lanes)) {
+        for (auto &s : lanes) {
+            s ^= s << 13;
+            s ^= s >> 7;
+            s ^= s << 17;
+        }
+        memcpy(data + i, lanes, sizeof(lanes));
+    }
+
+    if (i < size) memcpy(data + i, lanes, size - i);
+
+    m_randState = lanes[0] ^ lanes[3];
+}
+
+void TestSource::renderNoise(uint32_t entropy) {
+    const auto h = static_cast<int>(m_props.height);
+
+    for (size_t p = 0; p < m_planes.size() && m_planes[p] != nullptr; ++p) {
+        const auto rows = p == 0 ? h : h / 2;
+
+        for (int row = 0; row < rows; ++row) {
+            if (static_cast<uint32_t>(row % 100) >= entropy) continue;
+            fillNoise(m_planes[p] + row * m_linesizes[p],
+                      static_cast<size_t>(m_linesizes[p]));
+        }
+    }
+}
+
+void TestSource::renderFrame() {
+    if (m_props.pattern != Pattern::Noise)
+        memcpy(m_frame.data(), m_background.data(), m_frame.size());
+
+    switch (m_props.pattern) {
+        case Pattern::Bars: {
+            const auto w = static_cast<int>(m_props.width);
+            const auto barW = std::max(w / 32, 2);
+            const auto x = static_cast<int>((m_frameCount * m_props.motion) %
+                                            m_props.width);
+            fillRect(x, 0, barW, static_cast<int>(m_props.height),
+                     {255, 255, 255});
+            if (x + barW > w)
+                fillRect(x - w, 0, barW, static_cast<int>(m_props.height),
+                         {255, 255, 255});
+            break;
+        }
+        case Pattern::Scroll:
+            renderScrollText();
+            break;
+        case Pattern::Noise:
+            renderNoise(100);
+            break;
+    }
+
+    if (m_props.pattern != Pattern::Noise && m_props.entropy > 0)
+        renderNoise(m_props.entropy);
+
+    ++m_frameCount;
 }
 
 void TestSource::start() {
     m_thread = std::thread([this] {
         LOGD("test source thread started");
-        const auto sleepDur = std::chrono::microseconds{
+
+        const auto period = std::chrono::microseconds{
             static_cast<int>(1000000.0 / m_props.framerate)};
 
-        auto data = generateImage(m_props.width, m_props.height);
+        auto next = std::chrono::steady_clock::now();
 
         while (!m_termination) {
-            if (m_dataReadyHandler) {
-                m_dataReadyHandler(data.data(), data.size());
-            }
-            std::this_thread::sleep_for(sleepDur);
+            renderFrame();
+
+            if (m_dataReadyHandler)
+                m_dataReadyHandler(m_frame.data(), m_frame.size());
+
+            // rendering time is not added to frame duration
+            next += period;
+            next = std::max(next, std::chrono::steady_clock::now());
+            std::this_thread::sleep_until(next);
         }
+
         LOGD("test source thread ended");
     });
 }
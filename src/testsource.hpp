@@ -8,9 +8,11 @@
 #ifndef TESTSOURCE_HPP
 #define TESTSOURCE_HPP
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <functional>
-#include <optional>
+#include <ostream>
 #include <thread>
 #include <vector>
 
@@ -22,26 +24,55 @@ class TestSource {
    public:
     using DataReadyHandler = std::function<void(const uint8_t *, size_t)>;
 
+    enum class Pattern {
+        Bars,   // smpte color bars with moving vertical bar
+        Scroll, // scrolling frame counter
+        Noise   // random data in every frame
+    };
+    friend std::ostream &operator<<(std::ostream &os, Pattern pattern);
+
     struct Props {
-        uint32_t width = 0;
-        uint32_t height = 0;
-        uint32_t framerate = 0;
-        AVPixelFormat pixfmt = AV_PIX_FMT_NONE;
+        uint32_t width = 1280;
+        uint32_t height = 720;
+        uint32_t framerate = 30;
+        AVPixelFormat pixfmt = AV_PIX_FMT_YUV420P;
+        Pattern pattern = Pattern::Bars;
+        uint32_t motion = 4;   // pixels per frame
+        uint32_t entropy = 0;  // % of rows overwritten with noise
+        friend std::ostream &operator<<(std::ostream &os, const Props &props);
     };
 
-    explicit TestSource(DataReadyHandler dataReadyHandler);
+    TestSource(Props props, DataReadyHandler dataReadyHandler);
     ~TestSource();
     void start();
     static bool supported() noexcept;
-    static Props properties();
+    static bool propsValid(const Props &props);
 
    private:
-    DataReadyHandler m_dataReadyHandler;
+    struct Color {
+        uint8_t r = 0;
+        uint8_t g = 0;
+        uint8_t b = 0;
+    };
+
     Props m_props;
+    DataReadyHandler m_dataReadyHandler;
+    // background is rendered once, frame buffer is reused for every frame
+    std::vector<uint8_t> m_background;
+    std::vector<uint8_t> m_frame;
+    std::array<uint8_t *, 4> m_planes{};
+    std::array<int, 4> m_linesizes{};
+    uint64_t m_frameCount = 0;
+    uint64_t m_randState = 0x2545F4914F6CDD1DULL;
     std::thread m_thread;
-    bool m_termination = false;
+    std::atomic_bool m_termination{false};
 
-    static std::vector<uint8_t> generateImage(uint32_t width, uint32_t height);
+    void renderBackground();
+    void renderFrame();
+    void renderScrollText();
+    void renderNoise(uint32_t entropy);
+    void fillRect(int x, int y, int w, int h, Color color);
+    void fillNoise(uint8_t *data, size_t size);
 };
 
 #endif  // TESTSOURCE_HPP
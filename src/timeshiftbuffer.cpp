@@ -0,0 +1,82 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "timeshiftbuffer.hpp"
+
+#include <iterator>
+
+#include "logger.hpp"
+
+std::ostream &operator<<(std::ostream &os,
+                         const TimeShiftBuffer::Props &props) {
+    os << "duration=" << props.duration.count()
+       << ", max-size=" << props.maxSize;
+    return os;
+}
+
+TimeShiftBuffer::TimeShiftBuffer(Props props) : m_props{props} {
+    LOGD("creating time-shift buffer: " << m_props);
+}
+
+void TimeShiftBuffer::clear() {
+    LOGD("time-shift buffer cleared");
+
+    m_segments.clear();
+    m_size = 0;
+}
+
+void TimeShiftBuffer::push(const uint8_t *data, size_t size, bool syncPoint) {
+    const auto now = Clock::now();
+
+    if (syncPoint && (m_segments.empty() ||
+                      now - m_segments.back().time >= m_minSegmentDur)) {
+        auto &segment = m_segments.emplace_back();
+        segment.time = now;
+        trim(now);
+    }
+
+    if (m_segments.empty()) return;
+
+    auto &segment = m_segments.back().data;
+    segment.insert(segment.end(), data, data + size);
+    m_size += size;
+}
+
+void TimeShiftBuffer::trim(Clock::time_point now) {
+    // the newest segment is always kept
+    while (m_segments.size() > 1 &&
+           (m_size > m_props.maxSize ||
+            now - m_segments.front().time > m_props.duration)) {
+        m_size -= m_segments.front().data.size();
+        m_segments.pop_front();
+    }
+}
+
+std::chrono::seconds TimeShiftBuffer::read(std::chrono::seconds offset,
+                                           const DataHandler &handler) const {
+    if (m_segments.empty()) return {};
+
+    const auto now = Clock::now();
+    const auto target = now - offset;
+
+    auto it = m_segments.cbegin();
+    for (auto next = std::next(it);
+         next != m_segments.cend() && next->time <= target; ++next)
+        it = next;
+
+    const auto actualOffset =
+        std::chrono::duration_cast<std::chrono::seconds>(now - it->time);
+
+    LOGD("time-shift read: requested=" << offset.count()
+                                       << "s, actual=" << actualOffset.count()
+                                       << "s");
+
+    for (; it != m_segments.cend(); ++it)
+        if (!it->data.empty()) handler(it->data.data(), it->data.size());
+
+    return actualOffset;
+}
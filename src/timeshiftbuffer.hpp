@@ -0,0 +1,60 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef TIMESHIFTBUFFER_HPP
+#define TIMESHIFTBUFFER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+// Window of recently muxed stream. Data is split into segments starting at
+// sync points (key frames), so segment list is also an index used to start
+// playback from the past without re-encoding.
+class TimeShiftBuffer {
+   public:
+    using DataHandler = std::function<void(const uint8_t *, size_t)>;
+
+    struct Props {
+        std::chrono::seconds duration{0};
+        size_t maxSize = 0;  // bytes
+        friend std::ostream &operator<<(std::ostream &os, const Props &props);
+    };
+
+    explicit TimeShiftBuffer(Props props);
+    void clear();
+    // data before first sync point is dropped
+    void push(const uint8_t *data, size_t size, bool syncPoint);
+    // passes data starting at the latest sync point not newer than
+    // offset, returns actual offset
+    std::chrono::seconds read(std::chrono::seconds offset,
+                              const DataHandler &handler) const;
+    inline auto size() const { return m_size; }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    // sync points closer than that are merged into one segment
+    static constexpr const std::chrono::milliseconds m_minSegmentDur{250};
+
+    struct Segment {
+        Clock::time_point time;
+        std::vector<uint8_t> data;
+    };
+
+    Props m_props;
+    std::deque<Segment> m_segments;
+    size_t m_size = 0;
+
+    void trim(Clock::time_point now);
+};
+
+#endif  // TIMESHIFTBUFFER_HPP
@@ -0,0 +1,314 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "v4l2source.hpp"
+
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/time.h>
+}
+
+#include "fftools.hpp"
+#include "logger.hpp"
+
+std::ostream &operator<<(std::ostream &os, const V4l2Source::Props &props) {
+    os << "dev=" << props.dev << ", width=" << props.width
+       << ", height=" << props.height << ", framerate=" << props.framerate
+       << ", pixfmt=" << av_get_pix_fmt_name(props.pixfmt)
+       << ", queue-depth=" << props.queueDepth;
+    return os;
+}
+
+static int xioctl(int fd, unsigned long request, void *arg) {
+    int ret;
+    do {
+        ret = ioctl(fd, request, arg);
+    } while (ret == -1 && errno == EINTR);
+    return ret;
+}
+
+V4l2Source::Device::~Device() {
+    for (auto &buf : buffers) {
+        if (buf.data != nullptr) munmap(buf.data, buf.size);
+    }
+
+    if (fd >= 0) close(fd);
+
+    LOGD("v4l2 device closed");
+}
+
+void V4l2Source::Device::queueBuffer(uint32_t index) const {
+    v4l2_buffer buf{};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+
+    if (xioctl(fd, VIDIOC_QBUF, &buf) < 0)
+        LOGW("v4l2 qbuf error: " << strerror(errno));
+}
+
+V4l2Source::V4l2Source(Props props, FrameReadyHandler frameReadyHandler,
+                       ErrorHandler errorHandler)
+    : m_props{std::move(props)},
+      m_frameReadyHandler{std::move(frameReadyHandler)},
+      m_errorHandler{std::move(errorHandler)},
+      m_device{std::make_shared<Device>()} {
+    LOGD("creating v4l2 source: " << m_props);
+
+    m_device->fd = open(m_props.dev.c_str(), O_RDWR | O_NONBLOCK);
+    if (m_device->fd < 0) {
+        LOGE("failed to open v4l2 dev: " << strerror(errno));
+        throw std::runtime_error("v4l2 open error");
+    }
+
+    setFormat();
+    setFramerate();
+    allocBuffers();
+
+    LOGD("v4l2 source created");
+}
+
+V4l2Source::~V4l2Source() {
+    LOGD("v4l2 source termination started");
+    clean();
+    LOGD("v4l2 source termination completed");
+}
+
+void V4l2Source::clean() {
+    m_termination = true;
+    if (m_thread.joinable()) m_thread.join();
+
+    if (m_device->streaming) {
+        m_device->streaming = false;
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(m_device->fd, VIDIOC_STREAMOFF, &type);
+    }
+}
+
+bool V4l2Source::supported() noexcept { return true; }
+
+void V4l2Source::setFormat() {
+    const auto pixelformat =
+        ff_tools::ff_fmt_ff2v4l(m_props.pixfmt, AV_CODEC_ID_RAWVIDEO);
+    if (pixelformat == 0)
+        throw std::runtime_error("pixfmt not supported by v4l2 source");
+
+    v4l2_format fmt{};
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = m_props.width;
+    fmt.fmt.pix.height = m_props.height;
+    fmt.fmt.pix.pixelformat = pixelformat;
+    fmt.fmt.pix.field = V4L2_FIELD_ANY;
+
+    if (xioctl(m_device->fd, VIDIOC_S_FMT, &fmt) < 0) {
+        LOGE("v4l2 s_fmt error: " << strerror(errno));
+        throw std::runtime_error("v4l2 s_fmt error");
+    }
+
+    if (fmt.fmt.pix.width != m_props.width ||
+        fmt.fmt.pix.height != m_props.height ||
+        fmt.fmt.pix.pixelformat != pixelformat) {
+        LOGE("v4l2 format not accepted by driver: "
+             << fmt.fmt.pix.width << "x" << fmt.fmt.pix.height);
+        throw std::runtime_error("v4l2 format error");
+    }
+
+    m_bytesperline = fmt.fmt.pix.bytesperline;
+
+    LOGD("v4l2 format: bytesperline=" << m_bytesperline
+                                      << ", sizeimage="
+                                      << fmt.fmt.pix.sizeimage);
+}
+
+void V4l2Source::setFramerate() {
+    v4l2_streamparm parm{};
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    parm.parm.capture.timeperframe.numerator = 1;
+    parm.parm.capture.timeperframe.denominator = m_props.framerate;
+
+    if (xioctl(m_device->fd, VIDIOC_S_PARM, &parm) < 0)
+        LOGW("v4l2 s_parm error: " << strerror(errno));
+}
+
+void V4l2Source::allocBuffers() {
+    v4l2_requestbuffers req{};
+    req.count = m_props.queueDepth;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+
+    if (xioctl(m_device->fd, VIDIOC_REQBUFS, &req) < 0) {
+        LOGE("v4l2 reqbufs error: " << strerror(errno));
+        throw std::runtime_error("v4l2 reqbufs error");
+    }
+
+    if (req.count < 2) throw std::runtime_error("not enough v4l2 buffers");
+
+    if (req.count != m_props.queueDepth)
+        LOGW("v4l2 queue depth adjusted: " << m_props.queueDepth << " => "
+                                           << req.count);
+
+    m_device->buffers.resize(req.count);
+
+    for (uint32_t i = 0; i < req.count; ++i) {
+        v4l2_buffer vbuf{};
+        vbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        vbuf.memory = V4L2_MEMORY_MMAP;
+        vbuf.index = i;
+
+        if (xioctl(m_device->fd, VIDIOC_QUERYBUF, &vbuf) < 0) {
+            LOGE("v4l2 querybuf error: " << strerror(errno));
+            throw std::runtime_error("v4l2 querybuf error");
+        }
+
+        auto *data = mmap(nullptr, vbuf.length, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, m_device->fd, vbuf.m.offset);
+        if (data == MAP_FAILED) {
+            LOGE("v4l2 mmap error: " << strerror(errno));
+            throw std::runtime_error("v4l2 mmap error");
+        }
+
+        auto &buf = m_device->buffers[i];
+        buf.data = data;
+        buf.size = vbuf.length;
+    }
+
+    LOGD("v4l2 buffers allocated: count=" << req.count);
+}
+
+void V4l2Source::start() {
+    LOGD("starting v4l2 source");
+
+    for (uint32_t i = 0; i < m_device->buffers.size(); ++i)
+        m_device->queueBuffer(i);
+
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(m_device->fd, VIDIOC_STREAMON, &type) < 0) {
+        LOGE("v4l2 streamon error: " << strerror(errno));
+        throw std::runtime_error("v4l2 streamon error");
+    }
+
+    m_device->streaming = true;
+
+    m_thread = std::thread{[this] {
+        LOGD("v4l2 source thread started");
+        try {
+            doCapture();
+        } catch (const std::runtime_error &e) {
+            LOGE("error in v4l2 source thread: " << e.what());
+            if (m_errorHandler) m_errorHandler();
+        }
+        LOGD("v4l2 source thread ended");
+    }};
+}
+
+void V4l2Source::doCapture() {
+    // driver timestamps are monotonic, but capture time is wall clock
+    const auto clockOffset = av_gettime() - av_gettime_relative();
+
+    pollfd pfd{m_device->fd, POLLIN, 0};
+
+    while (!m_termination) {
+        auto ret = poll(&pfd, 1, m_maxWait);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("v4l2 poll error");
+        }
+        if (ret == 0) continue;  // timeout
+
+        v4l2_buffer buf{};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+
+        if (xioctl(m_device->fd, VIDIOC_DQBUF, &buf) < 0) {
+            if (errno == EAGAIN) continue;
+            throw std::runtime_error("v4l2 dqbuf error");
+        }
+
+        if (buf.flags & V4L2_BUF_FLAG_ERROR) {
+            LOGW("v4l2 corrupted buffer");
+            m_device->queueBuffer(buf.index);
+            continue;
+        }
+
+        auto *frame = wrapBuffer(buf.index, buf.bytesused);
+        if (frame == nullptr) {
+            m_device->queueBuffer(buf.index);
+            continue;
+        }
+
+        auto captureTime = buf.timestamp.tv_sec * 1000000LL +
+                           buf.timestamp.tv_usec;
+        if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+            V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+            captureTime += clockOffset;
+
+        LOGT("v4l2 frame: index=" << buf.index << ", size=" << buf.bytesused);
+
+        m_frameReadyHandler(frame, captureTime);
+    }
+}
+
+AVFrame *V4l2Source::wrapBuffer(uint32_t index, uint32_t bytesused) const {
+    const auto &buf = m_device->buffers[index];
+
+    auto *frame = av_frame_alloc();
+    if (frame == nullptr) return nullptr;
+
+    frame->format = m_props.pixfmt;
+    frame->width = static_cast<int>(m_props.width);
+    frame->height = static_cast<int>(m_props.height);
+
+    av_image_fill_linesizes(frame->linesize, m_props.pixfmt, frame->width);
+
+    // driver may pad lines, chroma planes are padded proportionally
+    if (m_bytesperline > static_cast<uint32_t>(frame->linesize[0])) {
+        const auto tight = frame->linesize[0];
+        for (auto &linesize : frame->linesize)
+            linesize = static_cast<int>(linesize * m_bytesperline / tight);
+    }
+
+    auto size = av_image_fill_pointers(frame->data, m_props.pixfmt,
+                                       frame->height,
+                                       static_cast<uint8_t *>(buf.data),
+                                       frame->linesize);
+    if (size < 0 || static_cast<uint32_t>(size) > bytesused) {
+        LOGW("v4l2 buffer too small: " << bytesused << " < " << size);
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    auto *ref = new BufferRef{m_device, index};
+    frame->buf[0] =
+        av_buffer_create(static_cast<uint8_t *>(buf.data), bytesused,
+                         releaseBuffer, ref, AV_BUFFER_FLAG_READONLY);
+    if (frame->buf[0] == nullptr) {
+        delete ref;
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    return frame;
+}
+
+void V4l2Source::releaseBuffer(void *opaque, [[maybe_unused]] uint8_t *data) {
+    auto *ref = static_cast<BufferRef *>(opaque);
+
+    if (ref->device->streaming) ref->device->queueBuffer(ref->index);
+
+    delete ref;
+}
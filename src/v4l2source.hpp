@@ -0,0 +1,88 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef V4L2SOURCE_HPP
+#define V4L2SOURCE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+class V4l2Source {
+   public:
+    // handler takes ownership of the frame, buffer returns to the driver
+    // when the last reference to the frame is dropped
+    using FrameReadyHandler =
+        std::function<void(AVFrame *frame, int64_t captureTime)>;
+    using ErrorHandler = std::function<void(void)>;
+
+    struct Props {
+        std::string dev;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t framerate = 0;
+        AVPixelFormat pixfmt = AV_PIX_FMT_NONE;
+        uint32_t queueDepth = 4;
+        friend std::ostream &operator<<(std::ostream &os, const Props &props);
+    };
+
+    V4l2Source(Props props, FrameReadyHandler frameReadyHandler,
+               ErrorHandler errorHandler);
+    ~V4l2Source();
+    void start();
+    static bool supported() noexcept;
+
+   private:
+    static const int m_maxWait = 100;  // ms
+
+    struct Buffer {
+        void *data = nullptr;
+        size_t size = 0;
+    };
+
+    // shared with frames, so device outlives frames that are still in use
+    struct Device {
+        int fd = -1;
+        std::vector<Buffer> buffers;
+        std::atomic_bool streaming{false};
+        ~Device();
+        void queueBuffer(uint32_t index) const;
+    };
+
+    struct BufferRef {
+        std::shared_ptr<Device> device;
+        uint32_t index = 0;
+    };
+
+    Props m_props;
+    FrameReadyHandler m_frameReadyHandler;
+    ErrorHandler m_errorHandler;
+    std::shared_ptr<Device> m_device;
+    uint32_t m_bytesperline = 0;
+    std::thread m_thread;
+    std::atomic_bool m_termination{false};
+
+    void clean();
+    void setFormat();
+    void setFramerate();
+    void allocBuffers();
+    void doCapture();
+    AVFrame *wrapBuffer(uint32_t index, uint32_t bytesused) const;
+    static void releaseBuffer(void *opaque, uint8_t *data);
+};
+
+#endif  // V4L2SOURCE_HPP
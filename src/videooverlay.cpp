@@ -0,0 +1,265 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "videooverlay.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "logger.hpp"
+
+std::ostream &operator<<(std::ostream &os, VideoOverlay::Position position) {
+    switch (position) {
+        case VideoOverlay::Position::TopLeft:
+            os << "top-left";
+            break;
+        case VideoOverlay::Position::TopRight:
+            os << "top-right";
+            break;
+        case VideoOverlay::Position::BottomLeft:
+            os << "bottom-left";
+            break;
+        case VideoOverlay::Position::BottomRight:
+            os << "bottom-right";
+            break;
+    }
+
+    return os;
+}
+
+std::ostream &operator<<(std::ostream &os, const VideoOverlay::Props &props) {
+    os << "src=" << props.srcWidth << "x" << props.srcHeight << "/"
+       << av_get_pix_fmt_name(props.srcPixfmt) << ", dst=" << props.dstWidth
+       << "x" << props.dstHeight << "/"
+       << av_get_pix_fmt_name(props.dstPixfmt) << ", rect=" << props.x << ","
+       << props.y << "," << props.width << "x" << props.height
+       << ", opacity=" << props.opacity << ", fill=" << props.fill;
+    return os;
+}
+
+VideoOverlay::VideoOverlay(Props props) : m_props{props} {
+    LOGD("creating video overlay: " << m_props);
+
+    if (!pixfmtSupported(m_props.dstPixfmt))
+        throw std::runtime_error("unsupported overlay dst pixfmt");
+
+    if (m_props.width == 0 || m_props.height == 0 ||
+        m_props.x + m_props.width > m_props.dstWidth ||
+        m_props.y + m_props.height > m_props.dstHeight)
+        throw std::runtime_error("overlay rect out of frame");
+
+    const auto *desc = av_pix_fmt_desc_get(m_props.dstPixfmt);
+    if (((m_props.x | m_props.width) & ((1U << desc->log2_chroma_w) - 1)) ||
+        ((m_props.y | m_props.height) & ((1U << desc->log2_chroma_h) - 1)))
+        throw std::runtime_error("overlay rect not aligned to chroma");
+
+    m_planeCount = av_pix_fmt_count_planes(m_props.dstPixfmt);
+    m_chromaShiftH = desc->log2_chroma_h;
+
+    if (m_props.fill) {
+        // packed yuv would need black value per component
+        const auto rgb = desc->flags & AV_PIX_FMT_FLAG_RGB;
+        if (!rgb && m_planeCount < 2)
+            throw std::runtime_error("overlay fill not supported for pixfmt");
+        if (!rgb) m_blackValues = {16, 128, 128, 255};  // limited range
+    }
+    m_alpha = std::min(m_props.opacity, 100U) * 256 / 100;
+
+    try {
+        m_swsCtx = sws_getContext(
+            static_cast<int>(m_props.srcWidth),
+            static_cast<int>(m_props.srcHeight), m_props.srcPixfmt,
+            static_cast<int>(m_props.width), static_cast<int>(m_props.height),
+            m_props.dstPixfmt, SWS_BILINEAR, nullptr, nullptr, nullptr);
+        if (m_swsCtx == nullptr)
+            throw std::runtime_error("sws_getContext error");
+
+        for (auto **frame : {&m_backFrame, &m_latestFrame, &m_frontFrame}) {
+            *frame = av_frame_alloc();
+            if (*frame == nullptr)
+                throw std::runtime_error("av_frame_alloc error");
+            (*frame)->format = m_props.dstPixfmt;
+            (*frame)->width = static_cast<int>(m_props.width);
+            (*frame)->height = static_cast<int>(m_props.height);
+            if (av_frame_get_buffer(*frame, 0) < 0)
+                throw std::runtime_error("av_frame_get_buffer error");
+        }
+    } catch (...) {
+        clean();
+        throw;
+    }
+}
+
+VideoOverlay::~VideoOverlay() { clean(); }
+
+void VideoOverlay::clean() {
+    av_frame_free(&m_backFrame);
+    av_frame_free(&m_latestFrame);
+    av_frame_free(&m_frontFrame);
+
+    if (m_swsCtx != nullptr) {
+        sws_freeContext(m_swsCtx);
+        m_swsCtx = nullptr;
+    }
+}
+
+bool VideoOverlay::pixfmtSupported(AVPixelFormat pixfmt) {
+    const auto *desc = av_pix_fmt_desc_get(pixfmt);
+    if (desc == nullptr || desc->nb_components == 0) return false;
+
+    if (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM |
+                       AV_PIX_FMT_FLAG_PAL))
+        return false;
+
+    // blending works on bytes
+    for (int i = 0; i < desc->nb_components; ++i)
+        if (desc->comp[i].depth != 8) return false;
+
+    return true;
+}
+
+void VideoOverlay::push(const uint8_t *data, size_t size, bool yinverted) {
+    uint8_t *planes[4] = {};
+    int linesizes[4] = {};
+
+    auto ret = av_image_fill_arrays(
+        planes, linesizes, data, m_props.srcPixfmt,
+        static_cast<int>(m_props.srcWidth),
+        static_cast<int>(m_props.srcHeight), 1);
+    if (ret < 0 || static_cast<size_t>(ret) > size) {
+        LOGW("overlay frame has invalid size: " << size);
+        return;
+    }
+
+    if (yinverted) {
+        // scaler reads lines backwards when stride is negative
+        const auto shiftH =
+            av_pix_fmt_desc_get(m_props.srcPixfmt)->log2_chroma_h;
+        for (int p = 0; p < 4 && planes[p] != nullptr; ++p) {
+            const auto rows = static_cast<int>(m_props.srcHeight) >>
+                              (p == 1 || p == 2 ? shiftH : 0);
+            planes[p] += (rows - 1) * linesizes[p];
+            linesizes[p] = -linesizes[p];
+        }
+    }
+
+    convert(planes, linesizes);
+}
+
+void VideoOverlay::push(AVFrame *frame) {
+    if (frame->width == static_cast<int>(m_props.srcWidth) &&
+        frame->height == static_cast<int>(m_props.srcHeight)) {
+        convert(frame->data, frame->linesize);
+    } else {
+        LOGW("overlay frame has invalid dim: " << frame->width << "x"
+                                               << frame->height);
+    }
+
+    av_frame_free(&frame);
+}
+
+void VideoOverlay::convert(const uint8_t *const *data, const int *linesizes) {
+    sws_scale(m_swsCtx, data, linesizes, 0,
+              static_cast<int>(m_props.srcHeight), m_backFrame->data,
+              m_backFrame->linesize);
+
+    std::lock_guard lock{m_mtx};
+    std::swap(m_backFrame, m_latestFrame);
+    m_fresh = true;
+}
+
+// plain loop over bytes, compilers turn it into simd code (sse2, neon)
+void VideoOverlay::blendRow(uint8_t *dst, const uint8_t *src, size_t size,
+                            uint32_t alpha) {
+    const auto invAlpha = 256 - alpha;
+    for (size_t i = 0; i < size; ++i)
+        dst[i] =
+            static_cast<uint8_t>((src[i] * alpha + dst[i] * invAlpha) >> 8);
+}
+
+void VideoOverlay::fill(AVFrame *dst) const {
+    for (int p = 0; p < m_planeCount; ++p) {
+        const auto shiftH = p == 1 || p == 2 ? m_chromaShiftH : 0;
+        const auto rows = static_cast<int>(m_props.dstHeight) >> shiftH;
+        const auto rectY = static_cast<int>(m_props.y) >> shiftH;
+        const auto rectRows = static_cast<int>(m_props.height) >> shiftH;
+        const auto rowSize = static_cast<size_t>(av_image_get_linesize(
+            m_props.dstPixfmt, static_cast<int>(m_props.dstWidth), p));
+        const auto left = static_cast<size_t>(av_image_get_linesize(
+            m_props.dstPixfmt, static_cast<int>(m_props.x), p));
+        const auto right = left + static_cast<size_t>(av_image_get_linesize(
+                                      m_props.dstPixfmt,
+                                      static_cast<int>(m_props.width), p));
+
+        for (int r = 0; r < rows; ++r) {
+            auto *row = dst->data[p] + r * dst->linesize[p];
+            if (r < rectY || r >= rectY + rectRows) {
+                std::memset(row, m_blackValues[p], rowSize);
+            } else {
+                std::memset(row, m_blackValues[p], left);
+                std::memset(row + right, m_blackValues[p], rowSize - right);
+            }
+        }
+    }
+}
+
+bool VideoOverlay::fresh() {
+    std::lock_guard lock{m_mtx};
+    return m_fresh;
+}
+
+bool VideoOverlay::blend(AVFrame *dst) {
+    {
+        std::lock_guard lock{m_mtx};
+        if (m_fresh) {
+            std::swap(m_frontFrame, m_latestFrame);
+            m_fresh = false;
+            m_frontValid = true;
+        }
+    }
+
+    // nothing pushed yet
+    if (!m_frontValid) return false;
+
+    if (dst->width != static_cast<int>(m_props.dstWidth) ||
+        dst->height != static_cast<int>(m_props.dstHeight) ||
+        dst->format != m_props.dstPixfmt) {
+        LOGT("overlay skipped due to dst format change");
+        return false;
+    }
+
+    if (m_props.fill) fill(dst);
+
+    for (int p = 0; p < m_planeCount; ++p) {
+        const auto shiftH = p == 1 || p == 2 ? m_chromaShiftH : 0;
+        const auto rows = static_cast<int>(m_props.height) >> shiftH;
+        const auto y = static_cast<int>(m_props.y) >> shiftH;
+        const auto rowSize = static_cast<size_t>(av_image_get_linesize(
+            m_props.dstPixfmt, static_cast<int>(m_props.width), p));
+        const auto xOffset = av_image_get_linesize(
+            m_props.dstPixfmt, static_cast<int>(m_props.x), p);
+
+        for (int r = 0; r < rows; ++r) {
+            auto *dstRow = dst->data[p] + (y + r) * dst->linesize[p] + xOffset;
+            const auto *srcRow =
+                m_frontFrame->data[p] + r * m_frontFrame->linesize[p];
+            if (m_alpha >= 256)
+                std::memcpy(dstRow, srcRow, rowSize);
+            else
+                blendRow(dstRow, srcRow, rowSize, m_alpha);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,89 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef VIDEOOVERLAY_HPP
+#define VIDEOOVERLAY_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+}
+
+// Picture-in-picture layer. Overlay source pushes frames from its own
+// thread in its own format and framerate. Every frame is scaled to overlay
+// rect and converted to encoder format right away, so blending on encoder
+// thread is only a copy (or mix) of the latest frame into the output frame.
+class VideoOverlay {
+   public:
+    enum class Position { TopLeft, TopRight, BottomLeft, BottomRight };
+    friend std::ostream &operator<<(std::ostream &os, Position position);
+
+    struct Props {
+        // format of frames pushed by source
+        uint32_t srcWidth = 0;
+        uint32_t srcHeight = 0;
+        AVPixelFormat srcPixfmt = AV_PIX_FMT_NONE;
+        // format of frames passed to blend
+        uint32_t dstWidth = 0;
+        uint32_t dstHeight = 0;
+        AVPixelFormat dstPixfmt = AV_PIX_FMT_NONE;
+        // overlay rect in dst frame
+        uint32_t x = 0;
+        uint32_t y = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t opacity = 100;  // %
+        bool fill = false;       // dst outside of rect is painted black
+        friend std::ostream &operator<<(std::ostream &os, const Props &props);
+    };
+
+    explicit VideoOverlay(Props props);
+    ~VideoOverlay();
+    VideoOverlay(const VideoOverlay &) = delete;
+    VideoOverlay &operator=(const VideoOverlay &) = delete;
+    // packed frame with unaligned lines, yinverted frame is flipped
+    void push(const uint8_t *data, size_t size, bool yinverted = false);
+    // takes ownership of the frame
+    void push(AVFrame *frame);
+    // blends latest pushed frame, dst frame has to be writable, returns
+    // false when nothing was blended
+    bool blend(AVFrame *dst);
+    // frame was pushed after the last blend
+    bool fresh();
+    static bool pixfmtSupported(AVPixelFormat pixfmt);
+
+   private:
+    Props m_props;
+    SwsContext *m_swsCtx = nullptr;
+    // back is written by source thread, front is read by encoder thread,
+    // latest is swapped with one of them under the lock
+    AVFrame *m_backFrame = nullptr;
+    AVFrame *m_latestFrame = nullptr;
+    AVFrame *m_frontFrame = nullptr;
+    bool m_fresh = false;
+    bool m_frontValid = false;
+    std::mutex m_mtx;
+    int m_planeCount = 0;
+    int m_chromaShiftH = 0;
+    std::array<uint8_t, 4> m_blackValues{};  // per plane
+    uint32_t m_alpha = 256;  // opacity scaled to 0-256
+
+    void clean();
+    void convert(const uint8_t *const *data, const int *linesizes);
+    void fill(AVFrame *dst) const;
+    static void blendRow(uint8_t *dst, const uint8_t *src, size_t size,
+                         uint32_t alpha);
+};
+
+#endif  // VIDEOOVERLAY_HPP
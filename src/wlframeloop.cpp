@@ -0,0 +1,71 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "wlframeloop.hpp"
+
+#include <poll.h>
+
+#include <algorithm>
+#include <cerrno>
+
+WlFrameLoop::WlFrameLoop(wl_display *display,
+                         std::chrono::microseconds frameDur,
+                         Clock::time_point firstRequestTime)
+    : m_display{display},
+      m_frameDur{frameDur},
+      m_nextRequestTime{firstRequestTime} {}
+
+bool WlFrameLoop::requestDue(bool requestPending) {
+    if (requestPending) return false;
+
+    auto now = Clock::now();
+    if (now < m_nextRequestTime) return false;
+
+    m_nextRequestTime = now + m_frameDur;
+
+    return true;
+}
+
+bool WlFrameLoop::dispatchEvents(bool requestPending,
+                                 bool hasLastFrame) const {
+    auto deadline = Clock::now() + m_maxPollDur;
+    if (hasLastFrame)
+        deadline = std::min(deadline, m_lastDeliveryTime + m_keepAliveDur);
+    if (!requestPending) deadline = std::min(deadline, m_nextRequestTime);
+
+    while (wl_display_prepare_read(m_display) != 0) {
+        if (wl_display_dispatch_pending(m_display) == -1) return false;
+    }
+
+    if (wl_display_flush(m_display) == -1 && errno != EAGAIN) {
+        wl_display_cancel_read(m_display);
+        return false;
+    }
+
+    const auto timeout = std::clamp(
+        std::chrono::duration_cast<std::chrono::milliseconds>(deadline -
+                                                              Clock::now()),
+        std::chrono::milliseconds::zero(), m_maxPollDur);
+
+    pollfd pfd{wl_display_get_fd(m_display), POLLIN, 0};
+
+    auto ret = poll(&pfd, 1, static_cast<int>(timeout.count()));
+    if (ret <= 0) {
+        wl_display_cancel_read(m_display);
+        return ret == 0 || errno == EINTR;
+    }
+
+    if (wl_display_read_events(m_display) == -1) return false;
+
+    return wl_display_dispatch_pending(m_display) != -1;
+}
+
+bool WlFrameLoop::keepAliveDue() const {
+    return Clock::now() >= m_lastDeliveryTime + m_keepAliveDur;
+}
+
+void WlFrameLoop::frameDelivered() { m_lastDeliveryTime = Clock::now(); }
@@ -0,0 +1,46 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef WLFRAMELOOP_HPP
+#define WLFRAMELOOP_HPP
+
+#include <wayland-client.h>
+
+#include <chrono>
+
+// Timing of wayland capture thread. Compositor sends frame only on screen
+// change, so next frame is requested not earlier than one frame duration
+// after previous, and last frame is re-sent when screen is static, so
+// stream does not stall.
+class WlFrameLoop {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    WlFrameLoop(wl_display *display, std::chrono::microseconds frameDur,
+                Clock::time_point firstRequestTime = Clock::now());
+    // true when frame should be requested now, next request is scheduled
+    bool requestDue(bool requestPending);
+    // dispatches wl events until next request or keep-alive time, false on
+    // display error
+    bool dispatchEvents(bool requestPending, bool hasLastFrame) const;
+    // true when last frame should be re-sent
+    bool keepAliveDue() const;
+    void frameDelivered();
+
+   private:
+    // last frame is re-sent after that
+    static constexpr const std::chrono::milliseconds m_keepAliveDur{500};
+    // max time of waiting for wl events, limits termination latency
+    static constexpr const std::chrono::milliseconds m_maxPollDur{100};
+
+    wl_display *m_display = nullptr;
+    std::chrono::microseconds m_frameDur;
+    Clock::time_point m_nextRequestTime;
+    Clock::time_point m_lastDeliveryTime;
+};
+
+#endif  // WLFRAMELOOP_HPP
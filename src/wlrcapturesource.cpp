@@ -0,0 +1,508 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include "wlrcapturesource.hpp"
+
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "logger.hpp"
+
+WlrCaptureSource::WlrCaptureSource(uint32_t outputIdx, uint32_t framerate,
+                                   DataReadyHandler dataReadyHandler,
+                                   ErrorHandler errorHandler)
+    : m_dataReadyHandler{std::move(dataReadyHandler)},
+      m_errorHandler{std::move(errorHandler)},
+      m_frameDur{1000000 / std::max(framerate, 1u)} {
+    LOGD("creating wlr-capture: output=" << outputIdx
+                                         << ", framerate=" << framerate);
+
+    wlRegister(&m_globals);
+
+    if (!m_globals.ok() || outputIdx >= m_globals.outputs.size()) {
+        clean();
+        throw std::runtime_error("failed to init wlr-capture");
+    }
+
+    m_output = m_globals.outputs[outputIdx].output;
+
+    try {
+        m_props = outputProps(m_globals, outputIdx);
+    } catch (...) {
+        clean();
+        throw;
+    }
+
+    if (m_props.pixfmt == AV_PIX_FMT_NONE) {
+        clean();
+        throw std::runtime_error("unsupported wlr-capture pixfmt");
+    }
+}
+
+WlrCaptureSource::~WlrCaptureSource() {
+    LOGD("wlr-capture termination started");
+    m_terminating = true;
+    if (m_wlThread.joinable()) m_wlThread.join();
+    LOGD("wl tread joined");
+    clean();
+    LOGD("wlr-capture termination completed");
+}
+
+void WlrCaptureSource::clean() {
+    releaseFrame();
+    for (auto &buf : m_bufs) buf.reset();
+    cleanGlobals(&m_globals);
+}
+
+void WlrCaptureSource::cleanGlobals(Globals *globals) {
+    if (globals->manager != nullptr) {
+        zwlr_screencopy_manager_v1_destroy(globals->manager);
+        globals->manager = nullptr;
+    }
+    for (auto &output : globals->outputs) wl_output_destroy(output.output);
+    globals->outputs.clear();
+    if (globals->shm != nullptr) {
+        wl_shm_destroy(globals->shm);
+        globals->shm = nullptr;
+    }
+    if (globals->registry != nullptr) {
+        wl_registry_destroy(globals->registry);
+        globals->registry = nullptr;
+    }
+    if (globals->display != nullptr) {
+        wl_display_disconnect(globals->display);
+        globals->display = nullptr;
+    }
+}
+
+bool WlrCaptureSource::supported() noexcept {
+    try {
+        Globals globals;
+        wlRegister(&globals);
+        auto ok = globals.ok();
+        cleanGlobals(&globals);
+        if (!ok) LOGD("wlr-screencopy is not supported by compositor");
+        return ok;
+    } catch (const std::runtime_error &e) {
+        LOGD(e.what());
+    } catch (...) {
+        LOGE("unknown error");
+    }
+
+    return false;
+}
+
+void WlrCaptureSource::wlRegister(Globals *globals) {
+    globals->display = wl_display_connect(nullptr);
+    if (globals->display == nullptr)
+        throw std::runtime_error("failed to get wl display");
+
+    globals->registry = wl_display_get_registry(globals->display);
+    if (globals->registry == nullptr) {
+        wl_display_disconnect(globals->display);
+        globals->display = nullptr;
+        throw std::runtime_error("failed to get wl registry");
+    }
+
+    wl_registry_add_listener(globals->registry, &wlGlobalListener, globals);
+
+    // first roundtrip binds globals, second one receives output events
+    wl_display_roundtrip(globals->display);
+    wl_display_roundtrip(globals->display);
+}
+
+std::vector<WlrCaptureSource::Props> WlrCaptureSource::properties() {
+    Globals globals;
+    wlRegister(&globals);
+
+    std::vector<Props> props;
+
+    try {
+        if (globals.ok()) {
+            for (size_t i = 0; i < globals.outputs.size(); ++i)
+                props.push_back(outputProps(globals, i));
+        }
+    } catch (...) {
+        cleanGlobals(&globals);
+        throw;
+    }
+
+    cleanGlobals(&globals);
+
+    return props;
+}
+
+WlrCaptureSource::Props WlrCaptureSource::outputProps(const Globals &globals,
+                                                      size_t idx) {
+    const auto &output = globals.outputs.at(idx);
+
+    Props props;
+    props.outputName = fmt::format("{} {}", output.make, output.model);
+
+    // shm buffer params are only announced for a frame, so frame is
+    // requested and destroyed without copying
+    auto *frame = zwlr_screencopy_manager_v1_capture_output(globals.manager,
+                                                            0, output.output);
+    if (frame == nullptr)
+        throw std::runtime_error("failed to capture wlr frame");
+
+    zwlr_screencopy_frame_v1_add_listener(frame, &wlProbeListener, &props);
+    wl_display_roundtrip(globals.display);
+    zwlr_screencopy_frame_v1_destroy(frame);
+
+    props.pixfmt = wl2FfPixfmt(props.shmFormat);
+
+    LOGD("wlr output: idx=" << idx << ", name=" << props.outputName
+                            << ", width=" << props.width
+                            << ", height=" << props.height
+                            << ", stride=" << props.stride
+                            << ", format=" << props.shmFormat);
+
+    return props;
+}
+
+void WlrCaptureSource::wlGlobalCallback(void *data, wl_registry *registry,
+                                        uint32_t id, const char *interface,
+                                        uint32_t version) {
+    LOGD("wl global: interface=" << interface << ", version=" << version);
+
+    auto *globals = static_cast<Globals *>(data);
+
+    if (strcmp(interface, wl_shm_interface.name) == 0) {
+        globals->shm = static_cast<wl_shm *>(wl_registry_bind(
+            registry, id, &wl_shm_interface, std::min(version, 1U)));
+    } else if (strcmp(interface, wl_output_interface.name) == 0) {
+        auto *output = static_cast<wl_output *>(wl_registry_bind(
+            registry, id, &wl_output_interface, std::min(version, 2U)));
+        if (output != nullptr) {
+            globals->outputs.push_back({output, {}, {}});
+            wl_output_add_listener(output, &wlOutputListener, globals);
+        }
+    } else if (strcmp(interface, zwlr_screencopy_manager_v1_interface.name) ==
+               0) {
+        globals->manager =
+            static_cast<zwlr_screencopy_manager_v1 *>(wl_registry_bind(
+                registry, id, &zwlr_screencopy_manager_v1_interface,
+                std::min(version, 3U)));
+    }
+}
+
+void WlrCaptureSource::wlGlobalRemoveCallback(
+    [[maybe_unused]] void *data, [[maybe_unused]] wl_registry *registry,
+    [[maybe_unused]] uint32_t id) {}
+
+void WlrCaptureSource::start() {
+    if (m_terminating) return;
+
+    LOGD("starting wlr-capture");
+
+    for (auto &buf : m_bufs) buf.emplace(m_globals.shm, m_props);
+
+    m_wlThread = std::thread([this] {
+        LOGD("wl thread started");
+
+        // compositor sends frame only when output has been damaged
+        WlFrameLoop loop{m_globals.display, m_frameDur};
+
+        while (!m_terminating) {
+            if (loop.requestDue(m_frame != nullptr)) captureFrame();
+
+            if (!loop.dispatchEvents(m_frame != nullptr, m_lastBuf != nullptr))
+                break;
+
+            if (m_bufferMismatch || m_failedCount >= m_maxFailedCount) break;
+
+            if (m_readyBuf != nullptr) {
+                deliverFrame(std::exchange(m_readyBuf, nullptr));
+                loop.frameDelivered();
+            } else if (m_lastBuf != nullptr && loop.keepAliveDue()) {
+                LOGT("wlr keep alive");
+                deliverFrame(m_lastBuf);
+                loop.frameDelivered();
+            }
+        }
+
+        if (!m_terminating) {
+            m_terminating = true;
+            if (m_bufferMismatch) {
+                LOGE("wlr output buffer params changed");
+            } else if (m_failedCount >= m_maxFailedCount) {
+                LOGE("too many failed wlr frames");
+            } else {
+                auto err = wl_display_get_error(m_globals.display);
+                LOGE(fmt::format("wl error: {} ({})", strerror(err), err));
+            }
+            if (m_errorHandler) m_errorHandler();
+        }
+
+        LOGD("wl thread ended");
+    });
+
+    LOGD("wlr-capture started");
+}
+
+void WlrCaptureSource::deliverFrame(WlBufferWrapper *buf) {
+    // re-sent frame is captured now
+    const auto captureTime = buf == m_lastBuf ? 0 : buf->captureTime;
+
+    m_yinverted = buf->yinverted;
+    m_lastBuf = buf;
+
+    if (m_dataReadyHandler)
+        m_dataReadyHandler(buf->data, buf->size, captureTime);
+}
+
+void WlrCaptureSource::captureFrame() {
+    LOGT("wlr capture frame");
+
+    m_frame = zwlr_screencopy_manager_v1_capture_output(m_globals.manager, 1,
+                                                        m_output);
+    if (m_frame == nullptr) {
+        LOGW("failed to capture wlr frame");
+        ++m_failedCount;
+        return;
+    }
+
+    zwlr_screencopy_frame_v1_add_listener(m_frame, &wlFrameListener, this);
+}
+
+void WlrCaptureSource::copyFrame() {
+    // buffer that was delivered last is never copied to, because it may
+    // be re-sent as keep alive frame
+    auto *buf = &*m_bufs[m_nextBufIdx];
+    if (buf == m_lastBuf) {
+        m_nextBufIdx = (m_nextBufIdx + 1) % m_bufCount;
+        buf = &*m_bufs[m_nextBufIdx];
+    }
+    m_nextBufIdx = (m_nextBufIdx + 1) % m_bufCount;
+
+    m_recordingBuf = buf;
+    m_damageArea = 0;
+
+    // first frame is copied without waiting for damage, so stream starts
+    // also when screen is static
+    if (m_lastBuf != nullptr &&
+        zwlr_screencopy_frame_v1_get_version(m_frame) >=
+            ZWLR_SCREENCOPY_FRAME_V1_COPY_WITH_DAMAGE_SINCE_VERSION)
+        zwlr_screencopy_frame_v1_copy_with_damage(m_frame, buf->buffer);
+    else
+        zwlr_screencopy_frame_v1_copy(m_frame, buf->buffer);
+}
+
+void WlrCaptureSource::releaseFrame() {
+    if (m_frame != nullptr) {
+        zwlr_screencopy_frame_v1_destroy(m_frame);
+        m_frame = nullptr;
+    }
+}
+
+void WlrCaptureSource::wlFrameBufferCallback(
+    void *data, zwlr_screencopy_frame_v1 *frame, uint32_t format,
+    uint32_t width, uint32_t height, uint32_t stride) {
+    auto *source = static_cast<WlrCaptureSource *>(data);
+
+    if (format != source->m_props.shmFormat ||
+        width != source->m_props.width || height != source->m_props.height ||
+        stride != source->m_props.stride) {
+        LOGW("wlr buffer params mismatch: format="
+             << format << ", width=" << width << ", height=" << height
+             << ", stride=" << stride);
+        source->m_bufferMismatch = true;
+        return;
+    }
+
+    // before v3 there is no buffer_done and shm is the only buffer type
+    if (zwlr_screencopy_frame_v1_get_version(frame) <
+        ZWLR_SCREENCOPY_FRAME_V1_BUFFER_DONE_SINCE_VERSION)
+        source->copyFrame();
+}
+
+void WlrCaptureSource::wlFrameBufferDoneCallback(
+    void *data, [[maybe_unused]] zwlr_screencopy_frame_v1 *frame) {
+    auto *source = static_cast<WlrCaptureSource *>(data);
+    if (!source->m_bufferMismatch) source->copyFrame();
+}
+
+void WlrCaptureSource::wlFrameLinuxDmabufCallback(
+    [[maybe_unused]] void *data,
+    [[maybe_unused]] zwlr_screencopy_frame_v1 *frame,
+    [[maybe_unused]] uint32_t format, [[maybe_unused]] uint32_t width,
+    [[maybe_unused]] uint32_t height) {
+    // dmabuf is not used, compositor reads frame back to shm buffer
+    LOGT("wlr dmabuf offered: format=" << format << ", width=" << width
+                                       << ", height=" << height);
+}
+
+void WlrCaptureSource::wlFrameFlagsCallback(
+    void *data, [[maybe_unused]] zwlr_screencopy_frame_v1 *frame,
+    uint32_t flags) {
+    auto *source = static_cast<WlrCaptureSource *>(data);
+    if (source->m_recordingBuf != nullptr)
+        source->m_recordingBuf->yinverted =
+            flags & ZWLR_SCREENCOPY_FRAME_V1_FLAGS_Y_INVERT;
+}
+
+void WlrCaptureSource::wlFrameDamageCallback(
+    void *data, [[maybe_unused]] zwlr_screencopy_frame_v1 *frame,
+    [[maybe_unused]] uint32_t x, [[maybe_unused]] uint32_t y, uint32_t width,
+    uint32_t height) {
+    auto *source = static_cast<WlrCaptureSource *>(data);
+    source->m_damageArea += static_cast<uint64_t>(width) * height;
+}
+
+void WlrCaptureSource::wlFrameReadyCallback(
+    void *data, [[maybe_unused]] zwlr_screencopy_frame_v1 *frame,
+    uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec) {
+    using namespace std::chrono;
+
+    auto *source = static_cast<WlrCaptureSource *>(data);
+
+    // presentation time is in monotonic clock
+    const auto presentationTime =
+        seconds{(static_cast<uint64_t>(tv_sec_hi) << 32) | tv_sec_lo} +
+        nanoseconds{tv_nsec};
+    const auto age = steady_clock::now().time_since_epoch() -
+                     duration_cast<steady_clock::duration>(presentationTime);
+
+    LOGT("wlr frame ready: damage="
+         << 100 * source->m_damageArea /
+                std::max<uint64_t>(1, static_cast<uint64_t>(
+                                          source->m_props.width) *
+                                          source->m_props.height)
+         << "%");
+
+    source->m_readyBuf = std::exchange(source->m_recordingBuf, nullptr);
+    if (source->m_readyBuf != nullptr)
+        source->m_readyBuf->captureTime =
+            age < steady_clock::duration::zero() || age > m_maxTimestampAge
+                ? 0
+                : duration_cast<microseconds>(
+                      (system_clock::now() - age).time_since_epoch())
+                      .count();
+    source->m_failedCount = 0;
+    source->releaseFrame();
+}
+
+void WlrCaptureSource::wlFrameFailedCallback(
+    void *data, [[maybe_unused]] zwlr_screencopy_frame_v1 *frame) {
+    LOGW("wlr frame failed");
+
+    auto *source = static_cast<WlrCaptureSource *>(data);
+    source->m_recordingBuf = nullptr;
+    ++source->m_failedCount;
+    source->releaseFrame();
+}
+
+void WlrCaptureSource::wlProbeBufferCallback(
+    void *data, [[maybe_unused]] zwlr_screencopy_frame_v1 *frame,
+    uint32_t format, uint32_t width, uint32_t height, uint32_t stride) {
+    auto *props = static_cast<Props *>(data);
+    props->shmFormat = format;
+    props->width = width;
+    props->height = height;
+    props->stride = stride;
+}
+
+WlrCaptureSource::WlBufferWrapper::WlBufferWrapper(wl_shm *shm,
+                                                   const Props &props) {
+    size = props.stride * props.height;
+
+    char filename[] = "/tmp/wlr-capture-shm-XXXXXX";
+
+    auto fd = mkstemp(filename);
+    if (fd < 0)
+        throw std::runtime_error("failed to create tmp file for wl buffer");
+
+    auto flags = fcntl(fd, F_GETFD);
+    if (flags != -1) fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        throw std::runtime_error(
+            fmt::format("ftruncate failed: {}", strerror(errno)));
+    }
+
+    data = static_cast<unsigned char *>(
+        mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+    unlink(filename);
+
+    if (data == static_cast<unsigned char *>(MAP_FAILED)) {
+        data = nullptr;
+        close(fd);
+        throw std::runtime_error("mmap failed");
+    }
+
+    auto *pool = wl_shm_create_pool(shm, fd, size);
+    buffer = wl_shm_pool_create_buffer(pool, 0, props.width, props.height,
+                                       props.stride, props.shmFormat);
+    wl_shm_pool_destroy(pool);
+
+    close(fd);
+}
+
+WlrCaptureSource::WlBufferWrapper::~WlBufferWrapper() {
+    if (buffer != nullptr) wl_buffer_destroy(buffer);
+    if (data != nullptr) munmap(data, size);
+}
+
+AVPixelFormat WlrCaptureSource::wl2FfPixfmt(uint32_t wlFormat) {
+    // wl_shm formats are little-endian
+    switch (wlFormat) {
+        case WL_SHM_FORMAT_ARGB8888:
+        case WL_SHM_FORMAT_XRGB8888:
+            return AV_PIX_FMT_BGR0;
+        case WL_SHM_FORMAT_ABGR8888:
+        case WL_SHM_FORMAT_XBGR8888:
+            return AV_PIX_FMT_RGB0;
+        default:
+            LOGW("unsupported wl pixfmt: " << wlFormat);
+    }
+
+    return AV_PIX_FMT_NONE;
+}
+
+void WlrCaptureSource::wlOutputGeometryCallback(
+    void *data, wl_output *wl_output, [[maybe_unused]] int32_t x,
+    [[maybe_unused]] int32_t y, [[maybe_unused]] int32_t physical_width,
+    [[maybe_unused]] int32_t physical_height,
+    [[maybe_unused]] int32_t subpixel, const char *make, const char *model,
+    [[maybe_unused]] int32_t transform) {
+    auto *globals = static_cast<Globals *>(data);
+
+    auto it = std::find_if(
+        globals->outputs.begin(), globals->outputs.end(),
+        [wl_output](const auto &output) { return output.output == wl_output; });
+    if (it == globals->outputs.end()) return;
+
+    it->make = make == nullptr ? "" : make;
+    it->model = model == nullptr ? "" : model;
+}
+
+void WlrCaptureSource::wlOutputModeCallback(
+    [[maybe_unused]] void *data, [[maybe_unused]] wl_output *wl_output,
+    [[maybe_unused]] uint32_t flags, int32_t width, int32_t height,
+    int32_t refresh) {
+    LOGD("wl output mode: width=" << width << ", height=" << height
+                                  << ", refresh=" << refresh);
+}
+
+void WlrCaptureSource::wlOutputDoneCallback(
+    [[maybe_unused]] void *data, [[maybe_unused]] wl_output *wl_output) {}
+
+void WlrCaptureSource::wlOutputScaleCallback(
+    [[maybe_unused]] void *data, [[maybe_unused]] wl_output *wl_output,
+    int32_t factor) {
+    LOGD("wl output scale: factor=" << factor);
+}
@@ -0,0 +1,189 @@
+/* Copyright (C) 2023 Michal Kosciesza <michal@mkiol.net>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef WLRCAPTURESOURCE_H
+#define WLRCAPTURESOURCE_H
+
+#include <wayland-client.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+
+#include "wayland-wlr-screencopy-client-protocol.h"
+#include "wlframeloop.hpp"
+
+class WlrCaptureSource {
+   public:
+    // capture time is in micro s since epoch, 0 when not known
+    using DataReadyHandler =
+        std::function<void(const uint8_t *, size_t, int64_t)>;
+    using ErrorHandler = std::function<void(void)>;
+
+    struct Props {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t stride = 0;
+        uint32_t framerate = 15;  // max, frames are delivered on damage
+        uint32_t shmFormat = 0;
+        AVPixelFormat pixfmt = AV_PIX_FMT_NONE;
+        std::string outputName;
+    };
+
+    WlrCaptureSource(uint32_t outputIdx, uint32_t framerate,
+                     DataReadyHandler dataReadyHandler,
+                     ErrorHandler errorHandler);
+    ~WlrCaptureSource();
+    void start();
+    static bool supported() noexcept;
+    // props of every output, index in vector is output index
+    static std::vector<Props> properties();
+    inline bool yinverted() const { return m_yinverted; }
+
+   private:
+    // compositor copies to one buffer while the other one is being read
+    static constexpr const size_t m_bufCount = 2;
+    // older presentation times are not trusted
+    static constexpr const std::chrono::milliseconds m_maxTimestampAge{1000};
+    static constexpr const uint32_t m_maxFailedCount = 10;
+
+    struct Output {
+        wl_output *output = nullptr;
+        std::string make;
+        std::string model;
+    };
+
+    struct Globals {
+        wl_display *display = nullptr;
+        wl_registry *registry = nullptr;
+        wl_shm *shm = nullptr;
+        zwlr_screencopy_manager_v1 *manager = nullptr;
+        std::vector<Output> outputs;
+        inline auto ok() const {
+            return display && registry && shm && manager && !outputs.empty();
+        }
+    };
+
+    struct WlBufferWrapper {
+        wl_buffer *buffer = nullptr;
+        uint8_t *data = nullptr;
+        size_t size = 0;
+        bool yinverted = false;
+        int64_t captureTime = 0;  // micro s since epoch
+        explicit WlBufferWrapper(wl_shm *shm, const Props &props);
+        ~WlBufferWrapper();
+        WlBufferWrapper(const WlBufferWrapper &) = delete;
+        WlBufferWrapper &operator=(const WlBufferWrapper &) = delete;
+    };
+
+    DataReadyHandler m_dataReadyHandler;
+    ErrorHandler m_errorHandler;
+    Globals m_globals;
+    Props m_props;
+    wl_output *m_output = nullptr;
+    std::chrono::microseconds m_frameDur;
+    std::array<std::optional<WlBufferWrapper>, m_bufCount> m_bufs;
+    size_t m_nextBufIdx = 0;
+    zwlr_screencopy_frame_v1 *m_frame = nullptr;
+    WlBufferWrapper *m_recordingBuf = nullptr;
+    WlBufferWrapper *m_readyBuf = nullptr;
+    WlBufferWrapper *m_lastBuf = nullptr;
+    uint64_t m_damageArea = 0;
+    uint32_t m_failedCount = 0;
+    bool m_bufferMismatch = false;
+    std::thread m_wlThread;
+    std::atomic_bool m_yinverted{false};
+    std::atomic_bool m_terminating{false};
+
+    void clean();
+    void captureFrame();
+    void copyFrame();
+    void releaseFrame();
+    void deliverFrame(WlBufferWrapper *buf);
+    static void wlRegister(Globals *globals);
+    static void cleanGlobals(Globals *globals);
+    static Props outputProps(const Globals &globals, size_t idx);
+    static AVPixelFormat wl2FfPixfmt(uint32_t wlFormat);
+    static void wlGlobalCallback(void *data, wl_registry *registry, uint32_t id,
+                                 const char *interface, uint32_t version);
+    static void wlGlobalRemoveCallback(void *data, wl_registry *registry,
+                                       uint32_t id);
+    static void wlOutputGeometryCallback(void *data, wl_output *wl_output,
+                                         int32_t x, int32_t y,
+                                         int32_t physical_width,
+                                         int32_t physical_height,
+                                         int32_t subpixel, const char *make,
+                                         const char *model, int32_t transform);
+    static void wlOutputModeCallback(void *data, wl_output *wl_output,
+                                     uint32_t flags, int32_t width,
+                                     int32_t height, int32_t refresh);
+    static void wlOutputDoneCallback(void *data, wl_output *wl_output);
+    static void wlOutputScaleCallback(void *data, wl_output *wl_output,
+                                      int32_t factor);
+    static void wlFrameBufferCallback(void *data,
+                                      zwlr_screencopy_frame_v1 *frame,
+                                      uint32_t format, uint32_t width,
+                                      uint32_t height, uint32_t stride);
+    static void wlFrameFlagsCallback(void *data,
+                                     zwlr_screencopy_frame_v1 *frame,
+                                     uint32_t flags);
+    static void wlFrameReadyCallback(void *data,
+                                     zwlr_screencopy_frame_v1 *frame,
+                                     uint32_t tv_sec_hi, uint32_t tv_sec_lo,
+                                     uint32_t tv_nsec);
+    static void wlFrameFailedCallback(void *data,
+                                      zwlr_screencopy_frame_v1 *frame);
+    static void wlFrameDamageCallback(void *data,
+                                      zwlr_screencopy_frame_v1 *frame,
+                                      uint32_t x, uint32_t y, uint32_t width,
+                                      uint32_t height);
+    static void wlFrameLinuxDmabufCallback(void *data,
+                                           zwlr_screencopy_frame_v1 *frame,
+                                           uint32_t format, uint32_t width,
+                                           uint32_t height);
+    static void wlFrameBufferDoneCallback(void *data,
+                                          zwlr_screencopy_frame_v1 *frame);
+    static void wlProbeBufferCallback(void *data,
+                                      zwlr_screencopy_frame_v1 *frame,
+                                      uint32_t format, uint32_t width,
+                                      uint32_t height, uint32_t stride);
+
+    inline static const wl_registry_listener wlGlobalListener{
+        wlGlobalCallback, wlGlobalRemoveCallback};
+    inline static const wl_output_listener wlOutputListener{
+        wlOutputGeometryCallback, wlOutputModeCallback, wlOutputDoneCallback,
+        wlOutputScaleCallback};
+    inline static const zwlr_screencopy_frame_v1_listener wlFrameListener{
+        wlFrameBufferCallback,      wlFrameFlagsCallback,
+        wlFrameReadyCallback,       wlFrameFailedCallback,
+        wlFrameDamageCallback,      wlFrameLinuxDmabufCallback,
+        wlFrameBufferDoneCallback};
+    // only used to read shm buffer params in properties()
+    inline static const zwlr_screencopy_frame_v1_listener wlProbeListener{
+        wlProbeBufferCallback,
+        [](void *, zwlr_screencopy_frame_v1 *, uint32_t) {},
+        [](void *, zwlr_screencopy_frame_v1 *, uint32_t, uint32_t,
+           uint32_t) {},
+        [](void *, zwlr_screencopy_frame_v1 *) {},
+        [](void *, zwlr_screencopy_frame_v1 *, uint32_t, uint32_t, uint32_t,
+           uint32_t) {},
+        [](void *, zwlr_screencopy_frame_v1 *, uint32_t, uint32_t,
+           uint32_t) {},
+        [](void *, zwlr_screencopy_frame_v1 *) {}};
+};
+
+#endif  // WLRCAPTURESOURCE_H